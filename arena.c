@@ -0,0 +1,123 @@
+/**
+ * @file arena.c
+ * @brief Static RAM arena: the large buffers sized by the build profile, checked against its budget
+ *
+ * The arena is a single static object, so the linker map and the size of .bss show it as a whole; the table of its
+ * owners is in the binary info. Free blocks of a pool are linked through their first word; pools are only used from
+ * the main loop, so they need no lock.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include "pico/binary_info.h"
+#include "arena.h"
+
+#define STR(x)		#x
+#define XSTR(x)		STR(x)
+
+// pool state
+struct pool {
+	uint8_t * base;
+	uint32_t block;				// bytes of a block
+	uint32_t count;				// number of blocks
+	void * free_list;
+	uint32_t nb_free;
+};
+
+_Static_assert (ARENA_SECTOR >= sizeof (void *), "pool blocks hold the free list link");
+
+// globals
+struct arena_layout arena;
+
+#define ARENA_POOL_INIT(name, block, count)	{ arena.name, (block), (count), NULL, 0 },
+static struct pool pools [ARENA_NB_POOLS] = {
+	ARENA_POOLS (ARENA_POOL_INIT)
+};
+
+// table of owners in binary info: "name=count*bytes" for each of them
+#define ARENA_REPORT(name, element, count)	" " #name "=" XSTR (count) "*" XSTR (element)
+bi_decl (bi_program_feature ("arena " XSTR (ARENA_BUDGET) ":" ARENA_BUFFERS (ARENA_REPORT) ARENA_POOLS (ARENA_REPORT)));
+
+
+// build the free lists of the pools, and print the arena table
+void arena_init (void)
+{
+	uint32_t i, j;
+	struct pool * p;
+
+	for (i = 0; i < ARENA_NB_POOLS; i++) {
+		p = &pools [i];
+		p->free_list = NULL;
+		for (j = p->count; j > 0; j--) {
+			*(void **) (p->base + (j - 1) * p->block) = p->free_list;
+			p->free_list = p->base + (j - 1) * p->block;
+		}
+		p->nb_free = p->count;
+	}
+
+	printf ("Arena: %lu of %lu bytes\r\n", (unsigned long) sizeof (arena), (unsigned long) ARENA_BUDGET);
+#define ARENA_PRINT(name, element, count)	printf ("  %-14s %6lu\r\n", #name, (unsigned long) ARENA_SIZEOF (name));
+	ARENA_BUFFERS (ARENA_PRINT)
+	ARENA_POOLS (ARENA_PRINT)
+#undef ARENA_PRINT
+}
+
+
+// take a block of "pool"; returns NULL if all blocks are taken
+void * arena_get (enum arena_pool pool)
+{
+	struct pool * p = &pools [pool];
+	void * block = p->free_list;
+
+	if (block == NULL) return NULL;
+	p->free_list = *(void **) block;
+	p->nb_free--;
+	return block;
+}
+
+
+// give back "block" taken from "pool"; NULL is ignored
+void arena_put (enum arena_pool pool, void * block)
+{
+	struct pool * p = &pools [pool];
+
+	if (block == NULL) return;
+	*(void **) block = p->free_list;
+	p->free_list = block;
+	p->nb_free++;
+}
+
+
+// take "count" blocks of "pool" into "blocks"; returns false, with no block taken, if there are not enough free blocks
+bool arena_get_blocks (enum arena_pool pool, uint8_t ** blocks, uint32_t count)
+{
+	uint32_t i;
+
+	if (pools [pool].nb_free < count) return false;
+	for (i = 0; i < count; i++) blocks [i] = arena_get (pool);
+	return true;
+}
+
+
+// give back "count" blocks taken by arena_get_blocks (); "blocks" are cleared, so giving them back twice is harmless
+void arena_put_blocks (enum arena_pool pool, uint8_t ** blocks, uint32_t count)
+{
+	uint32_t i;
+
+	for (i = 0; i < count; i++) {
+		arena_put (pool, blocks [i]);
+		blocks [i] = NULL;
+	}
+}
+
+
+// number of free blocks of "pool"
+uint32_t arena_free (enum arena_pool pool)
+{
+	return pools [pool].nb_free;
+}
@@ -0,0 +1,117 @@
+/**
+ * @file arena.h
+ * @brief Static RAM arena: the large buffers sized by the build profile, checked against its budget
+ *
+ * Owners are listed once in ARENA_BUFFERS and ARENA_POOLS: each gets a member of struct arena_layout, so their sizes and
+ * the total are known at compile time. A build over ARENA_BUDGET does not compile, and the table is stored in the binary
+ * info of the program (picotool info -a), and printed at boot by arena_init ().
+ *
+ * Buffers belong to one module for the whole run. Pools are fixed-size blocks shared by modules that do not need them
+ * all at the same time: a module takes its blocks when it starts, and gives them back when it is done.
+ *
+ * Buffers that are the same in every profile stay static in their module, and are not counted in ARENA_BUDGET:
+ * - audio.c audio_buf (2 KB): ring of the ADC DMA, which must be aligned on its own size, beyond ARENA_ALIGN;
+ * - display.c framebuffer (1 KB) and oled.c transfer (272 bytes): sized by the 128x64 screen;
+ * - beat.c odf (1 KB), acf (632 bytes) and prior (316 bytes): sized by the 4-second analysis window and the tempo range;
+ * - reclock.c queue (64 bytes).
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include "pico/stdlib.h"
+
+// build profiles, selected with -DARENA_PROFILE=...
+#define ARENA_PROFILE_FULL	0		// all features at full size
+#define ARENA_PROFILE_LITE	1		// shorter loops and fewer buffers, leaves RAM to new features
+
+#ifndef ARENA_PROFILE
+#define ARENA_PROFILE	ARENA_PROFILE_FULL
+#endif
+
+#if ARENA_PROFILE == ARENA_PROFILE_FULL
+#define ARENA_BUDGET			65536			// bytes of RAM given to the arena
+#define ARENA_MIDI_RX			1024			// midi receive buffer (bytes)
+#define ARENA_MIDI_TX			1024			// midi send buffer of the main loop (bytes)
+#define ARENA_SMF_TRACKS		16				// tracks of a midi file played
+#define ARENA_LOOPER_EVENTS		2048			// looper events, for all overdub layers
+#define ARENA_LOOPER_TICKS		6144			// longest loop, in clock ticks: 16 bars of 16 beats, 24 ticks each
+#define ARENA_SECTORS			8				// sector blocks shared by backup, recording and restore
+#define ARENA_SECTORS_PER_USER	4				// sector blocks taken by backup and recording (restore takes 2)
+#elif ARENA_PROFILE == ARENA_PROFILE_LITE
+#define ARENA_BUDGET			16384
+#define ARENA_MIDI_RX			256
+#define ARENA_MIDI_TX			256
+#define ARENA_SMF_TRACKS		8
+#define ARENA_LOOPER_EVENTS		512
+#define ARENA_LOOPER_TICKS		1536			// 4 bars of 16 beats
+#define ARENA_SECTORS			4
+#define ARENA_SECTORS_PER_USER	2
+#else
+#error "unknown ARENA_PROFILE"
+#endif
+
+#define ARENA_SECTOR			512				// bytes of a sector block: one sector of the stick
+#define ARENA_SMF_READ_AHEAD	64				// bytes of each midi file track read ahead from the stick
+#define ARENA_ALIGN				8
+
+// buffers: owner, bytes of an element, number of elements
+#define ARENA_BUFFERS(X) \
+	X (midi_rx,			1,							ARENA_MIDI_RX) \
+	X (midi_tx,			1,							ARENA_MIDI_TX) \
+	X (smf_tracks,		(ARENA_SMF_READ_AHEAD + 32),	ARENA_SMF_TRACKS) \
+	X (looper_events,	8,							ARENA_LOOPER_EVENTS) \
+	X (looper_heads,	2,							ARENA_LOOPER_TICKS) \
+	X (looper_tails,	2,							ARENA_LOOPER_TICKS)
+
+// pools: name, bytes of a block, number of blocks
+#define ARENA_POOLS(X) \
+	X (sector,			ARENA_SECTOR,				ARENA_SECTORS)
+
+// layout of the arena: one aligned member per owner
+#define ARENA_MEMBER(name, element, count)	uint8_t name [((element) * (count) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1)] __attribute__ ((aligned (ARENA_ALIGN)));
+struct arena_layout {
+	ARENA_BUFFERS (ARENA_MEMBER)
+	ARENA_POOLS (ARENA_MEMBER)
+};
+#undef ARENA_MEMBER
+
+_Static_assert (sizeof (struct arena_layout) <= ARENA_BUDGET, "arena is over the RAM budget of the build profile");
+
+extern struct arena_layout arena;
+
+// bytes of owner "name", for compile-time checks of the types stored in it
+#define ARENA_SIZEOF(name)	sizeof (((struct arena_layout *) 0)->name)
+
+// pools
+#define ARENA_POOL_ID(name, block, count)	ARENA_POOL_##name,
+enum arena_pool {
+	ARENA_POOLS (ARENA_POOL_ID)
+	ARENA_NB_POOLS
+};
+#undef ARENA_POOL_ID
+
+// build the free lists of the pools, and print the arena table
+void arena_init (void);
+
+// take a block of "pool"; returns NULL if all blocks are taken
+void * arena_get (enum arena_pool pool);
+
+// give back "block" taken from "pool"; NULL is ignored
+void arena_put (enum arena_pool pool, void * block);
+
+// take "count" blocks of "pool" into "blocks"; returns false, with no block taken, if there are not enough free blocks
+bool arena_get_blocks (enum arena_pool pool, uint8_t ** blocks, uint32_t count);
+
+// give back "count" blocks taken by arena_get_blocks (); "blocks" are cleared, so giving them back twice is harmless
+void arena_put_blocks (enum arena_pool pool, uint8_t ** blocks, uint32_t count);
+
+// number of free blocks of "pool"
+uint32_t arena_free (enum arena_pool pool);
+
+#endif /* _ARENA_H_ */
@@ -0,0 +1,121 @@
+/**
+ * @file audio.c
+ * @brief Audio input on the ADC, sampled by free-running DMA and fed to the beat tracker
+ *
+ * The ADC converts continuously at BEAT_SAMPLE_RATE; a DMA channel paced by the ADC FIFO writes samples
+ * into a ring buffer (DMA write address wraps on the buffer size), for AUDIO_TRANSFERS samples per run. At the end
+ * of a run, a control channel chained to it writes the transfer count again, which starts the next run where the
+ * write address stands, within a sample period (the ADC FIFO holds the samples meanwhile): sampling never stops.
+ * The main loop reads the DMA transfer count, and counts runs, to know how many samples are available, and hands
+ * them to the beat tracker one frame at a time.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+#include "beat.h"
+#include "audio.h"
+
+#define AUDIO_BUF_BITS		11								// ring buffer size is 2^AUDIO_BUF_BITS bytes
+#define AUDIO_BUF_SAMPLES	((1 << AUDIO_BUF_BITS) / 2)		// 1024 samples = 128 ms
+#define AUDIO_TRANSFERS		0x80000000						// DMA transfer count of a run: 3 days at 8kHz; divides 2^32, so that sample counts wrap with it
+#define AUDIO_MAX_FRAMES	2								// maximum number of frames processed per call, to bound time spent in main loop
+
+// globals
+static uint16_t audio_buf [AUDIO_BUF_SAMPLES] __attribute__ ((aligned (1 << AUDIO_BUF_BITS)));
+static int audio_dma = -1;
+static int audio_ctrl_dma = -1;				// control channel re-arming audio_dma at the end of each run
+static const uint32_t audio_transfers = AUDIO_TRANSFERS;		// read by the control channel
+static uint32_t audio_runs = 0;				// number of runs started after the first one, as seen by audio_task ()
+static uint32_t last_count = AUDIO_TRANSFERS;	// transfer count of audio_dma at last call of audio_task ()
+static uint64_t audio_start_time = 0;		// time of first sample (usec since boot)
+static uint32_t samples_read = 0;			// number of samples handed to beat tracker or skipped; multiple of BEAT_HOP
+static uint32_t samples_skipped = 0;		// number of samples lost because main loop was late
+
+
+// set "gpio" (26 to 28: ADC0 to ADC2) as audio input and start sampling; does nothing if gpio is NO_AUDIO_GPIO
+void audio_init (uint gpio)
+{
+	dma_channel_config config;
+
+	if (gpio == NO_AUDIO_GPIO) return;
+
+	beat_init ();
+
+	// ADC runs free at BEAT_SAMPLE_RATE (48MHz ADC clock), each sample goes to FIFO and raises DREQ
+	adc_init ();
+	adc_gpio_init (gpio);
+	adc_select_input (gpio - 26);
+	adc_fifo_setup (true, true, 1, false, false);
+	adc_set_clkdiv ((48000000 / BEAT_SAMPLE_RATE) - 1);
+
+	// DMA copies FIFO into ring buffer, wrapping write address; at the end of a run, control channel re-arms it
+	audio_dma = dma_claim_unused_channel (true);
+	audio_ctrl_dma = dma_claim_unused_channel (true);
+	config = dma_channel_get_default_config (audio_dma);
+	channel_config_set_transfer_data_size (&config, DMA_SIZE_16);
+	channel_config_set_read_increment (&config, false);
+	channel_config_set_write_increment (&config, true);
+	channel_config_set_ring (&config, true, AUDIO_BUF_BITS);
+	channel_config_set_dreq (&config, DREQ_ADC);
+	channel_config_set_chain_to (&config, audio_ctrl_dma);
+	dma_channel_configure (audio_dma, &config, audio_buf, &adc_hw->fifo, AUDIO_TRANSFERS, false);
+
+	// control channel: one unpaced transfer of the run length into the transfer count trigger alias of audio_dma
+	config = dma_channel_get_default_config (audio_ctrl_dma);
+	channel_config_set_transfer_data_size (&config, DMA_SIZE_32);
+	channel_config_set_read_increment (&config, false);
+	channel_config_set_write_increment (&config, false);
+	dma_channel_configure (audio_ctrl_dma, &config, &dma_channel_hw_addr (audio_dma)->al1_transfer_count_trig, &audio_transfers, 1, false);
+	dma_channel_start (audio_dma);
+
+	audio_runs = 0;
+	last_count = AUDIO_TRANSFERS;
+	samples_read = 0;
+	samples_skipped = 0;
+	audio_start_time = to_us_since_boot (get_absolute_time ());
+	adc_run (true);
+}
+
+
+// process samples captured since last call; returns true when the beat tracker is locked on a new estimate,
+// with beat period (usec) and time of last beat (usec since boot)
+bool audio_task (uint32_t * beat_period, uint64_t * beat_time)
+{
+	static struct beat_estimate estimate;
+	uint32_t samples_written, skip_to, count;
+	int frames = 0;
+	bool result = false;
+
+	if (audio_dma < 0) return false;
+
+	// transfer count went up: a new run has started since last call (runs last for days, so at most one)
+	count = dma_channel_hw_addr (audio_dma)->transfer_count;
+	if (count > last_count) audio_runs++;
+	last_count = count;
+	samples_written = audio_runs * AUDIO_TRANSFERS + (AUDIO_TRANSFERS - count);
+
+	// we have been away for longer than the ring buffer: skip lost samples (frames stay aligned on ring buffer)
+	if (samples_written - samples_read > AUDIO_BUF_SAMPLES) {
+		skip_to = (samples_written - (AUDIO_BUF_SAMPLES / 2)) & ~(BEAT_HOP - 1);
+		samples_skipped += skip_to - samples_read;
+		samples_read = skip_to;
+	}
+
+	// a frame never wraps around ring buffer, as buffer size is a multiple of BEAT_HOP
+	while ((samples_written - samples_read >= BEAT_HOP) && (frames < AUDIO_MAX_FRAMES)) {
+		if (beat_process (&audio_buf [samples_read % AUDIO_BUF_SAMPLES], &estimate) && estimate.locked) result = true;
+		samples_read += BEAT_HOP;
+		frames++;
+	}
+
+	if (result) {
+		*beat_period = estimate.period;
+		*beat_time = audio_start_time + ((estimate.last_beat + samples_skipped) * 1000000) / BEAT_SAMPLE_RATE;
+	}
+	return result;
+}
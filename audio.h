@@ -0,0 +1,25 @@
+/**
+ * @file audio.h
+ * @brief Audio input on the ADC, sampled by free-running DMA and fed to the beat tracker
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _AUDIO_H_
+#define _AUDIO_H_
+
+#include "pico/stdlib.h"
+
+#define NO_AUDIO_GPIO	255		// no audio input
+
+// set "gpio" (26 to 28: ADC0 to ADC2) as audio input and start sampling; does nothing if gpio is NO_AUDIO_GPIO
+void audio_init (uint gpio);
+
+// process samples captured since last call; returns true when the beat tracker is locked on a new estimate,
+// with beat period (usec) and time of last beat (usec since boot)
+bool audio_task (uint32_t * beat_period, uint64_t * beat_time);
+
+#endif /* _AUDIO_H_ */
@@ -0,0 +1,212 @@
+/**
+ * @file backup.c
+ * @brief Backup of groovebox SysEx dumps (patches, sessions) to files on the USB stick, streamed in small chunks
+ *
+ * Each dump request of the table gets its own file, in a new folder BACKUP/nnn of the stick. SysEx bytes are stored
+ * by the midi receive callback into a small ring of sector-sized chunks; the main loop writes full chunks to the file
+ * while the rest of the dump keeps arriving, so a dump is never held in RAM, whatever its size. A dump is over when
+ * the groovebox stops sending SysEx for BACKUP_END_TIME; the next request is sent then.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "ff.h"
+#include "stick.h"
+#include "backup.h"
+
+#define SYSEX_START		0xF0
+#define SYSEX_END		0xF7
+#define MIDI_REALTIME	0xF8		// realtime messages (0xF8 and above) may appear inside a SysEx
+#define BACKUP_FOLDERS	1000		// BACKUP/000 to BACKUP/999
+#define PATH_SIZE		32
+
+// states
+#define STATE_IDLE		0
+#define STATE_REQUEST	1			// open next file and send next request
+#define STATE_RECEIVE	2			// dump is being received
+
+// dump requests (Novation Circuit programmer's reference): each answer goes into its file
+struct dump_request {
+	const char * file;
+	uint8_t lg;
+	uint8_t data [9];
+};
+
+static const struct dump_request requests [] = {
+	{ "SYNTH1.SYX", 9, { 0xF0, 0x00, 0x20, 0x29, 0x01, 0x60, 0x40, 0x00, 0xF7 } },		// current patch of synth 1
+	{ "SYNTH2.SYX", 9, { 0xF0, 0x00, 0x20, 0x29, 0x01, 0x60, 0x40, 0x01, 0xF7 } }		// current patch of synth 2
+};
+#define NB_REQUESTS		(sizeof (requests) / sizeof (requests [0]))
+
+// globals
+static int state = STATE_IDLE;
+static char folder [PATH_SIZE];
+static FIL file;
+static uint8_t * chunks [BACKUP_CHUNKS];			// taken from the sector pool while a backup runs
+static uint32_t write_chunk = 0;		// oldest full chunk, next to be written
+static uint32_t ready = 0;				// number of full chunks; chunk being filled is the one after them
+static uint32_t fill = 0;				// bytes in chunk being filled
+static bool in_sysex = false;
+static bool received = false;			// SysEx bytes received since last request
+static uint64_t request_time = 0;		// time of last request (usec)
+static uint64_t last_byte = 0;			// time of last SysEx byte (usec)
+static uint32_t step_bytes = 0;			// bytes written for current dump
+static struct backup_progress progress;
+
+
+// write "lg" bytes of chunk "index" to file
+static void write_chunk_to_file (uint32_t index, uint32_t lg)
+{
+	UINT written = 0;
+
+	if (f_write (&file, chunks [index], lg, &written) != FR_OK || written != lg) printf ("Backup: write error\r\n");
+	progress.bytes += written;
+	step_bytes += written;
+}
+
+
+// start a backup into a new folder of the stick; returns false if there is no stick, or a backup is running
+bool backup_start (void)
+{
+	uint32_t n;
+	FRESULT result = FR_EXIST;
+
+	if (!stick_ready () || state != STATE_IDLE) return false;
+	if (!arena_get_blocks (ARENA_POOL_sector, chunks, BACKUP_CHUNKS)) {
+		printf ("Backup: no free buffer\r\n");
+		return false;
+	}
+
+	f_mkdir ("0:/BACKUP");
+	for (n = 0; n < BACKUP_FOLDERS && result == FR_EXIST; n++) {
+		snprintf (folder, PATH_SIZE, "0:/BACKUP/%03lu", (unsigned long) n);
+		result = f_mkdir (folder);
+	}
+	if (result != FR_OK) {
+		printf ("Backup: cannot create folder\r\n");
+		arena_put_blocks (ARENA_POOL_sector, chunks, BACKUP_CHUNKS);
+		return false;
+	}
+
+	memset (&progress, 0, sizeof (progress));
+	progress.running = true;
+	progress.steps = NB_REQUESTS;
+	state = STATE_REQUEST;
+	printf ("Backup to %s\r\n", folder);
+	return true;
+}
+
+
+// SysEx bytes received from the groovebox (realtime and other messages are ignored); to be called from midi receive callback
+void backup_rx (const uint8_t * buffer, uint32_t lg, uint64_t now)
+{
+	uint32_t i;
+	uint8_t byte;
+
+	if (state != STATE_RECEIVE) return;
+
+	for (i = 0; i < lg; i++) {
+		byte = buffer [i];
+		if (byte >= MIDI_REALTIME) continue;
+		if (byte == SYSEX_START) in_sysex = true;
+		else if ((byte & 0x80) && byte != SYSEX_END) in_sysex = false;		// SysEx interrupted by another message
+		if (!in_sysex) continue;
+
+		// all chunks are full: the stick is too slow
+		if (ready == BACKUP_CHUNKS) {
+			progress.lost++;
+			continue;
+		}
+		chunks [(write_chunk + ready) % BACKUP_CHUNKS][fill++] = byte;
+		if (fill == BACKUP_CHUNK) {
+			ready++;
+			fill = 0;
+		}
+
+		received = true;
+		last_byte = now;
+		if (byte == SYSEX_END) in_sysex = false;
+	}
+}
+
+
+// write buffered chunks to the stick, and write next dump request into "buffer" of "size" bytes; returns number of bytes
+// written into buffer, to be sent to the groovebox; to be called from the main loop, since writing to the stick waits
+uint32_t backup_task (uint64_t now, uint8_t * buffer, uint32_t size)
+{
+	char path [PATH_SIZE + 16];
+	const struct dump_request * request;
+
+	switch (state) {
+		case STATE_REQUEST:
+			// all dumps done
+			if (progress.step == NB_REQUESTS) {
+				state = STATE_IDLE;
+				progress.running = false;
+				arena_put_blocks (ARENA_POOL_sector, chunks, BACKUP_CHUNKS);
+				printf ("Backup done: %lu bytes, %lu lost\r\n", (unsigned long) progress.bytes, (unsigned long) progress.lost);
+				return 0;
+			}
+
+			request = &requests [progress.step];
+			if (request->lg > size) return 0;		// no room to send request yet
+			snprintf (path, sizeof (path), "%s/%s", folder, request->file);
+			if (!stick_ready () || f_open (&file, path, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK) {
+				printf ("Backup: cannot create %s\r\n", path);
+				state = STATE_IDLE;
+				progress.running = false;
+				arena_put_blocks (ARENA_POOL_sector, chunks, BACKUP_CHUNKS);
+				return 0;
+			}
+			write_chunk = 0;
+			ready = 0;
+			fill = 0;
+			in_sysex = false;
+			received = false;
+			step_bytes = 0;
+			request_time = now;
+			state = STATE_RECEIVE;
+			memcpy (buffer, request->data, request->lg);
+			return request->lg;
+
+		case STATE_RECEIVE:
+			// one full chunk per call, so that the main loop keeps running during long dumps
+			if (ready) {
+				write_chunk_to_file (write_chunk, BACKUP_CHUNK);
+				write_chunk = (write_chunk + 1) % BACKUP_CHUNKS;
+				ready--;
+				return 0;
+			}
+
+			// end of dump: no answer, or no more SysEx for a while (bytes may have been received after "now", while writing)
+			if ((!received && (int64_t) (now - request_time) > BACKUP_ANSWER_TIME) ||
+				(received && (int64_t) (now - last_byte) > (in_sysex ? BACKUP_ANSWER_TIME : BACKUP_END_TIME))) {
+				if (fill) write_chunk_to_file (write_chunk, fill);
+				f_close (&file);
+				printf ("Backup: %s, %lu bytes\r\n", requests [progress.step].file, (unsigned long) step_bytes);
+				if (step_bytes == 0) {
+					// nothing received: do not leave an empty file
+					snprintf (path, sizeof (path), "%s/%s", folder, requests [progress.step].file);
+					f_unlink (path);
+				}
+				progress.step++;
+				state = STATE_REQUEST;
+			}
+			return 0;
+
+		default:
+			return 0;
+	}
+}
+
+
+// progress of current or last backup
+void backup_progress (struct backup_progress * p)
+{
+	*p = progress;
+}
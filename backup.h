@@ -0,0 +1,44 @@
+/**
+ * @file backup.h
+ * @brief Backup of groovebox SysEx dumps (patches, sessions) to files on the USB stick, streamed in small chunks
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _BACKUP_H_
+#define _BACKUP_H_
+
+#include "pico/stdlib.h"
+#include "arena.h"
+
+#define BACKUP_CHUNK		ARENA_SECTOR			// SysEx bytes written to the stick at once: one sector
+#define BACKUP_CHUNKS		ARENA_SECTORS_PER_USER	// chunks buffered while the stick is busy, taken from the sector pool
+#define BACKUP_ANSWER_TIME	2000000		// time for the groovebox to start answering a dump request (usec)
+#define BACKUP_END_TIME		500000		// a dump is over when no SysEx byte was received for this time (usec)
+
+// progress of a backup
+struct backup_progress {
+	bool running;
+	uint32_t step;			// dump being received (0 to steps - 1)
+	uint32_t steps;			// number of dumps requested
+	uint32_t bytes;			// SysEx bytes written to the stick
+	uint32_t lost;			// SysEx bytes lost because the stick was too slow
+};
+
+// start a backup into a new folder of the stick; returns false if there is no stick, or a backup is running
+bool backup_start (void);
+
+// SysEx bytes received from the groovebox (realtime and other messages are ignored); to be called from midi receive callback
+void backup_rx (const uint8_t * buffer, uint32_t lg, uint64_t now);
+
+// write buffered chunks to the stick, and write next dump request into "buffer" of "size" bytes; returns number of bytes
+// written into buffer, to be sent to the groovebox; to be called from the main loop, since writing to the stick waits
+uint32_t backup_task (uint64_t now, uint8_t * buffer, uint32_t size);
+
+// progress of current or last backup
+void backup_progress (struct backup_progress * progress);
+
+#endif /* _BACKUP_H_ */
@@ -0,0 +1,236 @@
+/**
+ * @file bass.c
+ * @brief Bass pedal mode: pedals play notes to a synth track of the groovebox, from the first edge of each switch
+ *
+ * Like Moog Taurus pedals, notes are monophonic, last pressed pedal wins. A GPIO interrupt stamps the first falling
+ * edge of each press; the note-on goes out on the next call to bass_task (), in the realtime lane, with no debounce
+ * wait: bounces that follow are ignored because the pedal is already down. Release is debounced instead: the note-off
+ * waits until the switch has stayed open for BASS_RELEASE_DEBOUNCE. The interrupt only writes times, each of them
+ * owned by one key, so nothing is locked.
+ *
+ * Latency is measured from the edge to the USB flush of the note-on, which is what the player hears on top of the
+ * USB frame (1 ms at full speed). It is only as short as the longest pass of the main loop: a scope on a pedal and on
+ * the probe output measures it on the pedal itself, and tools/hosttest/test_bass reproduces it for a given loop.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include "midi_msg.h"
+#include "bass.h"
+
+#define NB_GPIOS		30
+#define NO_KEY			0xFF
+#define EDGES			(GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE)
+
+// globals
+static uint8_t key_gpios [BASS_KEYS];
+static uint8_t key_notes [BASS_KEYS];
+static uint32_t nb_keys = 0;
+static uint8_t key_of_gpio [NB_GPIOS];					// key of each gpio; NO_KEY if none
+static uint8_t channel = 0;
+static uint8_t velocity = 100;
+static uint8_t options = 0;
+static bool enabled = false;
+static volatile uint32_t press_time [BASS_KEYS];		// time of first falling edge of a press not handled yet (time_us_32); 0 if none
+static volatile uint32_t edge_time [BASS_KEYS];			// time of last edge, for release debounce
+static uint32_t down = 0;								// debounced state of keys, one bit per key
+static uint8_t sounding = NO_KEY;						// key of the note sounding
+
+// latency measurement
+static uint32_t unflushed [BASS_KEYS];					// edge times of note-ons written but not flushed yet
+static uint32_t nb_unflushed = 0;
+static uint32_t window_notes = 0;
+static uint64_t window_sum = 0;
+static struct bass_stats window;
+static struct bass_stats last_stats;
+static bool stats_ready = false;
+static uint probe_gpio = BASS_NO_PROBE;
+static bool probe_level = false;
+
+
+// gpio interrupt: stamp edges of key switches
+static void __not_in_flash_func (bass_edge) (uint gpio, uint32_t events)
+{
+	uint8_t key;
+	uint32_t now = time_us_32 ();
+
+	if (gpio >= NB_GPIOS || (key = key_of_gpio [gpio]) == NO_KEY) return;
+	edge_time [key] = now;
+	// first falling edge of a press; 0 is kept for "none"
+	if ((events & GPIO_IRQ_EDGE_FALL) && press_time [key] == 0) press_time [key] = now | 1;
+}
+
+
+// note of "key" on or off into "buffer" of "size" bytes
+static uint32_t note (uint8_t key, bool on, uint8_t * buffer, uint32_t size)
+{
+	return midi_note (buffer, size, channel, key_notes [key], on ? velocity : 0);
+}
+
+
+// pedal "key" pressed, first edge at "time"; returns number of bytes written
+static uint32_t press (uint8_t key, uint32_t time, uint8_t * buffer, uint32_t size)
+{
+	uint32_t index = 0;
+
+	// hold: same pedal again stops its note
+	if (sounding == key) {
+		sounding = NO_KEY;
+		return note (key, false, buffer, size);
+	}
+
+	if (sounding != NO_KEY && !(options & BASS_LEGATO)) index += note (sounding, false, buffer + index, size - index);
+	index += note (key, true, buffer + index, size - index);
+	if (sounding != NO_KEY && (options & BASS_LEGATO)) index += note (sounding, false, buffer + index, size - index);
+	sounding = key;
+
+	if (nb_unflushed < BASS_KEYS) unflushed [nb_unflushed++] = time;
+	return index;
+}
+
+
+// pedal "key" released; returns number of bytes written
+static uint32_t release (uint8_t key, uint8_t * buffer, uint32_t size)
+{
+	if ((options & BASS_HOLD) || sounding != key) return 0;
+	sounding = NO_KEY;
+	return note (key, false, buffer, size);
+}
+
+
+// pedals on "count" gpios of "gpios" (CONFIG_NO_GPIO if absent) play "notes" on midi "channel" (0 to 15) at "velocity",
+// with "options" (BASS_HOLD, BASS_LEGATO); gpios must be set up as inputs with pull-up. Mode starts disabled
+void bass_init (const uint8_t * gpios, const uint8_t * notes, uint32_t count, uint8_t ch, uint8_t vel, uint8_t opt)
+{
+	uint32_t i;
+
+	for (i = 0; i < NB_GPIOS; i++) key_of_gpio [i] = NO_KEY;
+	nb_keys = 0;
+	for (i = 0; i < count && nb_keys < BASS_KEYS; i++) {
+		if (gpios [i] >= NB_GPIOS || notes [i] > 127) continue;
+		key_gpios [nb_keys] = gpios [i];
+		key_notes [nb_keys] = notes [i];
+		key_of_gpio [gpios [i]] = nb_keys;
+		nb_keys++;
+	}
+	channel = ch & 0x0F;
+	velocity = (vel == 0 || vel > 127) ? 127 : vel;
+	options = opt;
+	enabled = false;
+}
+
+
+// set "gpio" as latency probe output (BASS_NO_PROBE if none): it toggles each time note-ons have been flushed to USB,
+// so that a scope shows latency between switch edge and probe edge
+void bass_probe_init (uint gpio)
+{
+	probe_gpio = gpio;
+	if (gpio == BASS_NO_PROBE) return;
+	gpio_init (gpio);
+	gpio_set_dir (gpio, GPIO_OUT);
+	gpio_put (gpio, false);
+}
+
+
+// enable or disable bass mode; sounding notes are released by the next calls to bass_task () when disabled
+void bass_enable (bool enable)
+{
+	uint32_t key;
+
+	if (enable == enabled) return;
+	for (key = 0; key < nb_keys; key++) {
+		press_time [key] = 0;
+		if (enable) gpio_set_irq_enabled_with_callback (key_gpios [key], EDGES, true, bass_edge);
+		else gpio_set_irq_enabled (key_gpios [key], EDGES, false);
+	}
+	down = 0;
+	enabled = enable;
+}
+
+
+// returns true if bass mode is enabled
+bool bass_enabled (void)
+{
+	return enabled;
+}
+
+
+// write note-ons of new presses and note-offs of debounced releases into "buffer" of "size" bytes; returns number of
+// bytes written. To be called as often as possible, and buffer to be flushed right away
+uint32_t bass_task (uint8_t * buffer, uint32_t size)
+{
+	uint32_t index = 0, time, now;
+	uint8_t key;
+
+	// bass mode left: note still sounding (in hold mode, or pedal still down) is released
+	if (!enabled) {
+		if (sounding != NO_KEY && (index = note (sounding, false, buffer, size)) != 0) sounding = NO_KEY;
+		return index;
+	}
+
+	now = time_us_32 ();
+	for (key = 0; key < nb_keys; key++) {
+		if (size - index < 6) break;		// note-on and note-off of previous note; next keys on next call
+
+		// press: first edge only, later ones are bounces of a pedal already down
+		if ((time = press_time [key]) != 0) {
+			press_time [key] = 0;
+			if (!(down & (1u << key))) {
+				down |= 1u << key;
+				index += press (key, time, buffer + index, size - index);
+			}
+			continue;
+		}
+
+		// release: switch open (high), with no edge for BASS_RELEASE_DEBOUNCE
+		if ((down & (1u << key)) && gpio_get (key_gpios [key]) && now - edge_time [key] >= BASS_RELEASE_DEBOUNCE) {
+			down &= ~(1u << key);
+			index += release (key, buffer + index, size - index);
+		}
+	}
+	return index;
+}
+
+
+// buffer written by bass_task () has been flushed to USB: latency of its note-ons is measured
+void bass_flushed (void)
+{
+	uint32_t i, latency, now = time_us_32 ();
+
+	// probe first, as close to the flush as possible
+	if (nb_unflushed && probe_gpio != BASS_NO_PROBE) {
+		probe_level = !probe_level;
+		gpio_put (probe_gpio, probe_level);
+	}
+
+	for (i = 0; i < nb_unflushed; i++) {
+		latency = now - unflushed [i];
+		if (latency > window.max) window.max = latency;
+		if (latency > BASS_LATENCY_LIMIT) window.late++;
+		window_sum += latency;
+
+		if (++window_notes >= BASS_STATS_NOTES) {
+			window.mean = (uint32_t) (window_sum / window_notes);
+			last_stats = window;
+			stats_ready = true;
+			window.max = 0;
+			window.late = 0;
+			window_sum = 0;
+			window_notes = 0;
+		}
+	}
+	nb_unflushed = 0;
+}
+
+
+// returns true once every BASS_STATS_NOTES note-ons, with latency measurements of the window
+bool bass_stats (struct bass_stats * stats)
+{
+	if (!stats_ready) return false;
+	*stats = last_stats;
+	stats_ready = false;
+	return true;
+}
@@ -0,0 +1,57 @@
+/**
+ * @file bass.h
+ * @brief Bass pedal mode: pedals play notes to a synth track of the groovebox, from the first edge of each switch
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _BASS_H_
+#define _BASS_H_
+
+#include "pico/stdlib.h"
+
+#define BASS_KEYS				16			// maximum number of pedals playing notes
+#define BASS_RELEASE_DEBOUNCE	20000		// a pedal is released when its switch stays open for this time (usec)
+#define BASS_LATENCY_LIMIT		1000		// note-ons flushed later than this after their edge are counted as late (usec)
+#define BASS_STATS_NOTES		32			// note-ons per latency measurement window
+#define BASS_NO_PROBE			255			// no latency probe output
+
+// options
+#define BASS_HOLD				1			// notes keep sounding after release, until another pedal (or the same one again) is pressed
+#define BASS_LEGATO				2			// new note-on is sent before note-off of previous note, so that the synth slides
+
+// latency between switch edge and USB flush of the note-on, over a window of BASS_STATS_NOTES note-ons
+struct bass_stats {
+	uint32_t max;				// usec
+	uint32_t mean;				// usec
+	uint32_t late;				// note-ons over BASS_LATENCY_LIMIT
+};
+
+// pedals on "count" gpios of "gpios" (CONFIG_NO_GPIO if absent) play "notes" on midi "channel" (0 to 15) at "velocity",
+// with "options" (BASS_HOLD, BASS_LEGATO); gpios must be set up as inputs with pull-up. Mode starts disabled
+void bass_init (const uint8_t * gpios, const uint8_t * notes, uint32_t count, uint8_t channel, uint8_t velocity, uint8_t options);
+
+// set "gpio" as latency probe output (BASS_NO_PROBE if none): it toggles each time note-ons have been flushed to USB,
+// so that a scope shows latency between switch edge and probe edge
+void bass_probe_init (uint gpio);
+
+// enable or disable bass mode; sounding notes are released by the next calls to bass_task () when disabled
+void bass_enable (bool enable);
+
+// returns true if bass mode is enabled
+bool bass_enabled (void);
+
+// write note-ons of new presses and note-offs of debounced releases into "buffer" of "size" bytes; returns number of
+// bytes written. To be called as often as possible, and buffer to be flushed right away
+uint32_t bass_task (uint8_t * buffer, uint32_t size);
+
+// buffer written by bass_task () has been flushed to USB: latency of its note-ons is measured
+void bass_flushed (void);
+
+// returns true once every BASS_STATS_NOTES note-ons, with latency measurements of the window
+bool bass_stats (struct bass_stats * stats);
+
+#endif /* _BASS_H_ */
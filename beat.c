@@ -0,0 +1,193 @@
+/**
+ * @file beat.c
+ * @brief Fixed-point beat tracker: onset detection, tempo and phase estimation from audio samples
+ *
+ * For each frame of BEAT_HOP samples:
+ * - DC is removed and the energy of the frame is computed, then compressed to a log2 scale (Q4);
+ * - the onset detection function (ODF) is the positive difference between this and the previous frames' log energy;
+ * - a few lags of the ODF autocorrelation are updated, so that the tempo sweep is spread over many frames.
+ * When a sweep is complete, the autocorrelation peak (weighted by a prior centered on 120 BPM) gives the tempo,
+ * refined to a fraction of frame by parabolic interpolation, and a comb over the last beats gives the phase.
+ * All computation is integer; there is no floating point.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include "beat.h"
+
+#define FRAMES_PER_MINUTE	((60 * BEAT_SAMPLE_RATE) / BEAT_HOP)
+#define MIN_LAG				(FRAMES_PER_MINUTE / BEAT_MAX_BPM)			// lag of fastest tempo (frames)
+#define MAX_LAG				(FRAMES_PER_MINUTE / BEAT_MIN_BPM + 1)		// lag of slowest tempo (frames)
+#define NB_LAGS				(MAX_LAG - MIN_LAG + 1)
+#define ACF_WINDOW			(BEAT_ODF_LEN - MAX_LAG - 1)				// number of products per autocorrelation lag
+#define ODF_MASK			(BEAT_ODF_LEN - 1)
+#define ODF_MAX				1023		// keep ODF on 10 bits, so that an autocorrelation sum fits on 32 bits
+#define LAGS_PER_FRAME		4			// autocorrelation lags computed per frame
+#define LOCK_CONFIDENCE		384			// peak must be 1.5 times above average to lock (Q8)
+#define MIN_ACTIVITY		(ACF_WINDOW * 8)	// minimum ODF sum over window: below this, there is no rhythm in the signal
+#define PHASE_BEATS			4			// number of beats summed by the phase comb
+#define PRIOR_WIDTH			92			// square of the octave distance (Q4) at which tempo prior is halved: 0.6 octave
+
+// globals
+static int32_t dc = 0;						// DC level of signal (Q8)
+static uint32_t log_energy [3];				// log energy of previous frames (Q4)
+static uint16_t odf [BEAT_ODF_LEN];			// onset detection function, ring buffer
+static uint32_t frame_count = 0;			// number of frames processed; newest ODF value is at (frame_count - 1)
+static uint32_t acf [NB_LAGS];				// ODF autocorrelation per lag
+static uint16_t prior [NB_LAGS];			// tempo prior per lag (Q8)
+static uint32_t lag = MIN_LAG;				// next lag to compute
+
+
+// log2 of x in Q4 (4 bits of mantissa); 0 for x = 0
+static uint32_t log2_q4 (uint32_t x)
+{
+	uint32_t msb = 0;
+
+	if (x == 0) return 0;
+	while ((x >> msb) > 1) msb++;
+	// 4 bits following the most significant bit
+	if (msb >= 4) return (msb << 4) | ((x >> (msb - 4)) & 0x0F);
+	return (msb << 4) | ((x << (4 - msb)) & 0x0F);
+}
+
+
+// ODF value "age" frames before newest
+static inline uint32_t odf_at (uint32_t age)
+{
+	return odf [(frame_count - 1 - age) & ODF_MASK];
+}
+
+
+// autocorrelation of ODF at lag "l" over the newest ACF_WINDOW frames
+static uint32_t correlate (uint32_t l)
+{
+	uint32_t sum = 0;
+	uint32_t i;
+
+	for (i = 0; i < ACF_WINDOW; i++) sum += odf_at (i) * odf_at (i + l);
+	return sum;
+}
+
+
+// compute tempo and phase from a complete autocorrelation sweep
+static void estimate_tempo (struct beat_estimate * estimate)
+{
+	uint32_t i, best = 0, best_value = 0, value, neighbour, activity = 0;
+	uint64_t mean = 0;
+	int64_t a, b, c, den;
+	int32_t delta = 0;
+	uint32_t period_q8, phase, best_phase = 0, best_comb = 0, comb, offset, k;
+
+	// weighted autocorrelation peak; a peak between 2 lags is split over both, so add the larger neighbour
+	for (i = 0; i < NB_LAGS; i++) {
+		neighbour = (i > 0) ? acf [i - 1] : 0;
+		if (i < NB_LAGS - 1 && acf [i + 1] > neighbour) neighbour = acf [i + 1];
+		value = ((acf [i] + neighbour) >> 9) * prior [i];
+		mean += value;
+		if (value > best_value) {
+			best_value = value;
+			best = i;
+		}
+	}
+	mean /= NB_LAGS;
+	estimate->confidence = mean ? (uint32_t) (((uint64_t) best_value << 8) / mean) : 256;
+
+	// parabolic interpolation around peak, in Q8 of a frame
+	if (best > 0 && best < NB_LAGS - 1) {
+		a = acf [best - 1];
+		b = acf [best];
+		c = acf [best + 1];
+		den = a - 2 * b + c;
+		if (den < 0) delta = (int32_t) (((a - c) * 128) / den);
+		if (delta > 128) delta = 128;
+		if (delta < -128) delta = -128;
+	}
+	period_q8 = (uint32_t) ((int32_t) ((best + MIN_LAG) << 8) + delta);
+
+	// phase: offset of the comb of PHASE_BEATS teeth that best matches ODF
+	for (phase = 0; phase < best + MIN_LAG; phase++) {
+		comb = 0;
+		for (k = 0; k < PHASE_BEATS; k++) {
+			offset = phase + ((k * period_q8 + 128) >> 8);
+			if (offset >= BEAT_ODF_LEN) break;
+			comb += odf_at (offset);
+		}
+		if (comb > best_comb) {
+			best_comb = comb;
+			best_phase = phase;
+		}
+	}
+
+	for (i = 0; i < ACF_WINDOW; i++) activity += odf_at (i);
+
+	// frame durations are 1000000 * BEAT_HOP / BEAT_SAMPLE_RATE usec; beat is at the end of its frame
+	estimate->period = (uint32_t) (((uint64_t) period_q8 * BEAT_HOP * 1000000) / ((uint64_t) BEAT_SAMPLE_RATE << 8));
+	estimate->last_beat = (uint64_t) (frame_count - best_phase) * BEAT_HOP;
+	estimate->locked = (estimate->confidence >= LOCK_CONFIDENCE) && (activity >= MIN_ACTIVITY);
+}
+
+
+// reset tracker
+void beat_init (void)
+{
+	uint32_t i, bpm, distance;
+
+	dc = 2048 << 8;		// middle of 12-bit ADC range
+	log_energy [0] = log_energy [1] = log_energy [2] = 0;
+	for (i = 0; i < BEAT_ODF_LEN; i++) odf [i] = 0;
+	for (i = 0; i < NB_LAGS; i++) acf [i] = 0;
+	frame_count = 0;
+	lag = MIN_LAG;
+
+	// prior over octaves around 120 BPM, falling to a quarter one octave away, to favour the usual tempo octave
+	for (i = 0; i < NB_LAGS; i++) {
+		bpm = FRAMES_PER_MINUTE / (i + MIN_LAG);
+		distance = (bpm > 120) ? log2_q4 (bpm) - log2_q4 (120) : log2_q4 (120) - log2_q4 (bpm);
+		prior [i] = (256 * PRIOR_WIDTH) / (PRIOR_WIDTH + distance * distance);
+	}
+}
+
+
+// process one frame of BEAT_HOP 12-bit unsigned samples (as read from ADC);
+// returns true when a new estimate is available in "estimate"
+bool beat_process (const uint16_t * samples, struct beat_estimate * estimate)
+{
+	uint32_t energy = 0, level, previous, flux;
+	int32_t x;
+	int i;
+	bool result = false;
+
+	// energy of frame, after DC removal by a one-pole high pass filter
+	for (i = 0; i < BEAT_HOP; i++) {
+		x = ((int32_t) (samples [i] & 0x0FFF)) << 8;
+		dc += (x - dc) >> 6;
+		x -= dc;
+		energy += (uint32_t) ((x < 0 ? -x : x) >> 8);
+	}
+
+	// onset: increase of log energy compared to the average of 3 previous frames
+	level = log2_q4 (energy);
+	previous = (log_energy [0] + log_energy [1] + log_energy [2]) / 3;
+	log_energy [2] = log_energy [1];
+	log_energy [1] = log_energy [0];
+	log_energy [0] = level;
+	flux = (level > previous) ? (level - previous) * 16 : 0;
+	odf [frame_count & ODF_MASK] = (flux > ODF_MAX) ? ODF_MAX : flux;
+	frame_count++;
+
+	// wait for ODF history to be full before estimating tempo
+	if (frame_count < BEAT_ODF_LEN) return false;
+
+	for (i = 0; i < LAGS_PER_FRAME; i++) {
+		acf [lag - MIN_LAG] = correlate (lag);
+		if (++lag > MAX_LAG) {
+			lag = MIN_LAG;
+			estimate_tempo (estimate);
+			result = true;
+		}
+	}
+	return result;
+}
@@ -0,0 +1,38 @@
+/**
+ * @file beat.h
+ * @brief Fixed-point beat tracker: onset detection, tempo and phase estimation from audio samples
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _BEAT_H_
+#define _BEAT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BEAT_SAMPLE_RATE	8000	// audio sample rate (Hz)
+#define BEAT_HOP			64		// samples per onset detection frame (8 ms)
+#define BEAT_ODF_LEN		512		// onset detection function history, in frames (4 sec); power of 2
+#define BEAT_MIN_BPM		40
+#define BEAT_MAX_BPM		240
+
+// tempo and phase estimate
+struct beat_estimate {
+	uint32_t period;		// beat period (usec)
+	uint64_t last_beat;		// position of last beat, in samples since beginning of stream
+	uint32_t confidence;	// strength of tempo peak compared to average, Q8 (256 = no peak)
+	bool locked;			// estimate is reliable enough to drive the clock
+};
+
+// reset tracker
+void beat_init (void);
+
+// process one frame of BEAT_HOP 12-bit unsigned samples (as read from ADC);
+// returns true when a new estimate is available in "estimate"
+bool beat_process (const uint16_t * samples, struct beat_estimate * estimate);
+
+#endif /* _BEAT_H_ */
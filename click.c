@@ -0,0 +1,69 @@
+/**
+ * @file click.c
+ * @brief Metronome click on a PWM output (buzzer or headphone pin)
+ *
+ * The click is a square wave generated by the PWM slice of the click pin: starting a click only
+ * means writing the wrap and level registers, and a timer alarm sets the level back to 0 at the end.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include "hardware/pwm.h"
+#include "hardware/clocks.h"
+#include "click.h"
+
+// globals
+static uint click_gpio = NO_CLICK_GPIO;
+static uint click_slice = 0;
+static alarm_id_t click_alarm = 0;		// alarm stopping the current click; 0 if none
+
+
+// alarm callback: end of click
+static int64_t click_off (alarm_id_t id, void * user_data)
+{
+	(void) id;
+	(void) user_data;
+
+	pwm_set_gpio_level (click_gpio, 0);
+	click_alarm = 0;
+	return 0;		// do not reschedule
+}
+
+
+// set "gpio" as click output; does nothing if gpio is NO_CLICK_GPIO
+void click_init (uint gpio)
+{
+	if (gpio == NO_CLICK_GPIO) return;
+
+	click_gpio = gpio;
+	click_slice = pwm_gpio_to_slice_num (gpio);
+	gpio_set_function (gpio, GPIO_FUNC_PWM);
+
+	// PWM counter runs at 1MHz (system clock / system clock in MHz), so wrap value is the period in usec
+	pwm_set_clkdiv (click_slice, clock_get_hz (clk_sys) / 1000000.0f);
+	pwm_set_wrap (click_slice, (1000000 / CLICK_FREQ) - 1);
+	pwm_set_gpio_level (gpio, 0);
+	pwm_set_enabled (click_slice, true);
+}
+
+
+// start a click right now (accent for first beat of bar); click is stopped by a timer alarm, without CPU involvement from the caller
+void click (bool accent)
+{
+	uint16_t wrap;
+
+	if (click_gpio == NO_CLICK_GPIO) return;
+
+	// restart alarm if previous click is still sounding
+	if (click_alarm) cancel_alarm (click_alarm);
+
+	wrap = (1000000 / (accent ? CLICK_FREQ_ACCENT : CLICK_FREQ)) - 1;
+	pwm_set_wrap (click_slice, wrap);
+	pwm_set_gpio_level (click_gpio, wrap / 2);		// 50% duty cycle square wave
+
+	click_alarm = add_alarm_in_us (CLICK_DURATION, click_off, NULL, true);
+	if (click_alarm < 0) click_alarm = 0;
+}
@@ -0,0 +1,28 @@
+/**
+ * @file click.h
+ * @brief Metronome click on a PWM output (buzzer or headphone pin)
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _CLICK_H_
+#define _CLICK_H_
+
+#include "pico/stdlib.h"
+
+#define NO_CLICK_GPIO		255		// no click output
+
+#define CLICK_FREQ			1000	// click tone frequency (Hz)
+#define CLICK_FREQ_ACCENT	2000	// first beat of bar tone frequency (Hz)
+#define CLICK_DURATION		20000	// click duration (usec)
+
+// set "gpio" as click output; does nothing if gpio is NO_CLICK_GPIO
+void click_init (uint gpio);
+
+// start a click right now (accent for first beat of bar); click is stopped by a timer alarm, without CPU involvement from the caller
+void click (bool accent);
+
+#endif /* _CLICK_H_ */
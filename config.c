@@ -0,0 +1,192 @@
+/**
+ * @file config.c
+ * @brief Binary configuration image: pedal map, timing, setlist, tempo maps, macros and device profiles
+ *
+ * All the checks are done once, by config_check (): afterwards, records are read directly from the image.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include <stddef.h>
+#include "config.h"
+
+#define CRC_POLYNOMIAL	0xEDB88320		// reversed IEEE 802.3 polynomial
+
+// globals
+static const struct config_header * header = NULL;		// image in use; NULL for defaults
+static const struct config_settings * settings = NULL;
+
+
+// crc32 (IEEE 802.3) of "lg" bytes
+uint32_t config_crc (const uint8_t * data, uint32_t lg)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	uint32_t i, bit;
+
+	// bitwise: only run once at boot, on a few kbytes, so a table is not worth its flash
+	for (i = 0; i < lg; i++) {
+		crc ^= data [i];
+		for (bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ ((crc & 1) ? CRC_POLYNOMIAL : 0);
+	}
+	return ~crc;
+}
+
+
+// returns true if array of "count" records of "record_size" bytes at "offset" is inside an image of "size" bytes
+static bool array_fits (uint32_t offset, uint32_t count, uint32_t record_size, uint32_t size)
+{
+	if (count == 0) return true;
+	if (offset & 3) return false;
+	if (offset < sizeof (struct config_header) + sizeof (struct config_settings) || offset > size) return false;
+	return count <= (size - offset) / record_size;
+}
+
+
+// returns true if "image" holds a valid image of at most "max_size" bytes, with values in range
+bool config_check (const uint8_t * image, uint32_t max_size)
+{
+	const struct config_header * h = (const struct config_header *) image;
+	const struct config_settings * s;
+	const struct config_song * songs;
+	const struct config_macro * macros;
+	const struct config_device * devices;
+	const struct config_tempo * tempos;
+	uint32_t i, run = 0;
+
+	// header
+	if (max_size < sizeof (struct config_header) + sizeof (struct config_settings)) return false;
+	if (h->magic != CONFIG_MAGIC || h->version != CONFIG_VERSION || h->header_size != sizeof (struct config_header)) return false;
+	if (h->size < sizeof (struct config_header) + sizeof (struct config_settings) || h->size > max_size) return false;
+	if (h->nb_songs > CONFIG_MAX_SONGS || h->nb_macros > CONFIG_MAX_MACROS || h->nb_devices > CONFIG_MAX_DEVICES) return false;
+	if (h->nb_tempos > CONFIG_MAX_TEMPOS) return false;
+	if (!array_fits (h->songs_offset, h->nb_songs, sizeof (struct config_song), h->size)) return false;
+	if (!array_fits (h->macros_offset, h->nb_macros, sizeof (struct config_macro), h->size)) return false;
+	if (!array_fits (h->devices_offset, h->nb_devices, sizeof (struct config_device), h->size)) return false;
+	if (!array_fits (h->tempos_offset, h->nb_tempos, sizeof (struct config_tempo), h->size)) return false;
+	if (config_crc (image + h->header_size, h->size - h->header_size) != h->crc) return false;
+
+	// values
+	s = (const struct config_settings *) (image + h->header_size);
+	for (i = 0; i < CONFIG_PEDALS; i++) {
+		if (s->pedal_gpio [i] > 29 && s->pedal_gpio [i] != CONFIG_NO_GPIO) return false;
+	}
+	if (s->sessions < 1 || s->sessions > 64) return false;
+	if (s->beats_per_bar < 1 || s->beats_per_bar > 16) return false;
+	if (s->mtc_fps != 0 && s->mtc_fps != 24 && s->mtc_fps != 25 && s->mtc_fps != 30) return false;
+	if (s->drum_channel > 15) return false;
+	if (s->looper_bars < 1 || s->looper_bars > 16) return false;
+
+	songs = (const struct config_song *) (image + h->songs_offset);
+	for (i = 0; i < h->nb_songs; i++) {
+		if (songs [i].session >= s->sessions) return false;
+		if (songs [i].macro != CONFIG_NO_MACRO && songs [i].macro >= h->nb_macros) return false;
+		if (songs [i].bpm != 0 && (songs [i].bpm < 400 || songs [i].bpm > 2400)) return false;
+	}
+
+	macros = (const struct config_macro *) (image + h->macros_offset);
+	for (i = 0; i < h->nb_macros; i++) {
+		if (macros [i].lg > CONFIG_MACRO_SIZE) return false;
+	}
+
+	devices = (const struct config_device *) (image + h->devices_offset);
+	for (i = 0; i < h->nb_devices; i++) {
+		if (devices [i].role > CONFIG_ROLE_IGNORE) return false;
+		if (devices [i].channel > 15 && devices [i].channel != 255) return false;
+	}
+
+	// tempo maps: bars go up within each map, and a map fits in the segments of the clock engine
+	tempos = (const struct config_tempo *) (image + h->tempos_offset);
+	for (i = 0; i < h->nb_tempos; i++) {
+		if (tempos [i].bar == 0 || tempos [i].bpm < 400 || tempos [i].bpm > 2400) return false;
+		if (tempos [i].flags & ~(CONFIG_TEMPO_RAMP | CONFIG_TEMPO_SESSION)) return false;
+		if (tempos [i].owner >= ((tempos [i].flags & CONFIG_TEMPO_SESSION) ? s->sessions : h->nb_songs)) return false;
+		if (i > 0 && tempos [i].owner == tempos [i - 1].owner && (tempos [i].flags & CONFIG_TEMPO_SESSION) == (tempos [i - 1].flags & CONFIG_TEMPO_SESSION)) {
+			if (tempos [i].bar <= tempos [i - 1].bar) return false;
+			run++;
+		}
+		else run = 1;
+		if (run > CONFIG_MAP_TEMPOS) return false;
+	}
+	return true;
+}
+
+
+// use "image" if it is valid, or "defaults" with no setlist, macro or device profile otherwise; returns true if image is used
+// nothing is copied: image and defaults must stay in memory (flash) as long as configuration is read
+bool config_init (const uint8_t * image, uint32_t max_size, const struct config_settings * defaults)
+{
+	if (image != NULL && config_check (image, max_size)) {
+		header = (const struct config_header *) image;
+		settings = (const struct config_settings *) (image + header->header_size);
+		return true;
+	}
+
+	header = NULL;
+	settings = defaults;
+	return false;
+}
+
+
+// configuration in use
+const struct config_settings * config_settings (void)
+{
+	return settings;
+}
+
+
+uint32_t config_nb_songs (void)
+{
+	return header ? header->nb_songs : 0;
+}
+
+
+const struct config_song * config_song (uint32_t index)
+{
+	if (header == NULL || index >= header->nb_songs) return NULL;
+	return (const struct config_song *) ((const uint8_t *) header + header->songs_offset) + index;
+}
+
+
+const struct config_macro * config_macro (uint32_t index)
+{
+	if (header == NULL || index >= header->nb_macros) return NULL;
+	return (const struct config_macro *) ((const uint8_t *) header + header->macros_offset) + index;
+}
+
+
+const struct config_device * config_device (uint16_t vid, uint16_t pid)
+{
+	const struct config_device * devices;
+	uint32_t i;
+
+	if (header == NULL) return NULL;
+	devices = (const struct config_device *) ((const uint8_t *) header + header->devices_offset);
+	for (i = 0; i < header->nb_devices; i++) {
+		if (devices [i].vid == vid && devices [i].pid == pid) return &devices [i];
+	}
+	return NULL;
+}
+
+
+// tempo map of setlist entry "owner", or of session "owner" if "session" is true; returns its number of entries, and
+// its first entry in "entries"
+uint32_t config_tempo_map (uint8_t owner, bool session, const struct config_tempo ** entries)
+{
+	const struct config_tempo * tempos;
+	uint8_t flag = session ? CONFIG_TEMPO_SESSION : 0;
+	uint32_t i, n = 0;
+
+	*entries = NULL;
+	if (header == NULL) return 0;
+	tempos = (const struct config_tempo *) ((const uint8_t *) header + header->tempos_offset);
+	for (i = 0; i < header->nb_tempos; i++) {
+		if (tempos [i].owner != owner || (tempos [i].flags & CONFIG_TEMPO_SESSION) != flag) continue;
+		if (n == 0) *entries = &tempos [i];
+		else if (*entries + n != &tempos [i]) break;		// entries of a map are consecutive
+		n++;
+	}
+	return n;
+}
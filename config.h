@@ -0,0 +1,131 @@
+/**
+ * @file config.h
+ * @brief Binary configuration image: pedal map, timing, setlist, tempo maps, macros and device profiles
+ *
+ * The image is written to the last CONFIG_FLASH_SIZE bytes of flash, and read in place through XIP: records are
+ * little-endian, naturally aligned structures, so the firmware only checks the image once at boot, and never
+ * parses text or copies the image to RAM. Images are built from a text file by tools/configc, which uses these same
+ * definitions and checks.
+ *
+ * The linker script of the firmware (CMakeLists.txt) takes CONFIG_FLASH_SIZE off the program's flash region, so that
+ * the program can never overwrite the image.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _CONFIG_H_
+#define _CONFIG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CONFIG_MAGIC		0x47464350	// "PCFG"
+#define CONFIG_VERSION		4			// bumped whenever the layout of a record changes
+#define CONFIG_FLASH_SIZE	(64 * 1024)	// flash region reserved for the image, at the end of flash; (<n> * 1024), read by CMakeLists.txt
+#define CONFIG_NO_GPIO		255			// pedal not present
+
+#define CONFIG_PEDALS		9			// pedals, in the order of their bits: PREV, NEXT, PLAY, CONTINUE, TEMPO, HALF, DOUBLE, LOOPER, MOD
+#define CONFIG_NAME_SIZE	12			// song name, 0-terminated unless it takes the whole field
+#define CONFIG_MACRO_SIZE	31			// midi bytes in a macro
+#define CONFIG_MAX_SONGS	128
+#define CONFIG_MAX_MACROS	64
+#define CONFIG_MAX_DEVICES	16
+#define CONFIG_MAX_TEMPOS	512
+#define CONFIG_MAP_TEMPOS	32			// entries of one tempo map, as followed by the clock engine
+#define CONFIG_NO_MACRO		255
+
+// tempo map entries
+#define CONFIG_TEMPO_RAMP		1		// tempo goes linearly to the one of the next entry, instead of a step at that entry
+#define CONFIG_TEMPO_SESSION	2		// entry belongs to a session, instead of a setlist entry
+
+// device roles
+#define CONFIG_ROLE_GROOVEBOX	0		// device receiving sessions, clock and transport
+#define CONFIG_ROLE_DRUMS		1		// drum trigger input, for the drum follower
+#define CONFIG_ROLE_IGNORE		2		// device is not used
+
+// image header, at offset 0
+struct config_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t header_size;		// sizeof (struct config_header)
+	uint32_t size;				// total image size (bytes)
+	uint32_t crc;				// crc32 of bytes from header_size to size
+	uint32_t songs_offset;		// offsets of record arrays from start of image; multiples of 4
+	uint32_t macros_offset;
+	uint32_t devices_offset;
+	uint32_t tempos_offset;
+	uint16_t nb_songs;
+	uint16_t nb_macros;
+	uint16_t nb_devices;
+	uint16_t nb_tempos;
+};
+
+// fixed settings, right after the header
+struct config_settings {
+	uint8_t pedal_gpio [CONFIG_PEDALS];	// gpio of each pedal, CONFIG_NO_GPIO if not present
+	uint8_t sessions;					// number of sessions of the groovebox (1 to 64): next and previous wrap around
+	uint8_t beats_per_bar;				// 1 to 16
+	uint8_t count_in_bars;				// 0 for no count-in
+	uint8_t mtc_fps;					// 24, 25 or 30; 0 to disable time code
+	uint8_t drum_channel;				// midi channel (0 to 15) of drum trigger notes
+	uint8_t looper_bars;				// length of loops (1 to 16 bars)
+	uint8_t reserved [1];
+};
+
+// setlist entry: next and previous pedals walk the setlist instead of the sessions, when there is one
+struct config_song {
+	uint8_t session;			// session of the groovebox (0 to sessions - 1)
+	uint8_t macro;				// macro sent after the session change, CONFIG_NO_MACRO if none
+	uint16_t bpm;				// tempo in 1/10 BPM, 0 to keep current tempo
+	char name [CONFIG_NAME_SIZE];
+};
+
+// tempo map entry: from "bar" of its song on, the clock plays at "bpm". Entries of a song are consecutive, in bar order
+struct config_tempo {
+	uint16_t bar;				// 1 for first bar
+	uint16_t bpm;				// tempo in 1/10 BPM
+	uint8_t owner;				// setlist entry, or session with CONFIG_TEMPO_SESSION
+	uint8_t flags;				// CONFIG_TEMPO_RAMP, CONFIG_TEMPO_SESSION
+	uint8_t reserved [2];
+};
+
+// midi bytes sent as is to the groovebox
+struct config_macro {
+	uint8_t lg;
+	uint8_t data [CONFIG_MACRO_SIZE];
+};
+
+// role of a USB MIDI device, by vendor and product id
+struct config_device {
+	uint16_t vid;
+	uint16_t pid;
+	uint8_t role;
+	uint8_t channel;			// drum trigger channel of a CONFIG_ROLE_DRUMS device; 255 for the one in settings
+	uint8_t reserved [2];
+};
+
+// crc32 (IEEE 802.3) of "lg" bytes
+uint32_t config_crc (const uint8_t * data, uint32_t lg);
+
+// returns true if "image" holds a valid image of at most "max_size" bytes, with values in range
+bool config_check (const uint8_t * image, uint32_t max_size);
+
+// use "image" if it is valid, or "defaults" with no setlist, macro or device profile otherwise; returns true if image is used
+// nothing is copied: image and defaults must stay in memory (flash) as long as configuration is read
+bool config_init (const uint8_t * image, uint32_t max_size, const struct config_settings * defaults);
+
+// configuration in use
+const struct config_settings * config_settings (void);
+uint32_t config_nb_songs (void);
+const struct config_song * config_song (uint32_t index);			// NULL if no such song
+const struct config_macro * config_macro (uint32_t index);			// NULL if no such macro
+const struct config_device * config_device (uint16_t vid, uint16_t pid);	// NULL if device has no profile
+
+// tempo map of setlist entry "owner", or of session "owner" if "session" is true; returns its number of entries, and
+// its first entry in "entries"
+uint32_t config_tempo_map (uint8_t owner, bool session, const struct config_tempo ** entries);
+
+#endif /* _CONFIG_H_ */
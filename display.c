@@ -0,0 +1,186 @@
+/**
+ * @file display.c
+ * @brief Status screen renderer for a 128x64 monochrome OLED: framebuffer and dirty regions
+ *
+ * The framebuffer has the layout of SSD1306 memory: 8 pages of 128 columns, one byte per column holds 8 pixel rows
+ * (bit 0 on top). Each field of the screen (tempo, session, transport, position) is redrawn only when its value
+ * changes, and a column byte only becomes dirty if its value is really different. Each page keeps a single dirty
+ * run of columns, so the driver sends at most one short transfer per page.
+ *
+ * Screen layout:
+ *   pages 0-1: tempo, double size, and "BPM"
+ *   page 3:    session
+ *   page 5:    transport state or activity progress, and "NO USB" when no device is connected
+ *   pages 6-7: bar.beat, double size
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include <stdio.h>
+#include "display.h"
+
+#define FONT_FIRST		0x20		// first character in font
+#define FONT_LAST		0x5A		// last character in font; lowercase is drawn as uppercase
+#define FONT_WIDTH		5			// columns per character
+#define CHAR_WIDTH		6			// columns per character, with spacing
+#define TEXT_SIZE		16			// longest field text, plus ending 0
+
+// 5x7 font, one byte per column, bit 0 on top
+static const uint8_t font [FONT_LAST - FONT_FIRST + 1][FONT_WIDTH] = {
+	{0x00,0x00,0x00,0x00,0x00}, {0x00,0x00,0x5F,0x00,0x00}, {0x00,0x07,0x00,0x07,0x00}, {0x14,0x7F,0x14,0x7F,0x14},	//  !"#
+	{0x24,0x2A,0x7F,0x2A,0x12}, {0x23,0x13,0x08,0x64,0x62}, {0x36,0x49,0x56,0x20,0x50}, {0x00,0x08,0x07,0x03,0x00},	// $%&'
+	{0x00,0x1C,0x22,0x41,0x00}, {0x00,0x41,0x22,0x1C,0x00}, {0x2A,0x1C,0x7F,0x1C,0x2A}, {0x08,0x08,0x3E,0x08,0x08},	// ()*+
+	{0x00,0x80,0x70,0x30,0x00}, {0x08,0x08,0x08,0x08,0x08}, {0x00,0x00,0x60,0x60,0x00}, {0x20,0x10,0x08,0x04,0x02},	// ,-./
+	{0x3E,0x51,0x49,0x45,0x3E}, {0x00,0x42,0x7F,0x40,0x00}, {0x72,0x49,0x49,0x49,0x46}, {0x21,0x41,0x49,0x4D,0x33},	// 0123
+	{0x18,0x14,0x12,0x7F,0x10}, {0x27,0x45,0x45,0x45,0x39}, {0x3C,0x4A,0x49,0x49,0x31}, {0x41,0x21,0x11,0x09,0x07},	// 4567
+	{0x36,0x49,0x49,0x49,0x36}, {0x46,0x49,0x49,0x29,0x1E}, {0x00,0x00,0x14,0x00,0x00}, {0x00,0x40,0x34,0x00,0x00},	// 89:;
+	{0x00,0x08,0x14,0x22,0x41}, {0x14,0x14,0x14,0x14,0x14}, {0x00,0x41,0x22,0x14,0x08}, {0x02,0x01,0x59,0x09,0x06},	// <=>?
+	{0x3E,0x41,0x5D,0x59,0x4E}, {0x7C,0x12,0x11,0x12,0x7C}, {0x7F,0x49,0x49,0x49,0x36}, {0x3E,0x41,0x41,0x41,0x22},	// @ABC
+	{0x7F,0x41,0x41,0x41,0x3E}, {0x7F,0x49,0x49,0x49,0x41}, {0x7F,0x09,0x09,0x09,0x01}, {0x3E,0x41,0x41,0x51,0x73},	// DEFG
+	{0x7F,0x08,0x08,0x08,0x7F}, {0x00,0x41,0x7F,0x41,0x00}, {0x20,0x40,0x41,0x3F,0x01}, {0x7F,0x08,0x14,0x22,0x41},	// HIJK
+	{0x7F,0x40,0x40,0x40,0x40}, {0x7F,0x02,0x1C,0x02,0x7F}, {0x7F,0x04,0x08,0x10,0x7F}, {0x3E,0x41,0x41,0x41,0x3E},	// LMNO
+	{0x7F,0x09,0x09,0x09,0x06}, {0x3E,0x41,0x51,0x21,0x5E}, {0x7F,0x09,0x19,0x29,0x46}, {0x26,0x49,0x49,0x49,0x32},	// PQRS
+	{0x03,0x01,0x7F,0x01,0x03}, {0x3F,0x40,0x40,0x40,0x3F}, {0x1F,0x20,0x40,0x20,0x1F}, {0x3F,0x40,0x38,0x40,0x3F},	// TUVW
+	{0x63,0x14,0x08,0x14,0x63}, {0x03,0x04,0x78,0x04,0x03}, {0x61,0x59,0x49,0x4D,0x43}								// XYZ
+};
+
+// globals
+static uint8_t framebuffer [DISPLAY_PAGES][DISPLAY_WIDTH];
+static uint8_t dirty_first [DISPLAY_PAGES];		// first dirty column of each page; DISPLAY_WIDTH if page is clean
+static uint8_t dirty_last [DISPLAY_PAGES];		// last dirty column of each page
+static struct display_status shown;				// status currently in framebuffer
+static bool drawn = false;						// fields have been drawn once
+
+
+// set column "x" of "page" to "bits", and mark it dirty if it changes
+static void put_column (uint32_t page, uint32_t x, uint8_t bits)
+{
+	if (page >= DISPLAY_PAGES || x >= DISPLAY_WIDTH || framebuffer [page][x] == bits) return;
+
+	framebuffer [page][x] = bits;
+	if (dirty_first [page] == DISPLAY_WIDTH) dirty_first [page] = dirty_last [page] = x;
+	else if (x < dirty_first [page]) dirty_first [page] = x;
+	else if (x > dirty_last [page]) dirty_last [page] = x;
+}
+
+
+// 8 pixel rows doubled into 16: low or high byte
+static uint8_t stretch (uint8_t bits, bool high)
+{
+	uint8_t result = 0;
+	uint32_t i;
+
+	if (high) bits >>= 4;
+	for (i = 0; i < 4; i++) {
+		if (bits & (1 << i)) result |= 3 << (i * 2);
+	}
+	return result;
+}
+
+
+// draw "text" from column "x" of "page", padded with blanks to "width" characters; "size" 2 draws double size on 2 pages
+static void draw_text (uint32_t page, uint32_t x, const char * text, uint32_t width, uint32_t size)
+{
+	uint32_t i, col, dx;
+	uint8_t bits;
+	char c;
+	bool end = false;
+
+	for (i = 0; i < width; i++) {
+		if (!end && text [i] == 0) end = true;
+		c = end ? ' ' : text [i];
+		if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+		if (c < FONT_FIRST || c > FONT_LAST) c = '?';
+
+		for (col = 0; col < CHAR_WIDTH; col++) {
+			bits = (col < FONT_WIDTH) ? font [c - FONT_FIRST][col] : 0;
+			if (size == 1) put_column (page, x + i * CHAR_WIDTH + col, bits);
+			else {
+				for (dx = 0; dx < 2; dx++) {
+					put_column (page, x + (i * CHAR_WIDTH + col) * 2 + dx, stretch (bits, false));
+					put_column (page + 1, x + (i * CHAR_WIDTH + col) * 2 + dx, stretch (bits, true));
+				}
+			}
+		}
+	}
+}
+
+
+// clear framebuffer, and mark the whole screen as dirty so that it is cleared on the display too
+void display_init (void)
+{
+	uint32_t page, x;
+
+	for (page = 0; page < DISPLAY_PAGES; page++) {
+		for (x = 0; x < DISPLAY_WIDTH; x++) framebuffer [page][x] = 0;
+		dirty_first [page] = 0;
+		dirty_last [page] = DISPLAY_WIDTH - 1;
+	}
+	drawn = false;
+}
+
+
+// draw the fields of status that have changed since last call; only the columns that actually change are marked dirty
+void display_render (const struct display_status * status)
+{
+	char text [TEXT_SIZE];
+
+	if (!drawn || status->bpm != shown.bpm) {
+		snprintf (text, TEXT_SIZE, "%3lu.%lu", (unsigned long) (status->bpm / 10), (unsigned long) (status->bpm % 10));
+		draw_text (0, 0, text, 5, 2);
+	}
+	if (!drawn) draw_text (1, DISPLAY_WIDTH - 3 * CHAR_WIDTH, "BPM", 3, 1);
+
+	if (!drawn || status->song != shown.song) {
+		snprintf (text, TEXT_SIZE, "SESSION %u", (unsigned) status->song + 1);
+		draw_text (3, 0, text, 11, 1);
+	}
+
+	if (!drawn || status->activity != shown.activity || status->progress != shown.progress) {
+		snprintf (text, TEXT_SIZE, "%s %u%%", (status->activity == DISPLAY_BACKUP) ? "BACKUP" : "RESTORE", (unsigned) status->progress);
+		if (status->activity != DISPLAY_NO_ACTIVITY) draw_text (5, 0, text, 11, 1);
+	}
+	if ((!drawn || status->transport != shown.transport || status->activity != shown.activity) && status->activity == DISPLAY_NO_ACTIVITY) {
+		switch (status->transport) {
+			case DISPLAY_PLAY: draw_text (5, 0, "PLAY", 11, 1); break;
+			case DISPLAY_PAUSE: draw_text (5, 0, "PAUSE", 11, 1); break;
+			case DISPLAY_COUNT_IN: draw_text (5, 0, "COUNT IN", 11, 1); break;
+			default: draw_text (5, 0, "STOP", 11, 1); break;
+		}
+	}
+	if (!drawn || status->connected != shown.connected) {
+		draw_text (5, DISPLAY_WIDTH - 6 * CHAR_WIDTH, status->connected ? "" : "NO USB", 6, 1);
+	}
+
+	if (!drawn || status->bar != shown.bar || status->beat != shown.beat) {
+		snprintf (text, TEXT_SIZE, "%4ld.%u", (long) status->bar, (unsigned) status->beat);
+		draw_text (6, 0, text, 6, 2);
+	}
+
+	shown = *status;
+	drawn = true;
+}
+
+
+// take the first dirty region: one run of columns in one page, starting at "column" of "page"; returns its number of
+// bytes (0 if screen is clean), and its data in "data", valid until next call to display_render ()
+uint32_t display_next_dirty (uint8_t * page, uint8_t * column, const uint8_t ** data)
+{
+	uint32_t lg;
+	uint32_t p;
+
+	for (p = 0; p < DISPLAY_PAGES; p++) {
+		if (dirty_first [p] == DISPLAY_WIDTH) continue;
+
+		*page = p;
+		*column = dirty_first [p];
+		*data = &framebuffer [p][dirty_first [p]];
+		lg = dirty_last [p] - dirty_first [p] + 1;
+		dirty_first [p] = DISPLAY_WIDTH;
+		return lg;
+	}
+	return 0;
+}
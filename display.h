@@ -0,0 +1,56 @@
+/**
+ * @file display.h
+ * @brief Status screen renderer for a 128x64 monochrome OLED: framebuffer and dirty regions
+ *
+ * The renderer has no hardware access: tools/hosttest/test_display runs it against a simulated display, and prints
+ * the screen.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _DISPLAY_H_
+#define _DISPLAY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DISPLAY_WIDTH	128		// columns
+#define DISPLAY_PAGES	8		// pages of 8 pixel rows, as in SSD1306 memory
+
+// transport state shown on the screen
+#define DISPLAY_STOP		0
+#define DISPLAY_PLAY		1
+#define DISPLAY_PAUSE		2
+#define DISPLAY_COUNT_IN	3
+
+// long activities shown instead of transport state, with their progress
+#define DISPLAY_NO_ACTIVITY	0
+#define DISPLAY_BACKUP		1
+#define DISPLAY_RESTORE		2
+
+// what is shown on the screen
+struct display_status {
+	uint32_t bpm;			// tempo, in 1/10 BPM
+	uint8_t song;			// session number (0 for first session)
+	uint8_t transport;		// transport state
+	int32_t bar;			// bar number (1 for first bar; 0 and below during count-in)
+	uint8_t beat;			// beat in bar (1 for first beat)
+	bool connected;			// connection status to USB MIDI device
+	uint8_t activity;		// long activity going on, DISPLAY_NO_ACTIVITY if none
+	uint8_t progress;		// progress of activity (%)
+};
+
+// clear framebuffer, and mark the whole screen as dirty so that it is cleared on the display too
+void display_init (void);
+
+// draw the fields of status that have changed since last call; only the columns that actually change are marked dirty
+void display_render (const struct display_status * status);
+
+// take the first dirty region: one run of columns in one page, starting at "column" of "page"; returns its number of
+// bytes (0 if screen is clean), and its data in "data", valid until next call to display_render ()
+uint32_t display_next_dirty (uint8_t * page, uint8_t * column, const uint8_t ** data);
+
+#endif /* _DISPLAY_H_ */
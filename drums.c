@@ -0,0 +1,121 @@
+/**
+ * @file drums.c
+ * @brief Tempo and phase follower from drum trigger notes (kick and snare note-ons)
+ *
+ * The follower keeps a beat grid (period and time of last beat). Each kick or snare hit close enough to a beat
+ * of the grid (within a quarter of beat) pulls the grid towards it: phase by a fraction of the error, period by
+ * a smaller fraction of the error divided by the number of beats since last hit. Kick pulls harder than snare.
+ * Hits between beats (eighth notes, fills) are ignored, and the grid is dropped when the drummer stops.
+ * A pulled grid can put its last beat slightly after the hit that pulled it: a hit up to a quarter of beat before
+ * the last beat belongs to that beat. Notes received at the same time (kick and snare of one USB packet) make one hit.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include "drums.h"
+
+#define MIN_PERIOD		250000		// 240 BPM (usec)
+#define MAX_PERIOD		1500000		// 40 BPM (usec)
+#define SEED_MIN_PERIOD	375000		// a grid seeded from 2 hits is folded between 80 BPM...
+#define SEED_MAX_PERIOD	750000		// ...and 160 BPM, as the interval may be an eighth note or a half note
+#define PHASE_GAIN		128			// fraction of phase error corrected at each hit (Q8)
+#define PERIOD_GAIN		48			// fraction of phase error applied to period at each hit (Q8)
+#define LOCK_HITS		3			// number of consecutive hits on the grid before follower drives the clock
+#define MAX_SILENCE		4			// beats without hit after which grid is dropped
+
+// globals
+static uint32_t period = 0;			// beat period (usec); 0 if grid is not set
+static uint64_t last_beat = 0;		// time of last beat of grid (usec)
+static uint64_t last_hit = 0;		// time of last hit (usec), to seed grid from 2 hits
+static int hits = 0;				// number of consecutive hits on the grid
+
+
+// weight of note (Q8): general MIDI kick and snare notes; 0 for other notes
+static int32_t note_weight (uint8_t note)
+{
+	switch (note) {
+		case 35:	// acoustic bass drum
+		case 36:	// bass drum
+			return 256;
+		case 38:	// acoustic snare
+		case 40:	// electric snare
+			return 192;
+		default:
+			return 0;
+	}
+}
+
+
+// reset follower; "initial_period" is a beat period (usec) to start from, 0 if unknown
+void drums_init (uint32_t initial_period)
+{
+	period = initial_period;
+	last_beat = 0;
+	last_hit = 0;
+	hits = 0;
+}
+
+
+// note-on "note" received at "time" (usec); returns true when the follower is locked,
+// with updated beat period (usec) and time of last beat (usec)
+bool drums_note (uint8_t note, uint64_t time, uint32_t * beat_period, uint64_t * beat_time)
+{
+	int32_t weight = note_weight (note);
+	int64_t error, since;
+	uint64_t beats, predicted;
+
+	if (weight == 0) return false;
+	if (time == last_hit) return false;		// same hit as previous note
+
+	// no grid yet: seed it from interval between 2 hits, or from initial period
+	if (last_beat == 0) {
+		if (period == 0 && last_hit != 0 && (time - last_hit) >= MIN_PERIOD && (time - last_hit) <= MAX_PERIOD) {
+			period = (uint32_t) (time - last_hit);
+			while (period < SEED_MIN_PERIOD) period *= 2;
+			while (period > SEED_MAX_PERIOD) period /= 2;
+		}
+		last_hit = time;
+		if (period != 0) {
+			last_beat = time;
+			hits = 1;
+		}
+		return false;
+	}
+	last_hit = time;
+
+	// drummer stopped: drop grid, keep period as a starting point
+	since = (int64_t) (time - last_beat);
+	if (since > (int64_t) period * MAX_SILENCE) {
+		last_beat = time;
+		hits = 1;
+		return false;
+	}
+	if (since < -(int64_t) period / 4) return false;		// before last beat, and not on it
+
+	// nearest beat of grid, and error to it
+	beats = (uint64_t) (since + (period / 2)) / period;
+	predicted = last_beat + beats * period;
+	error = (int64_t) (time - predicted);
+	if (error > (int64_t) period / 4 || error < -(int64_t) period / 4) return false;		// hit between beats
+	if (beats == 0) {
+		// another hit on the same beat (kick and snare together): only refine phase
+		last_beat += (error * PHASE_GAIN * weight) >> 17;
+		return false;
+	}
+
+	// pull grid towards hit
+	last_beat = predicted + ((error * PHASE_GAIN * weight) >> 16);
+	period += (int32_t) (((error * PERIOD_GAIN * weight) >> 16) / (int64_t) beats);
+	if (period < MIN_PERIOD) period = MIN_PERIOD;
+	if (period > MAX_PERIOD) period = MAX_PERIOD;
+
+	if (hits < LOCK_HITS) hits++;
+	if (hits < LOCK_HITS) return false;
+
+	*beat_period = period;
+	*beat_time = last_beat;
+	return true;
+}
@@ -0,0 +1,24 @@
+/**
+ * @file drums.h
+ * @brief Tempo and phase follower from drum trigger notes (kick and snare note-ons)
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _DRUMS_H_
+#define _DRUMS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// reset follower; "initial_period" is a beat period (usec) to start from, 0 if unknown
+void drums_init (uint32_t initial_period);
+
+// note-on "note" received at "time" (usec); returns true when the follower is locked,
+// with updated beat period (usec) and time of last beat (usec)
+bool drums_note (uint8_t note, uint64_t time, uint32_t * beat_period, uint64_t * beat_time);
+
+#endif /* _DRUMS_H_ */
@@ -0,0 +1,186 @@
+/**
+ * @file footswitch.c
+ * @brief USB footswitches: keys of HID keyboards (cheap USB pedals) drive the pedal functions, like the pedal gpios
+ *
+ * Most USB footswitches are keyboards that send one key per pedal. Keyboard interfaces of HID devices plugged into the
+ * hub are taken: boot keyboards are read in boot protocol (the TinyUSB default); other interfaces are taken when their
+ * report descriptor has a keyboard report, which is then expected in the same layout, after its report id. Keys down
+ * are mapped to pedal bits, and the reception time of each report that changes them is kept: the switch has already
+ * been debounced by the footswitch, so the pedal event needs no anti-bounce wait, and its time is the one of the
+ * report, not the one of the pedal scan. Reports come in through tuh_task (), every interval of the interrupt endpoint
+ * of the device (1 ms to 10 ms for most footswitches).
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include <stdio.h>
+#include "tusb.h"
+#include "config.h"
+#include "footswitch.h"
+
+#define NB_REPORTS			4			// reports of a descriptor parsed when looking for a keyboard report
+#define NO_ADDR				0
+#define KEYS_OFFSET			2			// boot keyboard report: modifiers, reserved, then up to 6 keys down
+#define KEYS_END			8
+#define ERROR_ROLLOVER		0x01		// usage id in all key slots when too many keys are down
+
+// keyboard interface used as footswitch
+struct keyboard {
+	uint8_t dev_addr;					// NO_ADDR if slot is free
+	uint8_t instance;
+	uint8_t report_id;					// 0 for boot protocol, with no report id
+	uint32_t pedals;					// pedal bits held by keys down
+};
+
+// globals
+static uint8_t pedal_keys [FOOTSWITCH_PEDALS];		// key of each pedal bit
+static uint32_t nb_pedals = 0;
+static struct keyboard keyboards [CFG_TUH_HID];
+static uint64_t change_time = 0;					// reception time of last report that changed pedal bits
+
+
+// keyboard slot of interface "instance" of device "dev_addr"; NULL if none
+static struct keyboard * find (uint8_t dev_addr, uint8_t instance)
+{
+	uint32_t i;
+
+	for (i = 0; i < CFG_TUH_HID; i++) {
+		if (keyboards [i].dev_addr == dev_addr && keyboards [i].instance == instance) return &keyboards [i];
+	}
+	return NULL;
+}
+
+
+// pedal bits of the keys down in keyboard "report" of "len" bytes, in boot layout
+static uint32_t report_pedals (const uint8_t * report, uint16_t len)
+{
+	uint32_t i, bit, pedals = 0;
+
+	for (i = KEYS_OFFSET; i < len && i < KEYS_END; i++) {
+		if (report [i] == 0) continue;
+		for (bit = 0; bit < nb_pedals; bit++) {
+			if (pedal_keys [bit] == report [i]) pedals |= 1u << bit;
+		}
+	}
+	return pedals;
+}
+
+
+// pedal bit i (PREV, NEXT, PLAY... in the order of their bits) is held while key "keys" [i] (HID usage id of keyboard
+// page, FOOTSWITCH_NO_KEY if none) is down on a USB keyboard; "count" pedal bits (at most FOOTSWITCH_PEDALS)
+void footswitch_init (const uint8_t * keys, uint32_t count)
+{
+	uint32_t i;
+
+	nb_pedals = (count < FOOTSWITCH_PEDALS) ? count : FOOTSWITCH_PEDALS;
+	for (i = 0; i < nb_pedals; i++) pedal_keys [i] = keys [i];
+	for (i = 0; i < CFG_TUH_HID; i++) {
+		keyboards [i].dev_addr = NO_ADDR;
+		keyboards [i].instance = 0;
+	}
+	change_time = 0;
+}
+
+
+// pedal bits held by the keys of all USB footswitches; time of the report that last changed them in "time" (usec since
+// boot), 0 if none yet
+uint32_t footswitch_pedals (uint64_t * time)
+{
+	uint32_t i, pedals = 0;
+
+	for (i = 0; i < CFG_TUH_HID; i++) {
+		if (keyboards [i].dev_addr != NO_ADDR) pedals |= keyboards [i].pedals;
+	}
+	*time = change_time;
+	return pedals;
+}
+
+
+// TinyUSB: HID interface mounted; report descriptor is NULL if longer than CFG_TUH_ENUMERATION_BUFSIZE
+void tuh_hid_mount_cb (uint8_t dev_addr, uint8_t instance, uint8_t const * desc_report, uint16_t desc_len)
+{
+	tuh_hid_report_info_t info [NB_REPORTS];
+	const struct config_device * profile;
+	struct keyboard * keyboard;
+	uint16_t vid, pid;
+	uint8_t report_id = 0, i, n;
+
+	tuh_vid_pid_get (dev_addr, &vid, &pid);
+	profile = config_device (vid, pid);
+	if (profile && profile->role == CONFIG_ROLE_IGNORE) {
+		printf ("HID device %04x:%04x is ignored by configuration\r\n", vid, pid);
+		return;
+	}
+
+	// not a boot keyboard: look for a keyboard report in report protocol
+	if (tuh_hid_interface_protocol (dev_addr, instance) != HID_ITF_PROTOCOL_KEYBOARD) {
+		if (desc_report == NULL) return;
+		n = tuh_hid_parse_report_descriptor (info, NB_REPORTS, desc_report, desc_len);
+		for (i = 0; i < n; i++) {
+			if (info [i].usage_page == HID_USAGE_PAGE_DESKTOP && info [i].usage == HID_USAGE_DESKTOP_KEYBOARD) break;
+		}
+		if (i == n) return;
+		report_id = info [i].report_id;
+	}
+
+	// free slots are NO_ADDR, instance 0
+	if ((keyboard = find (NO_ADDR, 0)) == NULL) {
+		printf ("USB footswitch address = %u, instance = %u: no free slot\r\n", dev_addr, instance);
+		return;
+	}
+	keyboard->dev_addr = dev_addr;
+	keyboard->instance = instance;
+	keyboard->report_id = report_id;
+	keyboard->pedals = 0;
+	printf ("USB footswitch address = %u, instance = %u (%04x:%04x) is used as pedal input\r\n", dev_addr, instance, vid, pid);
+
+	if (!tuh_hid_receive_report (dev_addr, instance)) printf ("USB footswitch address = %u: cannot request report\r\n", dev_addr);
+}
+
+
+// TinyUSB: HID interface un-mounted; keys it held are released
+void tuh_hid_umount_cb (uint8_t dev_addr, uint8_t instance)
+{
+	struct keyboard * keyboard = find (dev_addr, instance);
+
+	if (keyboard == NULL) return;
+	if (keyboard->pedals) change_time = time_us_64 ();
+	keyboard->dev_addr = NO_ADDR;
+	keyboard->instance = 0;
+	printf ("USB footswitch address = %u, instance = %u is unmounted\r\n", dev_addr, instance);
+}
+
+
+// TinyUSB: report received from HID interface
+void tuh_hid_report_received_cb (uint8_t dev_addr, uint8_t instance, uint8_t const * report, uint16_t len)
+{
+	uint64_t now = time_us_64 ();
+	struct keyboard * keyboard = find (dev_addr, instance);
+	uint32_t pedals;
+
+	if (keyboard == NULL) return;
+
+	// report protocol: other reports of the interface (consumer keys...) are skipped
+	if (keyboard->report_id != 0) {
+		if (len == 0 || report [0] != keyboard->report_id) len = 0;
+		else {
+			report++;
+			len--;
+		}
+	}
+
+	// too many keys down: state is unknown, keep the previous one
+	if (len > KEYS_OFFSET && report [KEYS_OFFSET] != ERROR_ROLLOVER) {
+		pedals = report_pedals (report, len);
+		if (pedals != keyboard->pedals) {
+			keyboard->pedals = pedals;
+			change_time = now;
+		}
+	}
+
+	// next report
+	tuh_hid_receive_report (dev_addr, instance);
+}
@@ -0,0 +1,27 @@
+/**
+ * @file footswitch.h
+ * @brief USB footswitches: keys of HID keyboards (cheap USB pedals) drive the pedal functions, like the pedal gpios
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _FOOTSWITCH_H_
+#define _FOOTSWITCH_H_
+
+#include "pico/stdlib.h"
+
+#define FOOTSWITCH_PEDALS		16			// maximum number of pedal bits driven by keys
+#define FOOTSWITCH_NO_KEY		0			// pedal bit driven by no key
+
+// pedal bit i (PREV, NEXT, PLAY... in the order of their bits) is held while key "keys" [i] (HID usage id of keyboard
+// page, FOOTSWITCH_NO_KEY if none) is down on a USB keyboard; "count" pedal bits (at most FOOTSWITCH_PEDALS)
+void footswitch_init (const uint8_t * keys, uint32_t count);
+
+// pedal bits held by the keys of all USB footswitches; time of the report that last changed them in "time" (usec since
+// boot), 0 if none yet
+uint32_t footswitch_pedals (uint64_t * time);
+
+#endif /* _FOOTSWITCH_H_ */
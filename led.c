@@ -0,0 +1,106 @@
+/**
+ * @file led.c
+ * @brief Beat and bar tempo indicator on the LEDs, with hardware PWM fade-out
+ *
+ * Each led is driven by its PWM slice. A flash is a table of decreasing compare values that a DMA channel,
+ * paced by the PWM wrap DREQ, copies into the compare register: one step per PWM period. Starting a flash
+ * only restarts the DMA channel; the fade-out itself costs no CPU.
+ * Note the compare register holds both channels of a slice: the 2 leds must not be on the same PWM slice.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include "hardware/pwm.h"
+#include "hardware/dma.h"
+#include "hardware/clocks.h"
+#include "led.h"
+
+#define LED_PWM_WRAP	4095	// 12-bit brightness
+#define LED_BEAT_LEVEL	(LED_PWM_WRAP / 4)	// brightness of beat flash; first beat of bar flashes at full brightness
+
+// type definition
+struct tempo_led {
+	uint gpio;
+	uint slice;
+	int dma;								// DMA channel feeding the compare register; -1 if led is not present
+	dma_channel_config config;
+	uint32_t beat [LED_FADE_STEPS];			// compare register values for a beat flash
+	uint32_t bar [LED_FADE_STEPS];			// compare register values for a bar flash
+};
+
+// globals
+static struct tempo_led led1 = { .gpio = LED_NONE, .dma = -1 };
+static struct tempo_led led2 = { .gpio = LED_NONE, .dma = -1 };
+
+
+// fill a fade-out table going from "level" to 0, in the compare register half of the led's channel
+static void fill_fade (uint32_t * table, uint gpio, uint32_t level)
+{
+	uint32_t i, remaining, value;
+	uint shift = (pwm_gpio_to_channel (gpio) == PWM_CHAN_B) ? 16 : 0;
+
+	for (i = 0; i < LED_FADE_STEPS; i++) {
+		// quadratic decay looks more linear to the eye than a linear one
+		remaining = LED_FADE_STEPS - 1 - i;
+		value = (level * remaining * remaining) / ((LED_FADE_STEPS - 1) * (LED_FADE_STEPS - 1));
+		table [i] = value << shift;
+	}
+}
+
+
+// set PWM and DMA for a led
+static void init_led (struct tempo_led * led, uint gpio)
+{
+	if (gpio == LED_NONE) return;
+
+	led->gpio = gpio;
+	led->slice = pwm_gpio_to_slice_num (gpio);
+	gpio_set_function (gpio, GPIO_FUNC_PWM);
+
+	// one PWM period per fade step: LED_FADE_STEPS periods make LED_FADE_TIME (usec), whatever the system clock
+	pwm_set_clkdiv (led->slice, ((clock_get_hz (clk_sys) / 1000000.0f) * LED_FADE_TIME) / (LED_FADE_STEPS * (LED_PWM_WRAP + 1)));
+	pwm_set_wrap (led->slice, LED_PWM_WRAP);
+	pwm_set_gpio_level (gpio, 0);
+	pwm_set_enabled (led->slice, true);
+
+	fill_fade (led->beat, gpio, LED_BEAT_LEVEL);
+	fill_fade (led->bar, gpio, LED_PWM_WRAP);
+
+	// DMA copies one table entry to the compare register at each PWM wrap
+	led->dma = dma_claim_unused_channel (true);
+	led->config = dma_channel_get_default_config (led->dma);
+	channel_config_set_transfer_data_size (&led->config, DMA_SIZE_32);
+	channel_config_set_read_increment (&led->config, true);
+	channel_config_set_write_increment (&led->config, false);
+	channel_config_set_dreq (&led->config, pwm_get_dreq (led->slice));
+}
+
+
+// restart the fade-out of a led from the beginning of table
+static void start_fade (struct tempo_led * led, const uint32_t * table)
+{
+	if (led->dma < 0) return;
+
+	dma_channel_abort (led->dma);
+	dma_channel_configure (led->dma, &led->config, &pwm_hw->slice [led->slice].cc, table, LED_FADE_STEPS, true);
+}
+
+
+// set "gpio" (flashes on each beat, brighter on first beat of bar) and "gpio2" (flashes on first beat of bar) as tempo leds;
+// LED_NONE if a led is not present
+void led_init (uint gpio, uint gpio2)
+{
+	init_led (&led1, gpio);
+	init_led (&led2, gpio2);
+}
+
+
+// start a flash on beat (bar is true for first beat of bar); the fade-out is played by DMA into the PWM compare register
+void led_flash (bool bar)
+{
+	start_fade (&led1, bar ? led1.bar : led1.beat);
+	if (bar) start_fade (&led2, led2.bar);
+}
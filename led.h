@@ -0,0 +1,28 @@
+/**
+ * @file led.h
+ * @brief Beat and bar tempo indicator on the LEDs, with hardware PWM fade-out
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _LED_H_
+#define _LED_H_
+
+#include "pico/stdlib.h"
+
+#define LED_NONE		255		// no led on this pin (same value as NO_LED_GPIO)
+
+#define LED_FADE_STEPS	64		// number of brightness steps in a flash
+#define LED_FADE_TIME	120000	// duration of a flash (usec)
+
+// set "gpio" (flashes on each beat, brighter on first beat of bar) and "gpio2" (flashes on first beat of bar) as tempo leds;
+// LED_NONE if a led is not present
+void led_init (uint gpio, uint gpio2);
+
+// start a flash on beat (bar is true for first beat of bar); the fade-out is played by DMA into the PWM compare register
+void led_flash (bool bar);
+
+#endif /* _LED_H_ */
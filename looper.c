@@ -0,0 +1,292 @@
+/**
+ * @file looper.c
+ * @brief Bar-quantized midi looper: records midi received from the groovebox for some bars, then replays it in a loop
+ *
+ * Events live in packed 8-byte records, in the static arena (arena.h); there is no malloc. The loop has one list of events per
+ * clock tick: each tick only walks the events due on it, whatever the size of the loop. Events are linked by their
+ * record index, and unused records are chained in a free list. Each event keeps the overdub layer it was recorded in,
+ * so that the last layer can be removed, and the loop pass it was recorded in, so that it is not sent back to the
+ * groovebox while it is being played. Once that pass is over, the mark is cleared (LOOPER_PLAYED): passes count from
+ * the start of the song, which restarts on STOP then PLAY, so an old mark would mute the event on a later pass of
+ * the same number.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include <string.h>
+#include "midi_msg.h"
+#include "looper.h"
+
+#define LOOPER_NONE		0xFFFF		// end of an event list
+#define LOOPER_PLAYED	0xFFFF		// pass of an event whose recording pass is over: played on every pass
+#define MIDI_NOTE_OFF	0x80
+#define MIDI_NOTE_ON	0x90
+#define CC_ALL_NOTES_OFF	123
+
+// packed event
+struct loop_event {
+	uint16_t next;			// next event of the same tick (or of the free list), LOOPER_NONE if last
+	uint16_t pass;			// loop pass the event was recorded in: it is played from the next pass on; LOOPER_PLAYED after that
+	uint8_t status;			// channel message
+	uint8_t data [2];
+	uint8_t layer;			// overdub layer; 0 for the first pass
+};
+
+_Static_assert (sizeof (struct loop_event) == 8, "loop events are packed in 8 bytes");
+_Static_assert (sizeof (struct loop_event) * LOOPER_EVENTS <= ARENA_SIZEOF (looper_events), "looper events fit their arena buffer");
+_Static_assert (LOOPER_EVENTS < LOOPER_NONE, "event indexes are 16 bits");
+
+// globals
+static struct loop_event * const events = (struct loop_event *) arena.looper_events;
+static uint16_t * const heads = (uint16_t *) arena.looper_heads;		// first and last event of each tick of the loop
+static uint16_t * const tails = (uint16_t *) arena.looper_tails;
+static uint16_t free_list = LOOPER_NONE;
+static uint8_t state = LOOPER_EMPTY;
+static int32_t start_tick = 0;					// tick of start of loop, from start of song; on a bar boundary
+static uint32_t length = 0;						// length of loop (ticks)
+static uint16_t pass = 0;						// loop pass of last tick
+static uint8_t layer = 0;						// overdub layer being recorded
+static uint16_t cursor = LOOPER_NONE;			// next event of last tick to be sent
+static bool marked = false;						// some events still carry the pass they were recorded in
+static uint16_t channels = 0;					// channels played, for all notes off
+static uint32_t held [16][4];					// notes recorded as on and not yet off, per channel: their note off is always recorded
+static uint8_t message [3];						// channel message being received
+static uint32_t message_lg = 0;					// bytes of message received so far; 0 if none
+
+
+// number of data bytes of channel message "status"
+static uint32_t data_bytes (uint8_t status)
+{
+	return ((status & 0xF0) == 0xC0 || (status & 0xF0) == 0xD0) ? 1 : 2;
+}
+
+
+// clear the loop
+void looper_init (void)
+{
+	uint32_t i;
+
+	for (i = 0; i < LOOPER_EVENTS; i++) events [i].next = (i + 1 < LOOPER_EVENTS) ? i + 1 : LOOPER_NONE;
+	free_list = 0;
+	for (i = 0; i < LOOPER_MAX_TICKS; i++) heads [i] = tails [i] = LOOPER_NONE;
+	memset (held, 0, sizeof (held));
+	state = LOOPER_EMPTY;
+	layer = 0;
+	cursor = LOOPER_NONE;
+	marked = false;
+	message_lg = 0;
+}
+
+
+// looper pedal pressed: arm recording when empty, then overdub on / off once the loop plays
+void looper_press (void)
+{
+	switch (state) {
+		case LOOPER_EMPTY:
+			state = LOOPER_ARMED;
+			break;
+		case LOOPER_ARMED:
+			state = LOOPER_EMPTY;		// cancel
+			break;
+		case LOOPER_PLAY:
+			if (layer < 0xFF) {
+				layer++;
+				state = LOOPER_OVERDUB;
+			}
+			break;
+		case LOOPER_OVERDUB:
+			state = LOOPER_PLAY;
+			break;
+		default:
+			break;						// first pass ends by itself
+	}
+}
+
+
+// looper pedal held: remove last overdub layer, or clear the loop if it has none
+void looper_undo (void)
+{
+	uint32_t tick;
+	uint16_t index, next, previous;
+
+	if ((state != LOOPER_PLAY && state != LOOPER_OVERDUB) || layer == 0) {
+		looper_init ();
+		return;
+	}
+
+	// unlink events of last layer, and give them back to the free list
+	for (tick = 0; tick < length; tick++) {
+		previous = LOOPER_NONE;
+		for (index = heads [tick]; index != LOOPER_NONE; index = next) {
+			next = events [index].next;
+			if (events [index].layer != layer) {
+				previous = index;
+				continue;
+			}
+			if (previous == LOOPER_NONE) heads [tick] = next;
+			else events [previous].next = next;
+			if (tails [tick] == index) tails [tick] = previous;
+			events [index].next = free_list;
+			free_list = index;
+		}
+	}
+	cursor = LOOPER_NONE;
+	layer--;
+	state = LOOPER_PLAY;
+}
+
+
+// clock tick "tick" (from start of song) has been sent while playing, with "bar_ticks" ticks per bar and loops of "bars"
+// bars; starts recording on a bar boundary, closes the loop, and gets the events of the tick ready for looper_play ()
+void looper_tick (int32_t tick, uint32_t bar_ticks, uint32_t bars)
+{
+	int32_t offset, loops;
+	uint16_t index;
+
+	if (state == LOOPER_ARMED && tick >= 0 && (tick % bar_ticks) == 0) {
+		while (bars > 1 && bars * bar_ticks > LOOPER_MAX_TICKS) bars--;
+		start_tick = tick;
+		length = bars * bar_ticks;
+		state = LOOPER_RECORD;
+	}
+	if (state == LOOPER_EMPTY || state == LOOPER_ARMED) return;
+
+	// position in loop; the song may have been restarted before start of loop
+	offset = tick - start_tick;
+	loops = offset / (int32_t) length;
+	if (offset < loops * (int32_t) length) loops--;
+	pass = (uint16_t) loops;
+	if (state == LOOPER_RECORD && loops > 0) state = LOOPER_PLAY;
+	cursor = heads [offset - loops * (int32_t) length];
+
+	// events of this tick recorded in an earlier pass: their recording pass is over
+	for (index = cursor; index != LOOPER_NONE; index = events [index].next) {
+		if (events [index].pass != LOOPER_PLAYED && loops > (int32_t) events [index].pass) events [index].pass = LOOPER_PLAYED;
+	}
+}
+
+
+// write the events of last tick that are still to be sent into "buffer" of "size" bytes; returns number of bytes
+// written. Events that do not fit are sent on the next call
+uint32_t looper_play (uint8_t * buffer, uint32_t size)
+{
+	uint32_t n = 0, lg;
+	struct loop_event * e;
+
+	while (cursor != LOOPER_NONE) {
+		e = &events [cursor];
+		if (e->pass == LOOPER_PLAYED || e->pass != pass) {
+			lg = data_bytes (e->status);
+			if (n + 1 + lg > size) break;
+			buffer [n++] = e->status;
+			buffer [n++] = e->data [0];
+			if (lg == 2) buffer [n++] = e->data [1];
+			channels |= 1 << (e->status & 0x0F);
+		}
+		cursor = e->next;
+	}
+	return n;
+}
+
+
+// store channel message "message" at "position"; its pass and tick in loop follow from the tick it is rounded to
+static void record_event (uint32_t position)
+{
+	uint8_t type = message [0] & 0xF0, channel = message [0] & 0x0F, note = message [1];
+	bool note_on = (type == MIDI_NOTE_ON) && message [2] != 0;
+	bool note_off = (type == MIDI_NOTE_OFF) || (type == MIDI_NOTE_ON && message [2] == 0);
+	bool is_held = (held [channel][note >> 5] >> (note & 31)) & 1;
+	int32_t offset;
+	uint16_t index, event_pass;
+	uint32_t tick;
+
+	// note offs of recorded notes are recorded even after recording stops, so that no note is left on in the loop
+	if (state != LOOPER_RECORD && state != LOOPER_OVERDUB && !(note_off && is_held)) return;
+
+	offset = (int32_t) ((position + 128) >> 8) - start_tick;
+	if (offset < 0 || free_list == LOOPER_NONE) return;
+	event_pass = offset / length;
+	if (event_pass >= LOOPER_PLAYED) event_pass = LOOPER_PLAYED - 1;
+	tick = offset % length;
+
+	index = free_list;
+	free_list = events [index].next;
+	events [index].next = LOOPER_NONE;
+	events [index].pass = event_pass;
+	marked = true;
+	events [index].status = message [0];
+	events [index].data [0] = message [1];
+	events [index].data [1] = message [2];
+	events [index].layer = layer;
+	if (heads [tick] == LOOPER_NONE) heads [tick] = index;
+	else events [tails [tick]].next = index;
+	tails [tick] = index;
+
+	if (note_on) held [channel][note >> 5] |= 1u << (note & 31);
+	if (note_off) held [channel][note >> 5] &= ~(1u << (note & 31));
+}
+
+
+// midi bytes received from the groovebox at "position" (1/256 of clock tick from start of song); channel messages are
+// recorded to the nearest tick while recording or overdubbing. To be called from midi receive callback
+void looper_rx (const uint8_t * buffer, uint32_t lg, uint32_t position)
+{
+	uint32_t i;
+	uint8_t byte;
+
+	if (state == LOOPER_EMPTY || state == LOOPER_ARMED) return;
+
+	for (i = 0; i < lg; i++) {
+		byte = buffer [i];
+		if (byte >= 0xF8) continue;			// realtime, may appear anywhere
+		if (byte >= 0xF0) {
+			message_lg = 0;					// system message or SysEx: skipped up to next channel message
+			continue;
+		}
+		if (byte & 0x80) {
+			message [0] = byte;
+			message_lg = 1;
+			continue;
+		}
+		if (message_lg == 0) continue;		// data without status
+
+		// running status is kept, so that a following message can reuse it
+		message [message_lg++] = byte;
+		if (message_lg == 1 + data_bytes (message [0])) {
+			if (message_lg == 2) message [2] = 0;
+			record_event (position);
+			message_lg = 1;
+		}
+	}
+}
+
+
+// transport stopped, or loop cleared: write all notes off of the channels played by the loop into "buffer" of "size"
+// bytes; returns number of bytes written
+uint32_t looper_stop (uint8_t * buffer, uint32_t size)
+{
+	uint32_t n = 0, channel, tick;
+	uint16_t index;
+
+	// song restarts from its first pass: passes being recorded are over
+	cursor = LOOPER_NONE;
+	for (tick = 0; marked && tick < length; tick++) {
+		for (index = heads [tick]; index != LOOPER_NONE; index = events [index].next) events [index].pass = LOOPER_PLAYED;
+	}
+	marked = false;
+	for (channel = 0; channel < 16; channel++) {
+		if (channels & (1 << channel)) n += midi_control_change (buffer + n, size - n, channel, CC_ALL_NOTES_OFF, 0);
+	}
+	channels = 0;
+	return n;
+}
+
+
+// state of the looper
+uint8_t looper_state (void)
+{
+	return state;
+}
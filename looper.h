@@ -0,0 +1,55 @@
+/**
+ * @file looper.h
+ * @brief Bar-quantized midi looper: records midi received from the groovebox for some bars, then replays it in a loop
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _LOOPER_H_
+#define _LOOPER_H_
+
+#include "pico/stdlib.h"
+#include "arena.h"
+
+#define LOOPER_EVENTS		ARENA_LOOPER_EVENTS		// events stored, for all overdub layers
+#define LOOPER_MAX_TICKS	ARENA_LOOPER_TICKS		// longest loop, in clock ticks
+
+// looper states
+#define LOOPER_EMPTY		0			// no loop
+#define LOOPER_ARMED		1			// recording starts on next bar
+#define LOOPER_RECORD		2			// first pass is being recorded
+#define LOOPER_PLAY			3			// loop is playing
+#define LOOPER_OVERDUB		4			// loop is playing, and new events are added to it
+
+// clear the loop
+void looper_init (void);
+
+// looper pedal pressed: arm recording when empty, then overdub on / off once the loop plays
+void looper_press (void);
+
+// looper pedal held: remove last overdub layer, or clear the loop if it has none
+void looper_undo (void);
+
+// clock tick "tick" (from start of song) has been sent while playing, with "bar_ticks" ticks per bar and loops of "bars"
+// bars; starts recording on a bar boundary, closes the loop, and gets the events of the tick ready for looper_play ()
+void looper_tick (int32_t tick, uint32_t bar_ticks, uint32_t bars);
+
+// write the events of last tick that are still to be sent into "buffer" of "size" bytes; returns number of bytes
+// written. Events that do not fit are sent on the next call
+uint32_t looper_play (uint8_t * buffer, uint32_t size);
+
+// midi bytes received from the groovebox at "position" (1/256 of clock tick from start of song); channel messages are
+// recorded to the nearest tick while recording or overdubbing. To be called from midi receive callback
+void looper_rx (const uint8_t * buffer, uint32_t lg, uint32_t position);
+
+// transport stopped, or loop cleared: write all notes off of the channels played by the loop into "buffer" of "size"
+// bytes; returns number of bytes written
+uint32_t looper_stop (uint8_t * buffer, uint32_t size);
+
+// state of the looper
+uint8_t looper_state (void);
+
+#endif /* _LOOPER_H_ */
@@ -0,0 +1,220 @@
+/**
+ * @file midi.hpp
+ * @brief Typed midi messages: wire bytes and USB-MIDI event packets, built at compile time when values are known
+ *
+ * Channels and cables are template parameters, and data bytes can only be built through data7 (data14 for 14-bit
+ * values), which checks constant values at compile time, and gives no value at all for runtime ones out of range: a
+ * malformed message cannot be built, and the caller has to decide what to do with bad data. All builders are
+ * constexpr, so a message made of constants is a constant array in flash, and costs nothing at runtime.
+ *
+ *   constexpr auto session = midi::program_change<15, 3> ();		// CF 03
+ *   if (auto n = midi::data7::from (note))
+ *       index += midi::note_on<9> (*n, midi::data7::of<127> ()).write (buffer + index, size - index);
+ *   auto packet = midi::clock ().usb_packet<0> ();				// 0F F8 00 00
+ *
+ * Header only, C++17.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _MIDI_HPP_
+#define _MIDI_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace midi {
+
+// 7-bit data byte
+class data7 {
+public:
+	// constant value, checked at compile time
+	template <unsigned Value> static constexpr data7 of ()
+	{
+		static_assert (Value < 128, "midi data bytes are 0 to 127");
+		return data7 (Value);
+	}
+
+	// runtime value; none if it is out of range
+	static constexpr std::optional<data7> from (unsigned value)
+	{
+		return (value < 128) ? std::optional<data7> (data7 (value)) : std::nullopt;
+	}
+
+	constexpr uint8_t value () const { return v; }
+
+private:
+	constexpr explicit data7 (unsigned value) : v (static_cast<uint8_t> (value)) {}
+	uint8_t v;
+};
+
+
+// 14-bit value, sent as 2 data bytes, least significant first
+class data14 {
+public:
+	// constant value, checked at compile time
+	template <unsigned Value> static constexpr data14 of ()
+	{
+		static_assert (Value < 16384, "midi 14-bit values are 0 to 16383");
+		return data14 (Value);
+	}
+
+	// runtime value; none if it is out of range
+	static constexpr std::optional<data14> from (unsigned value)
+	{
+		return (value < 16384) ? std::optional<data14> (data14 (value)) : std::nullopt;
+	}
+
+	constexpr uint8_t lsb () const { return static_cast<uint8_t> (v & 0x7F); }
+	constexpr uint8_t msb () const { return static_cast<uint8_t> (v >> 7); }
+
+private:
+	constexpr explicit data14 (unsigned value) : v (static_cast<uint16_t> (value)) {}
+	uint16_t v;
+};
+
+
+namespace detail {
+struct builder;
+}
+
+
+// wire bytes of a message of N bytes; only built by the functions below
+template <std::size_t N> class message {
+public:
+	static_assert (N >= 1 && N <= 3, "midi messages other than SysEx are 1 to 3 bytes");
+
+	constexpr const std::array<uint8_t, N> & bytes () const { return data; }
+	static constexpr std::size_t size () { return N; }
+	constexpr uint8_t status () const { return data [0]; }
+
+	// USB-MIDI event packet on "Cable": cable and code index number, then the message padded with 0
+	template <unsigned Cable> constexpr std::array<uint8_t, 4> usb_packet () const
+	{
+		static_assert (Cable < 16, "USB-MIDI cables are 0 to 15");
+		std::array<uint8_t, 4> packet {};
+
+		packet [0] = static_cast<uint8_t> ((Cable << 4) | code_index ());
+		for (std::size_t i = 0; i < N; i++) packet [i + 1] = data [i];
+		return packet;
+	}
+
+	// copy message into "buffer" of "size" bytes; returns number of bytes written, 0 if it does not fit
+	uint32_t write (uint8_t * buffer, uint32_t size) const
+	{
+		if (size < N) return 0;
+		for (std::size_t i = 0; i < N; i++) buffer [i] = data [i];
+		return N;
+	}
+
+private:
+	friend struct detail::builder;
+	constexpr explicit message (const std::array<uint8_t, N> & bytes) : data (bytes) {}
+
+	// code index number: the high nibble of status for channel messages, the length for system messages
+	constexpr uint8_t code_index () const
+	{
+		if (data [0] < 0xF0) return data [0] >> 4;
+		if (data [0] >= 0xF8) return 0x0F;			// realtime: single byte
+		return (N == 1) ? 0x05 : ((N == 2) ? 0x02 : 0x03);
+	}
+
+	std::array<uint8_t, N> data;
+};
+
+
+namespace detail {
+
+struct builder {
+	template <std::size_t N> static constexpr message<N> make (const std::array<uint8_t, N> & bytes) { return message<N> (bytes); }
+};
+
+template <unsigned Channel> constexpr uint8_t status (uint8_t type)
+{
+	static_assert (Channel < 16, "midi channels are 0 to 15 (channel 1 to 16)");
+	return static_cast<uint8_t> (type | Channel);
+}
+
+} // namespace detail
+
+
+// channel messages, runtime data
+template <unsigned Channel> constexpr message<3> note_on (data7 note, data7 velocity)
+{
+	return detail::builder::make<3> ({ detail::status<Channel> (0x90), note.value (), velocity.value () });
+}
+
+template <unsigned Channel> constexpr message<3> note_off (data7 note, data7 velocity)
+{
+	return detail::builder::make<3> ({ detail::status<Channel> (0x80), note.value (), velocity.value () });
+}
+
+template <unsigned Channel> constexpr message<3> poly_pressure (data7 note, data7 pressure)
+{
+	return detail::builder::make<3> ({ detail::status<Channel> (0xA0), note.value (), pressure.value () });
+}
+
+template <unsigned Channel> constexpr message<3> control_change (data7 controller, data7 value)
+{
+	return detail::builder::make<3> ({ detail::status<Channel> (0xB0), controller.value (), value.value () });
+}
+
+template <unsigned Channel> constexpr message<2> program_change (data7 program)
+{
+	return detail::builder::make<2> ({ detail::status<Channel> (0xC0), program.value () });
+}
+
+template <unsigned Channel> constexpr message<2> channel_pressure (data7 pressure)
+{
+	return detail::builder::make<2> ({ detail::status<Channel> (0xD0), pressure.value () });
+}
+
+// 8192 is center
+template <unsigned Channel> constexpr message<3> pitch_bend (data14 value)
+{
+	return detail::builder::make<3> ({ detail::status<Channel> (0xE0), value.lsb (), value.msb () });
+}
+
+
+// channel messages, constant data checked at compile time
+template <unsigned Channel, unsigned Note, unsigned Velocity> constexpr message<3> note_on ()
+{
+	return note_on<Channel> (data7::of<Note> (), data7::of<Velocity> ());
+}
+
+template <unsigned Channel, unsigned Note, unsigned Velocity> constexpr message<3> note_off ()
+{
+	return note_off<Channel> (data7::of<Note> (), data7::of<Velocity> ());
+}
+
+template <unsigned Channel, unsigned Controller, unsigned Value> constexpr message<3> control_change ()
+{
+	return control_change<Channel> (data7::of<Controller> (), data7::of<Value> ());
+}
+
+template <unsigned Channel, unsigned Program> constexpr message<2> program_change ()
+{
+	return program_change<Channel> (data7::of<Program> ());
+}
+
+
+// system messages
+constexpr message<1> clock () { return detail::builder::make<1> ({ 0xF8 }); }
+constexpr message<1> start () { return detail::builder::make<1> ({ 0xFA }); }
+constexpr message<1> continue_ () { return detail::builder::make<1> ({ 0xFB }); }
+constexpr message<1> stop () { return detail::builder::make<1> ({ 0xFC }); }
+
+// song position, in midi beats (1/16 note) from start of song
+constexpr message<3> song_position (data14 beats)
+{
+	return detail::builder::make<3> ({ 0xF2, beats.lsb (), beats.msb () });
+}
+
+} // namespace midi
+
+#endif /* _MIDI_HPP_ */
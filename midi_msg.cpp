@@ -0,0 +1,124 @@
+/**
+ * @file midi_msg.cpp
+ * @brief Midi messages sent by the pedal, for C code: built with the typed messages of midi.hpp
+ *
+ * Channels are template parameters, so a wrong channel does not compile; constant messages are built at compile time.
+ * Values known at runtime go through data7::from (): out of range, nothing is written and 0 is returned.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include <utility>
+#include "midi.hpp"
+
+extern "C" {
+#include "midi_msg.h"
+}
+
+namespace {
+
+// std::array comparison is only constexpr from C++20
+template <std::size_t N> constexpr bool same (const std::array<uint8_t, N> & a, const std::array<uint8_t, N> & b)
+{
+	for (std::size_t i = 0; i < N; i++) {
+		if (a [i] != b [i]) return false;
+	}
+	return true;
+}
+
+// wire bytes and USB-MIDI packets, checked at compile time
+static_assert (same (midi::program_change<15, 3> ().bytes (), { 0xCF, 0x03 }), "program change");
+static_assert (same (midi::note_on<9, 37, 100> ().usb_packet<0> (), { 0x09, 0x99, 37, 100 }), "note on packet");
+static_assert (same (midi::clock ().usb_packet<1> (), { 0x1F, 0xF8, 0x00, 0x00 }), "realtime packet");
+static_assert (same (midi::pitch_bend<0> (midi::data14::of<8192> ()).bytes (), { 0xE0, 0x00, 0x40 }), "pitch bend");
+static_assert (!midi::data14::from (20000) && !midi::data7::from (128) && midi::data7::from (127), "runtime values out of range");
+
+constexpr auto clock = midi::clock ();
+constexpr auto start = midi::start ();
+constexpr auto continue_ = midi::continue_ ();
+constexpr auto stop = midi::stop ();
+
+// channel messages for a channel known at runtime: one instance per channel, picked from a table
+using writer = uint32_t (*) (uint8_t *, uint32_t, uint8_t, uint8_t);
+
+template <unsigned Channel> uint32_t write_note (uint8_t * buffer, uint32_t size, uint8_t note, uint8_t velocity)
+{
+	auto n = midi::data7::from (note), v = midi::data7::from (velocity);
+
+	return (n && v) ? midi::note_on<Channel> (*n, *v).write (buffer, size) : 0;
+}
+
+template <unsigned Channel> uint32_t write_control_change (uint8_t * buffer, uint32_t size, uint8_t controller, uint8_t value)
+{
+	auto c = midi::data7::from (controller), v = midi::data7::from (value);
+
+	return (c && v) ? midi::control_change<Channel> (*c, *v).write (buffer, size) : 0;
+}
+
+template <std::size_t... Channels> constexpr std::array<writer, sizeof... (Channels)> note_table (std::index_sequence<Channels...>)
+{
+	return { { write_note<Channels>... } };
+}
+
+template <std::size_t... Channels> constexpr std::array<writer, sizeof... (Channels)> control_change_table (std::index_sequence<Channels...>)
+{
+	return { { write_control_change<Channels>... } };
+}
+
+constexpr auto notes = note_table (std::make_index_sequence<16> ());
+constexpr auto control_changes = control_change_table (std::make_index_sequence<16> ());
+
+} // namespace
+
+
+uint32_t midi_clock (uint8_t * buffer, uint32_t size)
+{
+	return clock.write (buffer, size);
+}
+
+
+uint32_t midi_start (uint8_t * buffer, uint32_t size)
+{
+	return start.write (buffer, size);
+}
+
+
+uint32_t midi_continue (uint8_t * buffer, uint32_t size)
+{
+	return continue_.write (buffer, size);
+}
+
+
+uint32_t midi_stop (uint8_t * buffer, uint32_t size)
+{
+	return stop.write (buffer, size);
+}
+
+
+uint32_t midi_session (uint8_t * buffer, uint32_t size, uint8_t session)
+{
+	auto program = midi::data7::from (session);
+
+	return program ? midi::program_change<MIDI_GROOVEBOX_CHANNEL> (*program).write (buffer, size) : 0;
+}
+
+
+uint32_t midi_click (uint8_t * buffer, uint32_t size, uint8_t note, uint8_t velocity)
+{
+	return write_note<MIDI_CLICK_CHANNEL> (buffer, size, note, velocity);
+}
+
+
+uint32_t midi_note (uint8_t * buffer, uint32_t size, uint8_t channel, uint8_t note, uint8_t velocity)
+{
+	return (channel < 16) ? notes [channel] (buffer, size, note, velocity) : 0;
+}
+
+
+uint32_t midi_control_change (uint8_t * buffer, uint32_t size, uint8_t channel, uint8_t controller, uint8_t value)
+{
+	return (channel < 16) ? control_changes [channel] (buffer, size, controller, value) : 0;
+}
@@ -0,0 +1,41 @@
+/**
+ * @file midi_msg.h
+ * @brief Midi messages sent by the pedal, for C code: built with the typed messages of midi.hpp
+ *
+ * Each function writes its message into "buffer" of "size" bytes, and returns the number of bytes written: 0 if the
+ * message does not fit, so that a full buffer is never overrun, or if a value is out of range, so that a malformed
+ * message is never sent.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _MIDI_MSG_H_
+#define _MIDI_MSG_H_
+
+#include <stdint.h>
+
+#define MIDI_GROOVEBOX_CHANNEL	15		// midi channel (0 to 15) of session changes; 15 is channel 16
+#define MIDI_CLICK_CHANNEL		9		// midi channel (0 to 15) of click notes; 9 is channel 10 (drums)
+
+// transport and clock
+uint32_t midi_clock (uint8_t * buffer, uint32_t size);
+uint32_t midi_start (uint8_t * buffer, uint32_t size);
+uint32_t midi_continue (uint8_t * buffer, uint32_t size);
+uint32_t midi_stop (uint8_t * buffer, uint32_t size);
+
+// session change of the groovebox: program change on MIDI_GROOVEBOX_CHANNEL; session 0 to 127
+uint32_t midi_session (uint8_t * buffer, uint32_t size, uint8_t session);
+
+// click note on MIDI_CLICK_CHANNEL; note and velocity 0 to 127, velocity 0 is note off
+uint32_t midi_click (uint8_t * buffer, uint32_t size, uint8_t note, uint8_t velocity);
+
+// note on "channel" (0 to 15); note and velocity 0 to 127, velocity 0 is note off
+uint32_t midi_note (uint8_t * buffer, uint32_t size, uint8_t channel, uint8_t note, uint8_t velocity);
+
+// control change on "channel" (0 to 15); controller and value 0 to 127
+uint32_t midi_control_change (uint8_t * buffer, uint32_t size, uint8_t channel, uint8_t controller, uint8_t value);
+
+#endif /* _MIDI_MSG_H_ */
@@ -0,0 +1,181 @@
+/**
+ * @file mod.c
+ * @brief Tempo-synced modulation: CC streams (sine, triangle, ramp, step sequence) locked to the song position of the clock
+ *
+ * The phase of each lane comes from the clock tick, not from the time the pedal was pressed: sweeps stay locked to the
+ * groove, and restarting them lands on the same place of the bar. Shapes are read from an integer wavetable in 1/65536
+ * of period; there is no floating point. A value is only sent when it changed and the rate limit of its lane allows it,
+ * and at most MOD_MAX_PER_TICK values go out per tick, taken from lanes in turn, so that slow lanes are not starved by
+ * fast ones. A value that could not be sent is sent on a later tick.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include <stddef.h>
+#include "midi_msg.h"
+#include "mod.h"
+
+#define CLOCK_PPQN		24
+#define NO_VALUE		255
+
+// states
+#define STATE_IDLE		0
+#define STATE_RUN		1
+#define STATE_REST		2			// going back to rest values
+
+// state of a lane
+struct lane_state {
+	uint8_t sent;					// last value sent; NO_VALUE if none
+	int32_t sent_tick;				// tick of last value sent
+};
+
+// one period of a sine starting on its lowest point, 0 to 255
+static const uint8_t sine [256] = {
+	  0,   0,   0,   0,   1,   1,   1,   2,   2,   3,   4,   5,   5,   6,   7,   9,
+	 10,  11,  12,  14,  15,  17,  18,  20,  21,  23,  25,  27,  29,  31,  33,  35,
+	 37,  40,  42,  44,  47,  49,  52,  54,  57,  59,  62,  65,  67,  70,  73,  76,
+	 79,  82,  85,  88,  90,  93,  97, 100, 103, 106, 109, 112, 115, 118, 121, 124,
+	128, 131, 134, 137, 140, 143, 146, 149, 152, 155, 158, 162, 165, 167, 170, 173,
+	176, 179, 182, 185, 188, 190, 193, 196, 198, 201, 203, 206, 208, 211, 213, 215,
+	218, 220, 222, 224, 226, 228, 230, 232, 234, 235, 237, 238, 240, 241, 243, 244,
+	245, 246, 248, 249, 250, 250, 251, 252, 253, 253, 254, 254, 254, 255, 255, 255,
+	255, 255, 255, 255, 254, 254, 254, 253, 253, 252, 251, 250, 250, 249, 248, 246,
+	245, 244, 243, 241, 240, 238, 237, 235, 234, 232, 230, 228, 226, 224, 222, 220,
+	218, 215, 213, 211, 208, 206, 203, 201, 198, 196, 193, 190, 188, 185, 182, 179,
+	176, 173, 170, 167, 165, 162, 158, 155, 152, 149, 146, 143, 140, 137, 134, 131,
+	128, 124, 121, 118, 115, 112, 109, 106, 103, 100,  97,  93,  90,  88,  85,  82,
+	 79,  76,  73,  70,  67,  65,  62,  59,  57,  54,  52,  49,  47,  44,  42,  40,
+	 37,  35,  33,  31,  29,  27,  25,  23,  21,  20,  18,  17,  15,  14,  12,  11,
+	 10,   9,   7,   6,   5,   5,   4,   3,   2,   2,   1,   1,   1,   0,   0,   0,
+};
+
+// globals
+static const struct mod_lane * lanes = NULL;
+static uint32_t nb_lanes = 0;
+static struct lane_state states [MOD_LANES];
+static int state = STATE_IDLE;
+static uint32_t next_lane = 0;				// first lane served on next tick
+
+
+// value of "lane" at "phase" (1/65536 of period)
+static uint8_t lane_value (const struct mod_lane * lane, uint32_t phase)
+{
+	uint32_t wave;			// 0 to 255
+
+	switch (lane->shape) {
+		case MOD_SHAPE_STEPS:
+			return lane->steps [(phase * lane->nb_steps) >> 16];
+		case MOD_SHAPE_TRIANGLE:
+			wave = (phase < 32768) ? phase >> 7 : (65535 - phase) >> 7;
+			break;
+		case MOD_SHAPE_RAMP:
+			wave = phase >> 8;
+			break;
+		default:
+			wave = sine [phase >> 8];
+			break;
+	}
+	return lane->low + (((int32_t) lane->high - lane->low) * (int32_t) wave) / 255;
+}
+
+
+// use "count" lanes of "lanes" (at most MOD_LANES); lanes are read in place, and must stay in memory
+void mod_init (const struct mod_lane * l, uint32_t count)
+{
+	uint32_t i, j;
+
+	// lanes are used in place: the table is cut at the first lane that would send out of range values
+	lanes = l;
+	for (i = 0; i < count && i < MOD_LANES; i++) {
+		if (l [i].channel > 15 || l [i].cc > 127 || l [i].beats == 0 || l [i].low > 127 || l [i].high > 127) break;
+		if (l [i].rest > 127 && l [i].rest != MOD_NO_REST) break;
+		if (l [i].shape == MOD_SHAPE_STEPS && (l [i].nb_steps == 0 || l [i].nb_steps > MOD_MAX_STEPS)) break;
+		if (l [i].shape == MOD_SHAPE_STEPS) {
+			for (j = 0; j < l [i].nb_steps && l [i].steps [j] <= 127; j++);
+			if (j < l [i].nb_steps) break;
+		}
+	}
+	nb_lanes = i;
+	next_lane = 0;
+	state = STATE_IDLE;
+}
+
+
+// start modulation from next clock tick; returns false if it is already running
+bool mod_start (void)
+{
+	uint32_t i;
+
+	if (state == STATE_RUN || nb_lanes == 0) return false;
+	for (i = 0; i < nb_lanes; i++) states [i].sent = NO_VALUE;
+	state = STATE_RUN;
+	return true;
+}
+
+
+// stop modulation: lanes go to their rest value on next clock ticks
+void mod_stop (void)
+{
+	if (state == STATE_RUN) state = STATE_REST;
+}
+
+
+// returns true if modulation is running
+bool mod_running (void)
+{
+	return state == STATE_RUN;
+}
+
+
+// clock tick "tick" (from start of song, 24 per beat) has been sent: write the lane values that changed, within rate
+// limits, into "buffer" of "size" bytes; returns number of bytes written
+uint32_t mod_tick (int32_t tick, uint8_t * buffer, uint32_t size)
+{
+	const struct mod_lane * lane;
+	struct lane_state * s;
+	uint32_t i, n, index = 0, sent = 0, lg, pending = 0, first = next_lane;
+	int32_t period, position;
+	uint8_t value;
+
+	if (state == STATE_IDLE) return 0;
+
+	for (n = 0; n < nb_lanes; n++) {
+		i = (first + n) % nb_lanes;
+		lane = &lanes [i];
+		s = &states [i];
+
+		if (state == STATE_REST) {
+			if (lane->rest == MOD_NO_REST || s->sent == lane->rest || s->sent == NO_VALUE) continue;
+			value = lane->rest;
+		}
+		else {
+			// phase from song position; count-in ticks are negative
+			period = (int32_t) lane->beats * CLOCK_PPQN;
+			position = ((tick % period) + period) % period;
+			value = lane_value (lane, ((uint32_t) position << 16) / (uint32_t) period);
+			if (value == s->sent) continue;
+			// rate limit, unless song has restarted (tick went back, to the pre-roll or count-in)
+			if (s->sent != NO_VALUE && tick >= s->sent_tick && tick - s->sent_tick < lane->min_ticks) continue;
+		}
+
+		// budget of this tick is used: lane is served first on next tick
+		if (sent == MOD_MAX_PER_TICK || (lg = midi_control_change (buffer + index, size - index, lane->channel, lane->cc, value)) == 0) {
+			pending++;
+			if (pending == 1) next_lane = i;
+			continue;
+		}
+		index += lg;
+		sent++;
+		s->sent = value;
+		s->sent_tick = tick;
+	}
+
+	if (pending == 0) {
+		next_lane = (first + 1) % nb_lanes;
+		if (state == STATE_REST) state = STATE_IDLE;
+	}
+	return index;
+}
@@ -0,0 +1,58 @@
+/**
+ * @file mod.h
+ * @brief Tempo-synced modulation: CC streams (sine, triangle, ramp, step sequence) locked to the song position of the clock
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _MOD_H_
+#define _MOD_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MOD_LANES			8		// lanes run at once
+#define MOD_MAX_STEPS		16		// steps of a step sequence
+#define MOD_MAX_PER_TICK	2		// CC messages sent per clock tick, all lanes together, so that the clock is never crowded out
+#define MOD_NO_REST			255		// lane leaves its last value when modulation stops
+
+// shapes
+#define MOD_SHAPE_SINE		0		// starts and ends on "low"
+#define MOD_SHAPE_TRIANGLE	1		// from "low" to "high" and back
+#define MOD_SHAPE_RAMP		2		// from "low" to "high", then jumps back
+#define MOD_SHAPE_STEPS		3		// "steps" values, each for an equal part of the period; "low" and "high" are not used
+
+// CC stream to one destination
+struct mod_lane {
+	uint8_t channel;				// midi channel (0 to 15)
+	uint8_t cc;						// controller (0 to 127)
+	uint8_t shape;					// MOD_SHAPE_...
+	uint8_t beats;					// period (beats, 1 or more); phase 0 is on tick 0 of song, so periods dividing a bar are bar-aligned
+	uint8_t low;					// range of values (0 to 127); "high" under "low" inverts the shape
+	uint8_t high;
+	uint8_t rest;					// value sent when modulation stops; MOD_NO_REST to leave the last value
+	uint8_t min_ticks;				// rate limit: clock ticks between 2 values sent on this lane (1 for every tick)
+	uint8_t nb_steps;				// step sequence: number of steps (1 to MOD_MAX_STEPS), and their values
+	uint8_t steps [MOD_MAX_STEPS];
+};
+
+// use "count" lanes of "lanes" (at most MOD_LANES); lanes are read in place, and must stay in memory
+void mod_init (const struct mod_lane * lanes, uint32_t count);
+
+// start modulation from next clock tick; returns false if it is already running
+bool mod_start (void);
+
+// stop modulation: lanes go to their rest value on next clock ticks
+void mod_stop (void);
+
+// returns true if modulation is running
+bool mod_running (void);
+
+// clock tick "tick" (from start of song, 24 per beat) has been sent: write the lane values that changed, within rate
+// limits, into "buffer" of "size" bytes; returns number of bytes written
+uint32_t mod_tick (int32_t tick, uint8_t * buffer, uint32_t size);
+
+#endif /* _MOD_H_ */
@@ -0,0 +1,172 @@
+/**
+ * @file mtc.c
+ * @brief MIDI Time Code generation (quarter-frame and full-frame messages)
+ *
+ * Time code is derived from the same microsecond time base as midi clock (time since boot):
+ * quarter frame n is due at start_time + n * 1000000 / (4 * fps), so there is no accumulated drift.
+ * Messages are only written into the buffer handed over by the caller (the realtime lane);
+ * functions called from the usb callbacks just change state.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include "mtc.h"
+
+#define MTC_MAX_LATE_QF		8		// if we are more than 2 frames late, resync with a full frame instead of bursting quarter frames
+
+// globals
+static uint8_t mtc_fps = 0;					// frames per second; 0 if time code is disabled
+static uint8_t mtc_rate = MTC_RATE_25;		// rate code sent with time code
+static bool mtc_running = false;
+static bool full_frame_pending = false;		// a full frame shall be sent at next call to mtc_task()
+static uint64_t start_time = 0;				// time (usec since boot) of quarter frame "base_qf"
+static uint32_t base_qf = 0;				// quarter frame index at start_time
+static uint32_t next_qf = 0;				// index of next quarter frame to send (position * 4)
+
+
+// time (usec since boot) when quarter frame "qf" is due
+static uint64_t qf_time (uint32_t qf)
+{
+	return start_time + ((uint64_t) (qf - base_qf) * 1000000) / (4 * mtc_fps);
+}
+
+
+// convert a frame count to hours, minutes, seconds and frames
+static void frame_to_time (uint32_t frame, uint8_t * hh, uint8_t * mm, uint8_t * ss, uint8_t * ff)
+{
+	*ff = frame % mtc_fps;
+	frame /= mtc_fps;
+	*ss = frame % 60;
+	frame /= 60;
+	*mm = frame % 60;
+	frame /= 60;
+	*hh = frame % 24;
+}
+
+
+// set frame rate (24, 25 or 30 fps) and reset position to 00:00:00:00; 0 disables time code
+void mtc_init (uint8_t fps)
+{
+	switch (fps) {
+		case 24:
+			mtc_rate = MTC_RATE_24;
+			break;
+		case 25:
+			mtc_rate = MTC_RATE_25;
+			break;
+		case 30:
+			mtc_rate = MTC_RATE_30;
+			break;
+		default:
+			fps = 0;		// unsupported rate: disable time code
+			break;
+	}
+	mtc_fps = fps;
+	mtc_running = false;
+	full_frame_pending = false;
+	base_qf = next_qf = 0;
+}
+
+
+// start running time code at "frame", from time "now" (usec since boot); a full frame is sent first
+void mtc_start (uint64_t now, uint32_t frame)
+{
+	if (mtc_fps == 0) return;
+
+	start_time = now;
+	base_qf = next_qf = frame * 4;
+	mtc_running = true;
+	full_frame_pending = true;
+}
+
+
+// resume running time code from the current position, from time "now"; a full frame is sent first
+void mtc_continue (uint64_t now)
+{
+	mtc_start (now, mtc_position (now));
+}
+
+
+// stop running time code; position is kept so that a subsequent start can resume from it
+void mtc_stop (void)
+{
+	if (mtc_running) next_qf = (next_qf / 4) * 4;		// keep position on a frame boundary
+	mtc_running = false;
+}
+
+
+// move position to "frame" and send a full frame; if time code is running, it carries on from there
+void mtc_locate (uint64_t now, uint32_t frame)
+{
+	if (mtc_fps == 0) return;
+
+	start_time = now;
+	base_qf = next_qf = frame * 4;
+	full_frame_pending = true;
+}
+
+
+// current position in frames
+uint32_t mtc_position (uint64_t now)
+{
+	if (mtc_fps == 0) return 0;
+	if (!mtc_running || now < start_time) return next_qf / 4;
+	return (base_qf / 4) + (uint32_t) (((now - start_time) * mtc_fps) / 1000000);
+}
+
+
+// write time code messages that are due at "now" into buffer; returns the number of bytes written
+int mtc_task (uint64_t now, uint8_t * buffer, int size)
+{
+	int index = 0;
+	uint8_t hh, mm, ss, ff;
+	uint8_t piece, nibble;
+
+	if (mtc_fps == 0) return 0;
+
+	// if we got late (eg. blocking USB transfer), resync receivers with a full frame rather than bursting quarter frames
+	if (mtc_running && !full_frame_pending && now >= qf_time (next_qf + MTC_MAX_LATE_QF)) {
+		mtc_locate (now, mtc_position (now));
+	}
+
+	// full frame: F0 7F 7F 01 01 hh mm ss ff F7 (device ID 7F = all devices)
+	if (full_frame_pending) {
+		if (size < MTC_FULL_FRAME_SIZE) return 0;
+		frame_to_time (next_qf / 4, &hh, &mm, &ss, &ff);
+		buffer [index++] = MIDI_SYSEX;
+		buffer [index++] = 0x7F;
+		buffer [index++] = 0x7F;
+		buffer [index++] = 0x01;
+		buffer [index++] = 0x01;
+		buffer [index++] = (mtc_rate << 5) | hh;
+		buffer [index++] = mm;
+		buffer [index++] = ss;
+		buffer [index++] = ff;
+		buffer [index++] = MIDI_SYSEX_END;
+		full_frame_pending = false;
+	}
+
+	// quarter frames: 8 pieces carry the time code of the frame where piece 0 was sent
+	while (mtc_running && (index + 2 <= size) && (now >= qf_time (next_qf))) {
+		piece = next_qf % 8;
+		frame_to_time ((next_qf - piece) / 4, &hh, &mm, &ss, &ff);
+		switch (piece) {
+			case 0: nibble = ff & 0x0F; break;
+			case 1: nibble = ff >> 4; break;
+			case 2: nibble = ss & 0x0F; break;
+			case 3: nibble = ss >> 4; break;
+			case 4: nibble = mm & 0x0F; break;
+			case 5: nibble = mm >> 4; break;
+			case 6: nibble = hh & 0x0F; break;
+			default: nibble = (mtc_rate << 1) | (hh >> 4); break;
+		}
+		buffer [index++] = MIDI_MTC_QUARTER_FRAME;
+		buffer [index++] = (piece << 4) | nibble;
+		next_qf++;
+	}
+
+	return index;
+}
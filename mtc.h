@@ -0,0 +1,52 @@
+/**
+ * @file mtc.h
+ * @brief MIDI Time Code generation (quarter-frame and full-frame messages)
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _MTC_H_
+#define _MTC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// midi time code messages
+#define MIDI_MTC_QUARTER_FRAME	0xF1
+#define MIDI_SYSEX				0xF0
+#define MIDI_SYSEX_END			0xF7
+
+// MTC rate codes, as carried in the hours byte of time code
+#define MTC_RATE_24			0
+#define MTC_RATE_25			1
+#define MTC_RATE_30DF		2		// not generated, listed for completeness
+#define MTC_RATE_30			3
+
+// size of a full-frame sysex message; largest message mtc_task() may write in one call
+#define MTC_FULL_FRAME_SIZE	10
+
+// set frame rate (24, 25 or 30 fps) and reset position to 00:00:00:00; 0 disables time code
+void mtc_init (uint8_t fps);
+
+// start running time code at "frame", from time "now" (usec since boot); a full frame is sent first
+void mtc_start (uint64_t now, uint32_t frame);
+
+// resume running time code from the current position, from time "now"; a full frame is sent first
+void mtc_continue (uint64_t now);
+
+// stop running time code; position is kept so that a subsequent start can resume from it
+void mtc_stop (void);
+
+// move position to "frame" and send a full frame; if time code is running, it carries on from there
+void mtc_locate (uint64_t now, uint32_t frame);
+
+// current position in frames
+uint32_t mtc_position (uint64_t now);
+
+// write time code messages that are due at "now" into buffer; returns the number of bytes written
+int mtc_task (uint64_t now, uint8_t * buffer, int size);
+
+#endif /* _MTC_H_ */
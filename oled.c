@@ -0,0 +1,120 @@
+/**
+ * @file oled.c
+ * @brief SSD1306 128x64 OLED status screen on I2C, fed by DMA in the background
+ *
+ * Rendering is done by display.c into a framebuffer. Each dirty region (a run of columns in one page) becomes one
+ * DMA transfer of 16-bit words to the I2C data command register: a command transaction setting the column and page
+ * window, then a data transaction with the region bytes, each ended by the STOP bit of its last word. The DMA is paced
+ * by the I2C TX FIFO, so the CPU only builds the transfer and starts it; a full page takes about 3.5 ms at 400 kHz.
+ * Only the initialization sequence is sent with a blocking write, once at startup.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include "hardware/i2c.h"
+#include "hardware/dma.h"
+#include "oled.h"
+
+#define OLED_I2C		i2c0
+#define OLED_DREQ		DREQ_I2C0_TX
+#define OLED_BAUDRATE	400000
+#define OLED_ADDRESS	0x3C		// SSD1306 I2C address (0x3D on some modules)
+#define OLED_TIMEOUT	20000		// initialization timeout, if no screen answers (usec)
+#define OLED_COMMAND	0x00		// control byte: commands follow
+#define OLED_DATA		0x40		// control byte: display data follows
+#define OLED_STOP		(1 << 9)	// data command register: issue STOP after this byte
+
+// SSD1306 initialization: 128x64, horizontal addressing, charge pump on
+static const uint8_t oled_setup [] = {
+	OLED_COMMAND,
+	0xAE,			// display off
+	0xD5, 0x80,		// clock divide ratio
+	0xA8, 0x3F,		// multiplex ratio: 64 rows
+	0xD3, 0x00,		// display offset
+	0x40,			// start line 0
+	0x8D, 0x14,		// charge pump on
+	0x20, 0x00,		// horizontal addressing mode
+	0xA1,			// segment remap
+	0xC8,			// COM scan direction remapped
+	0xDA, 0x12,		// COM pins configuration
+	0x81, 0xCF,		// contrast
+	0xD9, 0xF1,		// precharge period
+	0xDB, 0x40,		// VCOMH deselect level
+	0xA4,			// display follows RAM
+	0xA6,			// normal (not inverted) display
+	0xAF			// display on
+};
+
+// globals
+static bool oled_enabled = false;
+static int oled_dma = -1;
+static uint16_t transfer [8 + DISPLAY_WIDTH];		// words for I2C data command register, read by DMA
+
+
+// set "sda_gpio" and "scl_gpio" as I2C0 pins of the screen (0/1, 4/5, 8/9, 12/13, 16/17 or 20/21), and initialize it;
+// does nothing if a gpio is NO_OLED_GPIO, or if no screen answers
+void oled_init (uint sda_gpio, uint scl_gpio)
+{
+	dma_channel_config config;
+
+	if (sda_gpio == NO_OLED_GPIO || scl_gpio == NO_OLED_GPIO) return;
+
+	i2c_init (OLED_I2C, OLED_BAUDRATE);
+	gpio_set_function (sda_gpio, GPIO_FUNC_I2C);
+	gpio_set_function (scl_gpio, GPIO_FUNC_I2C);
+	gpio_pull_up (sda_gpio);
+	gpio_pull_up (scl_gpio);
+
+	// also sets target address for the DMA transfers
+	if (i2c_write_timeout_us (OLED_I2C, OLED_ADDRESS, oled_setup, sizeof (oled_setup), false, OLED_TIMEOUT) != sizeof (oled_setup)) return;
+
+	// DMA pushes a transfer to the I2C TX FIFO, one byte (with its command bits) per 16-bit word
+	oled_dma = dma_claim_unused_channel (true);
+	config = dma_channel_get_default_config (oled_dma);
+	channel_config_set_transfer_data_size (&config, DMA_SIZE_16);
+	channel_config_set_read_increment (&config, true);
+	channel_config_set_write_increment (&config, false);
+	channel_config_set_dreq (&config, OLED_DREQ);
+	dma_channel_configure (oled_dma, &config, &i2c_get_hw (OLED_I2C)->data_cmd, transfer, 0, false);
+
+	// first frames clear the screen
+	display_init ();
+	oled_enabled = true;
+}
+
+
+// render status into framebuffer, and send the next dirty region by DMA if the previous one is gone; never waits
+void oled_task (const struct display_status * status)
+{
+	const uint8_t * data;
+	uint8_t page, column;
+	uint32_t lg, i, n = 0;
+
+	if (!oled_enabled || dma_channel_is_busy (oled_dma)) return;
+
+	display_render (status);
+	lg = display_next_dirty (&page, &column, &data);
+	if (lg == 0) return;
+
+	// a screen that stopped answering aborts the transfer and holds the FIFO flushed: release it, next regions will retry
+	(void) i2c_get_hw (OLED_I2C)->clr_tx_abrt;
+
+	// window of the region
+	transfer [n++] = OLED_COMMAND;
+	transfer [n++] = 0x21;				// column range
+	transfer [n++] = column;
+	transfer [n++] = column + lg - 1;
+	transfer [n++] = 0x22;				// page range
+	transfer [n++] = page;
+	transfer [n++] = page | OLED_STOP;
+
+	// region data
+	transfer [n++] = OLED_DATA;
+	for (i = 0; i < lg; i++) transfer [n++] = data [i];
+	transfer [n - 1] |= OLED_STOP;
+
+	dma_channel_transfer_from_buffer_now (oled_dma, transfer, n);
+}
@@ -0,0 +1,26 @@
+/**
+ * @file oled.h
+ * @brief SSD1306 128x64 OLED status screen on I2C, fed by DMA in the background
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _OLED_H_
+#define _OLED_H_
+
+#include "pico/stdlib.h"
+#include "display.h"
+
+#define NO_OLED_GPIO	255		// no OLED screen
+
+// set "sda_gpio" and "scl_gpio" as I2C0 pins of the screen (0/1, 4/5, 8/9, 12/13, 16/17 or 20/21), and initialize it;
+// does nothing if a gpio is NO_OLED_GPIO, or if no screen answers
+void oled_init (uint sda_gpio, uint scl_gpio);
+
+// render status into framebuffer, and send the next dirty region by DMA if the previous one is gone; never waits
+void oled_task (const struct display_status * status);
+
+#endif /* _OLED_H_ */
@@ -27,48 +27,130 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include "pico/stdlib.h"
 #include "pico/binary_info.h"
+#include "hardware/regs/addressmap.h"
 #include "bsp/board_api.h"
 #include "tusb.h"
 #include "usb_midi_host.h"
+#include "mtc.h"
+#include "click.h"
+#include "led.h"
+#include "ring.h"
+#include "audio.h"
+#include "drums.h"
+#include "sync_out.h"
+#include "reclock.h"
+#include "ratio.h"
+#include "oled.h"
+#include "config.h"
+#include "stick.h"
+#include "backup.h"
+#include "restore.h"
+#include "smf.h"
+#include "record.h"
+#include "looper.h"
+#include "tempo.h"
+#include "midi_msg.h"
+#include "arena.h"
+#include "transport.h"
+#include "mod.h"
+#include "bass.h"
+#include "footswitch.h"
 
 // constants
 #define MIDI_CLOCK		0xF8
 #define MIDI_PLAY		0xFA
 #define MIDI_STOP		0xFC
 #define MIDI_CONTINUE	0xFB
-#define MIDI_PRG_CHANGE	0xCF	// 0xC0 is program change, 0x0F is midi channel
+#define MIDI_PRG_CHANGE	(0xC0 | MIDI_GROOVEBOX_CHANNEL)	// session change from the groovebox
 
 #define LED_GPIO	25	// onboard led
 #define LED2_GPIO	255	// 2nd led
 const uint NO_LED_GPIO = 255;
 const uint NO_LED2_GPIO = 255;
+#define LED_TEMPO	TRUE	// TRUE: leds flash on beats and bars of the midi clock being sent; FALSE: leds are lit while a switch is pressed
+
+#define CLICK_GPIO	16	// metronome click output (PWM buzzer or headphone pin); NO_CLICK_GPIO if none
+#define RING_GPIO	17	// WS2812 status led ring data output; NO_RING_GPIO if none
+#define AUDIO_GPIO	NO_AUDIO_GPIO	// audio input (26 to 28) for beat tracker, that drives the clock in follow mode; NO_AUDIO_GPIO if none
+#define DIN_GPIO	4		// DIN MIDI out (UART1 TX); NO_SYNC_GPIO if none
+#define PULSE_GPIO	18		// analog sync pulse out; NO_SYNC_GPIO if none
+#define BASS_PROBE_GPIO	BASS_NO_PROBE	// toggled when bass pedal notes are flushed to USB, to measure their latency on a scope; BASS_NO_PROBE if none
+#define OLED_SDA_GPIO	20		// OLED status screen (SSD1306, I2C0) data; NO_OLED_GPIO if none
+#define OLED_SCL_GPIO	21		// OLED status screen (SSD1306, I2C0) clock; NO_OLED_GPIO if none
+#define USB_RATIO_NUM	1		// clock ratio of each output: NUM output ticks for DEN ticks of the pedal clock (1 to 16 each)
+#define USB_RATIO_DEN	1		// eg. 1:2 halves the clock, 3:2 plays 3 beats against 2 for polymetric setups
+#define DIN_RATIO_NUM	1
+#define DIN_RATIO_DEN	1
+#define PULSE_RATIO_NUM	1
+#define PULSE_RATIO_DEN	1
+#define RECLOCK		TRUE	// when pedal clock is not running, the clock received from the groovebox is re-clocked to DIN and analog outputs
+#define DRUM_FOLLOW		TRUE	// a 2nd USB MIDI device (e-drum module, trigger interface) drives the clock in follow mode with its kick and snare notes
+#define DRUM_CHANNEL	9		// midi channel (0 to 15) of drum trigger notes; 9 is channel 10
+#define RESTORE_RATE	0		// SysEx restore pacing: bytes per second (0 for as fast as USB takes them)
+#define RESTORE_GAP		20000	// SysEx restore pacing: silence after each SysEx message, so that receiver can store it (usec)
+#define RECORD			TRUE	// midi received from the groovebox is recorded to the USB stick (REC folder) while the pedal clock plays a song
+#define SMF_PATH		"0:/SMF/S%02u.MID"	// midi file played along with each session (S01.MID for first session), if on the USB stick
 
 #define SWITCH_1	11
 #define SWITCH_2	12
 #define SWITCH_3	13
 #define SWITCH_4	14
 #define SWITCH_5	15
+#define SWITCH_6	10
+#define SWITCH_7	9
 
 #define SWITCH_PREV		11		// previous session
 #define SWITCH_NEXT		15		// next session
 #define SWITCH_PLAY		14		// play
 #define SWITCH_CONTINUE	12		// pause
 #define SWITCH_TEMPO	13		// tap tempo
+#define SWITCH_HALF		10		// half-time on / off
+#define SWITCH_DOUBLE	9		// double-time on / off
+#define SWITCH_LOOPER	8		// looper: record, then overdub on / off; held: remove last overdub, or clear loop; held 5 s while stopped: backup
+#define SWITCH_MOD		7		// modulation lanes (CC sweeps) on / off; held: bass pedal mode on / off; held 5 s while stopped: restore
 #define PREV			1
 #define NEXT			2
 #define PLAY			4
 #define CONTINUE		8
 #define TEMPO			16
+#define HALF			32
+#define DOUBLE			64
+#define LOOPER			128
+#define MOD				256
 
 #define FALSE			0
 #define TRUE 			1
 
 #define EXIT_FUNCTION	2000000	// 2000000 usec = 2 sec
+#define STICK_FUNCTION	5000000	// 5 sec: pedal held this long while transport is stopped acts on the USB stick
 #define NB_TICKS		24		// 24 ticks per beat (quarter note)
 #define	BPM40_TICKS		62500	// 40BPM = 1 beat every 1.5 seconds = 1500000 usec / NB_TICKS = 62500 us between ticks
 #define	BPM240_TICKS	10417	// 240BPM = 1 beat every .250 seconds = 250000 usec / NB_TICKS = 10417 us between ticks
+#define SESSIONS		32		// number of sessions of the groovebox
+#define MTC_FPS			25		// MIDI time code frame rate: 24, 25 or 30 fps; 0 to disable time code
+#define BEATS_PER_BAR	4		// beats per bar, for count-in and click accent
+#define COUNT_IN_BARS	1		// bars of click between press of PLAY and MIDI_PLAY; 0 for no count-in
+#define LOOPER_BARS		2		// length of loops recorded by the looper (1 to 16 bars); recording starts on next bar
+#define BASS_CHANNEL	0		// midi channel (0 to 15) of notes played in bass pedal mode; 0 is synth 1 of the Circuit
+#define BASS_VELOCITY	100		// velocity of notes played in bass pedal mode
+#define BASS_OPTIONS	0		// bass pedal mode: BASS_HOLD, BASS_LEGATO, or 0 for notes that stop when the pedal is released
+#define CLICK_METRONOME	FALSE	// keep clicking after count-in, while playing
+#define CLICK_NOTE		0		// midi note sent with each click (eg. 37 for side stick); 0 for no midi click
+#define CLICK_NOTE_ACCENT	0	// midi note sent with first click of bar; 0 for no midi click
+#define TAP_DOWNBEAT	TRUE	// last tap of a tap tempo sequence is the downbeat: clock bar is realigned on it
+#define TAP_SEQUENCE_END	2	// a tap sequence ends when there is no tap for this number of beats
+#define DEBUG_STATS		FALSE	// print re-clock jitter every 8 bars and bass pedal latency every 32 notes on the UART (each line is a blocking printf of 5 to 11 ms)
+#define RATE_SWITCH_TICKS	(NB_TICKS * settings->beats_per_bar)	// half-time / double-time starts on next bar, so that bars stay aligned; NB_TICKS for next beat
+#define RATE_NORMAL		0		// clock rate relative to tapped tempo
+#define RATE_HALF		1
+#define RATE_DOUBLE		2
+
+// configuration image, written with "picotool load config.bin -o <address>" (address: 0x10000000 + CONFIG_FLASH_OFFSET);
+// without a valid image, the constants above are used
+#define CONFIG_FLASH_OFFSET	(PICO_FLASH_SIZE_BYTES - CONFIG_FLASH_SIZE)
 
 // type definition
 struct pedalboard {
@@ -76,26 +158,82 @@ struct pedalboard {
 	bool change_state;		// describes whether pedal state has changed from last call
 	int change_value;		// describes pedal value when state is changed
 	uint64_t change_time;	// describes time elapsed between previous state change and current state change (ie. between previous press and current press); 0 if no state change
+	uint64_t time;			// time of last state change (usec since boot): report time for USB footswitches
 };
 
+// settings used without configuration image
+static const struct config_settings default_settings = {
+	.pedal_gpio = { SWITCH_PREV, SWITCH_NEXT, SWITCH_PLAY, SWITCH_CONTINUE, SWITCH_TEMPO, SWITCH_HALF, SWITCH_DOUBLE, SWITCH_LOOPER, SWITCH_MOD },
+	.sessions = SESSIONS,
+	.beats_per_bar = BEATS_PER_BAR,
+	.count_in_bars = COUNT_IN_BARS,
+	.mtc_fps = MTC_FPS,
+	.drum_channel = DRUM_CHANNEL,
+	.looper_bars = LOOPER_BARS
+};
+
+// modulation lanes started and stopped by the MOD pedal, locked to song position; macro knobs of the Circuit are CC 80 to
+// 87 on the channel of each synth (channel 1 and 2)
+static const struct mod_lane mod_lanes [] = {
+	// synth 1 macro 5: slow sine sweep over 2 bars, back to the middle when stopped
+	{ .channel = 0, .cc = 84, .shape = MOD_SHAPE_SINE, .beats = 8, .low = 20, .high = 110, .rest = 64, .min_ticks = 2 },
+	// synth 2 macro 5: triangle over 1 bar
+	{ .channel = 1, .cc = 84, .shape = MOD_SHAPE_TRIANGLE, .beats = 4, .low = 30, .high = 100, .rest = 64, .min_ticks = 2 },
+	// synth 1 macro 8: 16th-note step sequence over 1 bar
+	{ .channel = 0, .cc = 87, .shape = MOD_SHAPE_STEPS, .beats = 4, .rest = MOD_NO_REST, .min_ticks = 1, .nb_steps = 16,
+		.steps = { 100, 20, 60, 20, 100, 20, 80, 40, 100, 20, 60, 20, 120, 40, 80, 60 } },
+};
+
+// notes of the pedals in bass pedal mode, in the order of their bits (PREV, NEXT, PLAY...); 255 for a pedal that keeps its
+// function: the MOD pedal, which leaves bass pedal mode
+static const uint8_t bass_notes [CONFIG_PEDALS] = { 36, 38, 40, 41, 43, 45, 47, 48, 255 };		// C2 major scale
+
+// keys of USB footswitches (HID keyboards) acting as pedals, in the order of their bits (PREV, NEXT, PLAY...): page turner
+// keys for sessions, then keys most footswitches can be programmed to send; FOOTSWITCH_NO_KEY for none
+static const uint8_t footswitch_keys [CONFIG_PEDALS] = {
+	HID_KEY_PAGE_UP, HID_KEY_PAGE_DOWN, HID_KEY_SPACE, HID_KEY_ENTER, HID_KEY_T, HID_KEY_H, HID_KEY_D, HID_KEY_L, HID_KEY_M
+};
+
+// end of program in flash, from linker script
+extern char __flash_binary_end;
+
 // globals
-static uint8_t song = 0;
+static const struct config_settings * settings = &default_settings;	// settings in use, read in place from flash
+static uint32_t setlist_index = 0;		// current song of the setlist, if configuration has one
+static uint8_t drum_channel = DRUM_CHANNEL;	// midi channel of drum trigger notes, from settings or from device profile
 static uint8_t midi_dev_addr = 0;
+static uint8_t drum_dev_addr = 0;		// 2nd MIDI device, used as drum trigger input
 static bool connected = false;
-static bool play = false;
-static bool pause = false;
 
 // tempo fct
 static int64_t time_interval_between_ticks = 21000;				// time to wait between 2 MIDI clock ticks; initialized to 0.5 sec/24 (120BPM)
 static int64_t new_time_interval_between_ticks = 21000;			// time to wait between 2 MIDI clock ticks; initialized to 0.5 sec/24 (120BPM)
+static int64_t tapped_interval = 21000;							// time between ticks of tapped tempo; clock runs at rate_interval (tapped_interval, rate)
 static uint64_t time_to_send_next_clock = 0xffffffffffffffff;	// time when to sent next midi clock; initialized to end of times
 static uint64_t time_of_last_clock = 0;							// time when the last midi clock was sent
+static int32_t clock_tick = 0;									// position of next midi clock tick from beginning of song; negative during count-in
+static int32_t clock_run_ticks = 0;								// number of ticks sent since clock was started or its tempo tapped
+static int64_t phase_correction = 0;							// time (usec) still to be removed from (positive) or added to (negative) coming ticks to realign phase
+static bool clock_disabled = false;								// TEMPO held: pedal clock is off until next tap, PLAY sends MIDI_PLAY right away
+static bool tempo_map_suspended = false;						// a tap or a follower took over the tempo of the song: its tempo map is not followed
+static int rate = RATE_NORMAL;									// clock rate relative to tapped tempo (half-time, double-time)
+static int next_rate = RATE_NORMAL;								// rate to switch to on next RATE_SWITCH_TICKS boundary
+static uint8_t click_note = 0;									// midi note of the last click, to be released at next tick; 0 if none
+static bool drum_follow = false;								// drum follower has a new estimate, to be applied to clock in main loop
+static uint32_t drum_period = 0;								// beat period (usec) given by drum follower
+static uint64_t drum_beat_time = 0;								// time of last beat (usec) given by drum follower
 
 // midi buffers
-#define MIDI_BUF_SIZE	5000
-static uint8_t midi_rx [MIDI_BUF_SIZE];		// large midi buffer to avoid override when receiving midi
-static uint8_t midi_tx [MIDI_BUF_SIZE];		// large midi buffer to avoid override when receiving midi
+#define MIDI_RX_SIZE	((int) ARENA_SIZEOF (midi_rx))
+#define MIDI_BUF_SIZE	((int) ARENA_SIZEOF (midi_tx))
+static uint8_t * const midi_rx = arena.midi_rx;		// midi receive buffer, read until the device has no more
+static uint8_t * const midi_tx = arena.midi_tx;		// midi sent by the main loop
 static int index_tx = 0;
+#define MIDI_RT_BUF_SIZE	64
+static uint8_t midi_rt [MIDI_RT_BUF_SIZE];	// realtime lane: midi clock and time code, sent before anything else
+static int index_rt = 0;
+static struct clock_ratio usb_ratio;		// clock ratio of USB output
+static uint8_t smf_song = 0xFF;				// session of the midi file that is open; 0xFF if none
 
 
 // write lg bytes stored in buffer to midi out
@@ -113,65 +251,352 @@ void send_midi (uint8_t * buffer, uint32_t lg)
 }
 
 
+// song position of the pedal clock at time "now", in 1/256 of clock tick from tick 0 of song; 0 until tick 0 is sent.
+// Position is interpolated between ticks, and never goes past the next tick
+uint32_t song_position (uint64_t now)
+{
+	int64_t fraction;
+
+	if (clock_tick < 1) return 0;
+	fraction = ((int64_t) (now - time_of_last_clock) * 256) / time_interval_between_ticks;
+	if (fraction < 0) fraction = 0;
+	if (fraction > 255) fraction = 255;
+	return (uint32_t) (clock_tick - 1) * 256 + fraction;
+}
+
+
 // sends a midi clock signal when "when_to_send" time has elapsed, and returns true
 // returns false if not elapsed
 bool send_clock (uint64_t when_to_send)
 {
 	uint64_t time;
+	uint32_t n;
 
 	// check whether it is time to send midi clock signal or not
 	time = to_us_since_boot (get_absolute_time());
 	if (time < when_to_send) return false;
 
-	// send MIDI CLOCK signal
-	midi_tx [index_tx++] = MIDI_CLOCK;
+	// send MIDI CLOCK signal, as many times as the USB clock ratio requires (other ticks of the ratio are sent between master ticks)
+	for (n = ratio_tick (&usb_ratio, time, time_interval_between_ticks); n > 0; n--) index_rt += midi_clock (midi_rt + index_rt, MIDI_RT_BUF_SIZE - index_rt);
 	// set time of last midi clock was sent
 	time_of_last_clock = time;
 	return true;
 }
 
 
+// time between ticks at "new_rate", from time between ticks of tapped tempo "interval"; always derived from the tapped
+// tempo, so that switching rates back and forth does not accumulate rounding errors
+int64_t rate_interval (int64_t interval, int new_rate)
+{
+	if (new_rate == RATE_HALF) interval *= 2;
+	if (new_rate == RATE_DOUBLE) interval /= 2;
+	return interval;
+}
+
+
+// new tapped tempo "interval" (tap, setlist, tempo map): clock runs at current half-time / double-time rate, unless it
+// would leave 40 to 240 BPM, in which case it drops back to normal rate (as does a pending rate switch)
+void set_tapped_interval (int64_t interval)
+{
+	int64_t rated;
+
+	tapped_interval = interval;
+	rated = rate_interval (interval, next_rate);
+	if ((rated > BPM40_TICKS) || (rated < BPM240_TICKS)) next_rate = RATE_NORMAL;
+	rated = rate_interval (interval, rate);
+	if ((rated > BPM40_TICKS) || (rated < BPM240_TICKS)) rate = RATE_NORMAL;
+	time_interval_between_ticks = rate_interval (tapped_interval, rate);
+}
+
+
+// time between ticks of tapped tempo, from time between ticks "interval" at current rate
+int64_t tapped_of (int64_t interval)
+{
+	if (rate == RATE_HALF) interval /= 2;
+	if (rate == RATE_DOUBLE) interval *= 2;
+	return interval;
+}
+
+
+// transport transition (transport.h), without side effect: step session by "arg" (1 for next, sessions - 1 for
+// previous), modulo number of sessions of the settings
+static uint32_t step_session (uint32_t state, uint32_t arg)
+{
+	return (state & ~TRANSPORT_SONG) | (((state & TRANSPORT_SONG) + arg) % settings->sessions);
+}
+
+
+// called each time a midi clock tick has been sent: runs everything that follows the tick schedule, in the realtime lane
+void on_clock_tick (void)
+{
+	bool beat = (clock_tick % NB_TICKS) == 0;
+	bool bar = (clock_tick % (NB_TICKS * settings->beats_per_bar)) == 0;
+	uint32_t state = transport_state ();
+	int64_t interval;
+
+	// release midi click note of previous tick
+	if (click_note) {
+		index_rt += midi_click (midi_rt + index_rt, MIDI_RT_BUF_SIZE - index_rt, click_note, 0);		// velocity 0 is note off
+		click_note = 0;
+	}
+
+	// DIN and analog clock outputs follow the pedal clock
+	sync_out_tick (time_of_last_clock, time_interval_between_ticks);
+
+	// flash tempo leds on each beat of the clock actually being sent
+	if (beat && LED_TEMPO) led_flash (bar);
+
+	// click on each beat during count-in (and while playing in metronome mode), at the same time as the clock tick
+	if (beat && ((state & TRANSPORT_COUNT_IN) || (CLICK_METRONOME && (state & TRANSPORT_PLAY)))) {
+		click (bar);
+		click_note = bar ? CLICK_NOTE_ACCENT : CLICK_NOTE;
+		if (click_note) {
+			index_rt += midi_click (midi_rt + index_rt, MIDI_RT_BUF_SIZE - index_rt, click_note, bar ? 127 : 100);
+		}
+	}
+
+	// looper follows song position: events of this tick are sent by realtime_task ()
+	if (state & TRANSPORT_PLAY) looper_tick (clock_tick, NB_TICKS * settings->beats_per_bar, settings->looper_bars);
+
+	// modulation lanes follow song position, a few CC per tick at most, behind the clock tick
+	index_rt += mod_tick (clock_tick, midi_rt + index_rt, MIDI_RT_BUF_SIZE - index_rt);
+
+	// tempo map of the song: period of next tick, at current half-time / double-time rate. Sources of the tempo: the
+	// setlist tempo and the map set it when a song is selected or started, then the map sets every tick; a TEMPO tap or
+	// a follower (audio, drums) takes over until another song is selected, the map is suspended meanwhile. Half-time /
+	// double-time applies to whichever source is in charge, and phase realignment comes on top of the period of the tick
+	if ((state & TRANSPORT_PLAY) && !tempo_map_suspended && (interval = tempo_map_interval (clock_tick)) != 0) {
+		set_tapped_interval (interval);
+		time_to_send_next_clock = time_of_last_clock + time_interval_between_ticks;
+	}
+
+	// half-time / double-time: tick just sent is on the boundary, new rate applies from next tick on, without stop/continue
+	if ((next_rate != rate) && (clock_tick % RATE_SWITCH_TICKS == 0)) {
+		time_interval_between_ticks = rate_interval (tapped_interval, next_rate);
+		time_to_send_next_clock = time_of_last_clock + time_interval_between_ticks;
+		rate = next_rate;
+	}
+
+	// last tick of count-in or pre-roll: send MIDI_PLAY so that receivers start on the next tick, which is the downbeat
+	// (unless start has just been cancelled, or transport been stopped by the groovebox)
+	if (clock_tick == -1 && (transport_update (transport_start_play, 0) & TRANSPORT_STARTING)) {
+		index_rt += midi_start (midi_rt + index_rt, MIDI_RT_BUF_SIZE - index_rt);
+		ratio_reset (&usb_ratio);		// next tick is output tick 0 of every ratio
+		mtc_start (time_to_send_next_clock, 0);
+	}
+
+	clock_tick++;
+	if (clock_run_ticks < INT32_MAX) clock_run_ticks++;
+}
+
+
+// realtime lane: send midi clock and time code when due, and flush them right away so that they do not wait behind other messages
+void realtime_task (void)
+{
+	// midi clock always goes first, time code only fills the lane after it
+	int64_t step;
+	uint64_t now;
+	uint32_t lg;
+
+	if (send_clock (time_to_send_next_clock)) {
+		time_to_send_next_clock = time_of_last_clock + time_interval_between_ticks;
+		on_clock_tick ();
+
+		// phase realignment: compress or stretch next tick by at most 1/4 of its length, until correction is absorbed
+		if (phase_correction) {
+			step = phase_correction;
+			if (step > time_interval_between_ticks / 4) step = time_interval_between_ticks / 4;
+			if (step < -time_interval_between_ticks / 4) step = -time_interval_between_ticks / 4;
+			time_to_send_next_clock -= step;
+			phase_correction -= step;
+		}
+	}
+	// output ticks of clock ratios that fall between master ticks, right behind the master tick; a tick is only taken
+	// once its byte is in the lane
+	now = to_us_since_boot (get_absolute_time());
+	while (ratio_peek (&usb_ratio, now) && midi_clock (midi_rt + index_rt, MIDI_RT_BUF_SIZE - index_rt)) {
+		index_rt++;
+		ratio_take (&usb_ratio);
+	}
+
+	// bass pedal notes right behind the clock: their latency is what the player feels (they wait while a restore is in
+	// the middle of a SysEx message)
+	if (!restore_in_message ()) index_rt += bass_task (midi_rt + index_rt, MIDI_RT_BUF_SIZE - index_rt);
+	index_rt += mtc_task (to_us_since_boot (get_absolute_time()), midi_rt + index_rt, MIDI_RT_BUF_SIZE - index_rt);
+
+	// midi file events up to current position, interpolated between ticks so that events are not quantized to 24 PPQN
+	now = to_us_since_boot (get_absolute_time());
+	if ((transport_state () & TRANSPORT_PLAY) && clock_tick >= 1) index_rt += smf_play (song_position (now), midi_rt + index_rt, MIDI_RT_BUF_SIZE - index_rt);
+	index_rt += looper_play (midi_rt + index_rt, MIDI_RT_BUF_SIZE - index_rt);
+
+	sync_out_task (now);
+
+	// groovebox is master: regenerate its clock, dejittered, on DIN and analog outputs
+	if (reclock_output (now)) sync_out_tick (now, reclock_period ());
+
+	// while a restore is in the middle of a SysEx message, only realtime bytes go; the rest waits in the lane
+	if (index_rt && (lg = restore_sendable (midi_rt, index_rt)) != 0) {
+		sync_out_relay (midi_rt, lg);
+		send_midi (midi_rt, lg);
+		index_rt -= lg;
+		memmove (midi_rt, midi_rt + lg, index_rt);
+		if (connected) tuh_midi_stream_flush(midi_dev_addr);
+		if (index_rt == 0) bass_flushed ();
+	}
+}
+
+
+// follow mode: a tempo source (audio beat tracker...) gives its beat period and the time of one of its beats (usec);
+// tick period follows it, and phase error is spread over the ticks until the next beat but one, so that clock never jumps
+void clock_follow (uint32_t beat_period, uint64_t beat_time)
+{
+	int64_t interval;
+	int64_t adjust;
+	int64_t error;
+	int32_t ticks_to_beat;
+	uint64_t next_clock_beat, now;
+
+	// keep source in the tempo octave of the clock being sent: half-time or double-time detection is not a tempo change
+	if (time_to_send_next_clock != 0xffffffffffffffff) {
+		while (beat_period > (time_interval_between_ticks * NB_TICKS * 3) / 2) beat_period /= 2;
+		while (beat_period < (time_interval_between_ticks * NB_TICKS * 2) / 3) beat_period *= 2;
+	}
+	interval = beat_period / NB_TICKS;
+	if ((interval > BPM40_TICKS) || (interval < BPM240_TICKS)) return;
+
+	// clock not running: start it on next beat of source, unless it has been disabled by holding TEMPO
+	if (time_to_send_next_clock == 0xffffffffffffffff) {
+		if (clock_disabled) return;
+		now = to_us_since_boot (get_absolute_time());
+		if (beat_time < now) beat_time += (((now - beat_time) / beat_period) + 1) * beat_period;
+		time_interval_between_ticks = interval;
+		tapped_interval = tapped_of (interval);
+		tempo_map_suspended = true;
+		time_to_send_next_clock = beat_time;
+		clock_run_ticks = 0;
+		clock_tick += (NB_TICKS - (((clock_tick % NB_TICKS) + NB_TICKS) % NB_TICKS)) % NB_TICKS;	// next tick is a beat
+		return;
+	}
+
+	// time when clock will send its next beat tick, and phase error to the nearest beat of source
+	ticks_to_beat = (NB_TICKS - (((clock_tick % NB_TICKS) + NB_TICKS) % NB_TICKS)) % NB_TICKS;
+	next_clock_beat = time_to_send_next_clock + (ticks_to_beat * time_interval_between_ticks);
+	error = ((int64_t) (beat_time - next_clock_beat)) % (int64_t) beat_period;
+	if (error > (int64_t) beat_period / 2) error -= beat_period;
+	if (error < -(int64_t) beat_period / 2) error += beat_period;
+
+	// spread correction, never changing a tick period by more than 1/8
+	adjust = error / (ticks_to_beat + NB_TICKS);
+	if (adjust > interval / 8) adjust = interval / 8;
+	if (adjust < -interval / 8) adjust = -interval / 8;
+	time_interval_between_ticks = interval + adjust;
+	tapped_interval = tapped_of (interval);
+	tempo_map_suspended = true;		// source holds the tempo for the rest of the song
+}
+
+
+// realign bar of the clock on "downbeat" (usec since boot), by compressing or stretching the coming ticks:
+// the clock's nearest bar start is moved to the downbeat, going forward or backward whichever is shorter
+void clock_downbeat (uint64_t downbeat)
+{
+	int32_t bar_ticks = NB_TICKS * settings->beats_per_bar;
+	int64_t bar_length = time_interval_between_ticks * bar_ticks;
+	int32_t last_tick_in_bar = (((clock_tick - 1) % bar_ticks) + bar_ticks) % bar_ticks;
+	uint64_t clock_bar;
+	int64_t error;
+
+	if (time_to_send_next_clock == 0xffffffffffffffff) return;
+
+	// time when the bar of the last tick sent started, and its distance to downbeat modulo one bar
+	clock_bar = time_of_last_clock - (last_tick_in_bar * time_interval_between_ticks);
+	error = ((int64_t) (clock_bar - downbeat)) % bar_length;
+	if (error > bar_length / 2) error -= bar_length;
+	if (error < -bar_length / 2) error += bar_length;
+
+	// clock bar starts after downbeat: clock is late, remove time from coming ticks (and add time if it is early)
+	phase_correction = error;
+}
+
+
+// returns true if a backup or restore can be started: stick mounted, transport stopped, and no backup or restore running
+bool stick_idle (void)
+{
+	struct backup_progress backup;
+	struct restore_progress restore;
+
+	backup_progress (&backup);
+	restore_progress (&restore);
+	return stick_ready () && !(transport_state () & (TRANSPORT_RUNNING | TRANSPORT_STARTING)) && !backup.running && !restore.running;
+}
+
+
+// show session, transport, beat position and connection status on the led ring, and tempo as well on the OLED screen
+void show_status (void)
+{
+	struct ring_status status;
+	struct display_status screen;
+	struct backup_progress backup;
+	struct restore_progress restore;
+	int32_t bar_ticks = NB_TICKS * settings->beats_per_bar;
+	int32_t tick_in_bar = (((clock_tick - 1) % bar_ticks) + bar_ticks) % bar_ticks;	// position of last tick sent, also during count-in
+	uint32_t state = transport_state ();
+
+	status.song = state & TRANSPORT_SONG;
+	status.transport = (state & TRANSPORT_STARTING) ? RING_COUNT_IN : ((state & TRANSPORT_PLAY) ? RING_PLAY : ((state & TRANSPORT_PAUSE) ? RING_PAUSE : RING_STOP));
+	status.position = (tick_in_bar * RING_LEDS) / bar_ticks;
+	status.connected = connected;
+	ring_task (&status);
+
+	// 1/10 BPM = 60 sec * 10 / (tick interval * NB_TICKS), rounded
+	screen.bpm = (uint32_t) ((600000000 + time_interval_between_ticks * NB_TICKS / 2) / (time_interval_between_ticks * NB_TICKS));
+	screen.song = state & TRANSPORT_SONG;
+	screen.transport = (state & TRANSPORT_STARTING) ? DISPLAY_COUNT_IN : ((state & TRANSPORT_PLAY) ? DISPLAY_PLAY : ((state & TRANSPORT_PAUSE) ? DISPLAY_PAUSE : DISPLAY_STOP));
+	screen.bar = (clock_tick - 1 - tick_in_bar) / bar_ticks + 1;
+	screen.beat = tick_in_bar / NB_TICKS + 1;
+	screen.connected = connected;
+	backup_progress (&backup);
+	restore_progress (&restore);
+	screen.activity = backup.running ? DISPLAY_BACKUP : (restore.running ? DISPLAY_RESTORE : DISPLAY_NO_ACTIVITY);
+	screen.progress = backup.running ? (backup.step * 100) / backup.steps : 0;
+	if (restore.running && restore.total) screen.progress = (uint8_t) (((uint64_t) restore.bytes * 100) / restore.total);
+	oled_task (&screen);
+}
+
+
 // test switches and return which switch has been pressed (FALSE if none)
 int test_switch (int pedal_to_check, struct pedalboard* pedal)
 {
 	int result = 0;
+	int bit;
 	static int previous_result = 0;							// previous value for result, required for anti-bounce; this MUST BE static
+	static int previous_gpios = 0;							// part of previous result read from gpios; this MUST BE static
 	static uint64_t this_press, previous_press = 0;			// time between 2 state changes; this MUST be static
+	uint64_t report_time;
+	int gpios = 0;
 	int i;
 
 
 	// by default, we assume there is no change in the pedal state (ie. same pedals are pressed / unpressed as for previous function call)
 	pedal->change_state = false;
 
-	// determine for how long we are in the current state
-	this_press = to_us_since_boot (get_absolute_time());
-	pedal->change_time = this_press - previous_press;
-
 	// test if switch has been pressed
-	// in this case, line is down (level 0)
-	if ((pedal_to_check & PREV) && gpio_get (SWITCH_PREV)==0) {
-		result |= PREV;
-	}
-
-	if ((pedal_to_check & NEXT) && gpio_get (SWITCH_NEXT)==0) {
-		result |= NEXT;
-	}
-
-	if ((pedal_to_check & PLAY) && gpio_get (SWITCH_PLAY)==0) {
-		result |= PLAY;
-	}
-
-	if ((pedal_to_check & CONTINUE) && gpio_get (SWITCH_CONTINUE)==0) {
-		result |= CONTINUE;
+	// in this case, line is down (level 0); pedal gpios are in the order of pedal bits (PREV, NEXT, PLAY...)
+	for (bit = 0; bit < CONFIG_PEDALS; bit++) {
+		if ((pedal_to_check & (1 << bit)) && settings->pedal_gpio [bit] != CONFIG_NO_GPIO && gpio_get (settings->pedal_gpio [bit])==0) {
+			gpios |= 1 << bit;
+		}
 	}
+	// keys of USB footswitches act as the same pedals
+	result = gpios | (footswitch_pedals (&report_time) & pedal_to_check);
 
-	if ((pedal_to_check & TEMPO) && gpio_get (SWITCH_TEMPO)==0) {
-		result |= TEMPO;
-	}
+	// determine for how long we are in the current state; a change made by USB footswitches only happened when their report came in
+	this_press = to_us_since_boot (get_absolute_time());
+	if (result != previous_result && gpios == previous_gpios && report_time != 0) this_press = report_time;
+	pedal->change_time = this_press - previous_press;
 
-	// LED ON or LED OFF depending if a switch has been pressed
-	if (NO_LED_GPIO != LED_GPIO) gpio_put(LED_GPIO, (result ? true : false));		// if onboard led and if we are within time window, lite LED on/off
-	if (NO_LED2_GPIO != LED2_GPIO) gpio_put(LED2_GPIO, (result ? true : false));	// if another led and if we are within time window, lite LED on/off
+	// LED ON or LED OFF depending if a switch has been pressed (unless leds are used as tempo indicator)
+	if (!LED_TEMPO && NO_LED_GPIO != LED_GPIO) gpio_put(LED_GPIO, (result ? true : false));		// if onboard led and if we are within time window, lite LED on/off
+	if (!LED_TEMPO && NO_LED2_GPIO != LED2_GPIO) gpio_put(LED2_GPIO, (result ? true : false));	// if another led and if we are within time window, lite LED on/off
 
 	// check whether there has been a change of state in the pedal (pedal pressed or unpressed...)
 	// this allows to have anti-bouncing when pedal goes from unpressed to pressed, or from pressed to unpressed
@@ -179,19 +604,21 @@ int test_switch (int pedal_to_check, struct pedalboard* pedal)
 		// pedal state has changed; set variables accordingly
 		pedal->change_state = true;
 		pedal->change_value = previous_result;
+		pedal->time = this_press;
 		previous_press = this_press;
 
-		// anti-bounce of 30ms, but send clock during this time if required
-		for (i = 0; i < 30; i++) {
+		// anti-bounce of 30ms, but send clock during this time if required; USB footswitches are debounced by their own firmware
+		for (i = 0; gpios != previous_gpios && i < 30; i++) {
 			// wait 1ms: not sure whether sleep or busy_wait are blocking background threads
 			sleep_ms (1);
-			// send midi clock if required
-			if (send_clock (time_to_send_next_clock)) time_to_send_next_clock = time_of_last_clock + time_interval_between_ticks;
+			// send midi clock and time code if required
+			realtime_task ();
 		}
 	}
 
 	// copy pedal values and return
 	previous_result = result;
+	previous_gpios = gpios;
 	pedal->value = result;
 	return result;
 }
@@ -201,46 +628,94 @@ int main() {
 	
 	struct pedalboard pedal;
 	uint64_t this_press, previous_press = 0;	// time for tap tempo function, to measure timing between 1st and 2nd press
+	bool tap_sequence = false;					// a tap tempo sequence is going on; its last tap will be the downbeat
+	int32_t preroll;							// number of ticks to send before MIDI_PLAY
+	struct reclock_stats jitter;				// jitter of incoming and re-clocked midi clock
+	struct bass_stats latency;					// latency of bass pedal notes
+	uint32_t beat_period;						// beat period and time of last beat given by a tempo source, in follow mode
+	uint64_t beat_time;
+	const struct config_song * entry;			// setlist entry, if configuration has a setlist
+	const struct config_macro * macro;
+	char smf_path [32];							// midi file of current session
+	bool recording = false;						// song is playing, and is being recorded if possible
+	int64_t record_interval = 0;				// tempo of recording, as time between 2 ticks
+	const struct config_tempo * tempos;			// tempo map of current song
+	uint32_t tempo_owner = 0xFFFFFFFF, owner, count;
+	int64_t interval;
+	uint32_t state;								// transport state before a transition, or snapshot
+	struct restore_progress restore;
+	uint32_t lg;
+	int checked;								// pedals tested
+	int bit;
 
 
 	stdio_init_all();
 	board_init();
 	printf("Picovation\r\n");
+	arena_init ();
 	tusb_init();
 
+	// configuration image is read in place; the linker keeps the program out of its flash region, this check is for a
+	// board with a smaller flash than the linker script
+	if ((uintptr_t) &__flash_binary_end <= XIP_BASE + CONFIG_FLASH_OFFSET &&
+		config_init ((const uint8_t *) (XIP_BASE + CONFIG_FLASH_OFFSET), CONFIG_FLASH_SIZE, &default_settings)) {
+		printf("Configuration image: %lu songs in setlist\r\n", (unsigned long) config_nb_songs ());
+	}
+	else {
+		config_init (NULL, 0, &default_settings);
+		printf("No configuration image, using defaults\r\n");
+	}
+	settings = config_settings ();
+	drum_channel = settings->drum_channel;
 
-	// Map the pins to functions
-	gpio_init(LED_GPIO);
-	gpio_set_dir(LED_GPIO, GPIO_OUT);
-
-	gpio_init(LED2_GPIO);
-	gpio_set_dir(LED2_GPIO, GPIO_OUT);
-
-	gpio_init(SWITCH_PREV);
-	gpio_set_dir(SWITCH_PREV, GPIO_IN);
-	gpio_pull_up (SWITCH_PREV);		 // switch pull-up
 
-	gpio_init(SWITCH_NEXT);
-	gpio_set_dir(SWITCH_NEXT, GPIO_IN);
-	gpio_pull_up (SWITCH_NEXT);		 // switch pull-up
+	// Map the pins to functions
+	if (NO_LED_GPIO != LED_GPIO) {
+		gpio_init(LED_GPIO);
+		gpio_set_dir(LED_GPIO, GPIO_OUT);
+	}
 
-	gpio_init(SWITCH_PLAY);
-	gpio_set_dir(SWITCH_PLAY, GPIO_IN);
-	gpio_pull_up (SWITCH_PLAY);		 // switch pull-up
+	if (NO_LED2_GPIO != LED2_GPIO) {
+		gpio_init(LED2_GPIO);
+		gpio_set_dir(LED2_GPIO, GPIO_OUT);
+	}
 
-	gpio_init(SWITCH_CONTINUE);
-	gpio_set_dir(SWITCH_CONTINUE, GPIO_IN);
-	gpio_pull_up (SWITCH_CONTINUE);		 // switch pull-up
+	// tempo indicator: leds are driven by PWM instead
+	if (LED_TEMPO) led_init (LED_GPIO, LED2_GPIO);
 
-	gpio_init(SWITCH_TEMPO);
-	gpio_set_dir(SWITCH_TEMPO, GPIO_IN);
-	gpio_pull_up (SWITCH_TEMPO);		 // switch pull-up
+	for (bit = 0; bit < CONFIG_PEDALS; bit++) {
+		if (settings->pedal_gpio [bit] == CONFIG_NO_GPIO) continue;
+		gpio_init(settings->pedal_gpio [bit]);
+		gpio_set_dir(settings->pedal_gpio [bit], GPIO_IN);
+		gpio_pull_up (settings->pedal_gpio [bit]);		 // switch pull-up
+	}
+	// bass pedal mode plays notes on the same pedals, from an edge interrupt
+	bass_init (settings->pedal_gpio, bass_notes, CONFIG_PEDALS, BASS_CHANNEL, BASS_VELOCITY, BASS_OPTIONS);
+	bass_probe_init (BASS_PROBE_GPIO);
+	// USB footswitches plugged into the hub act as pedals as well
+	footswitch_init (footswitch_keys, CONFIG_PEDALS);
+
+	// MIDI time code runs alongside midi clock while transport is playing
+	mtc_init (settings->mtc_fps);
+	looper_init ();
+	mod_init (mod_lanes, sizeof (mod_lanes) / sizeof (mod_lanes [0]));
+	click_init (CLICK_GPIO);
+	ring_init (RING_GPIO);
+	oled_init (OLED_SDA_GPIO, OLED_SCL_GPIO);
+	audio_init (AUDIO_GPIO);
+	sync_out_init (DIN_GPIO, PULSE_GPIO);
+	ratio_init (&usb_ratio, USB_RATIO_NUM, USB_RATIO_DEN);
+	sync_out_ratio (SYNC_DIN, DIN_RATIO_NUM, DIN_RATIO_DEN);
+	sync_out_ratio (SYNC_PULSE, PULSE_RATIO_NUM, PULSE_RATIO_DEN);
+	reclock_init ();
+	stick_init (realtime_task);
 
 	// init pedal structure to all 0
 	pedal.value = 0;
 	pedal.change_state = false;
 	pedal.change_value = 0;
 	pedal.change_time = 0;
+	pedal.time = 0;
 
 
 	// main loop
@@ -252,50 +727,106 @@ int main() {
 
 
 		// test pedal and check if one of them is pressed
-		test_switch (PREV | NEXT | PLAY | CONTINUE | TEMPO, &pedal);
+		// in bass pedal mode, pedals play notes (bass_task ()): only MOD keeps its function; while a restore runs,
+		// transport, session and MOD pedals are ignored, as their midi would cut into its SysEx messages
+		checked = bass_enabled () ? MOD : (PREV | NEXT | PLAY | CONTINUE | TEMPO | HALF | DOUBLE | LOOPER | MOD);
+		restore_progress (&restore);
+		if (restore.running) checked &= ~(PREV | NEXT | PLAY | CONTINUE | MOD);
+		test_switch (checked, &pedal);
 
 		// check if state has changed, ie. pedal has just been pressed or unpressed
 		if (pedal.change_state) {
 
 			if (pedal.value & (NEXT | PREV)) {
-				// previous or next session
-				if (pedal.value & NEXT)
-					song = (song == 31) ? 0 : song + 1;		// test boundaries
-				if (pedal.value & PREV)
-					song = (song == 0) ? 31 : song - 1;		// test boundaries
-				midi_tx [index_tx++] = MIDI_PRG_CHANGE;
-				midi_tx [index_tx++] = song; 
+				// previous or next session, or previous or next song of the setlist
+				entry = NULL;
+				if (config_nb_songs ()) {
+					if (pedal.value & NEXT)
+						setlist_index = (setlist_index + 1 == config_nb_songs ()) ? 0 : setlist_index + 1;
+					if (pedal.value & PREV)
+						setlist_index = (setlist_index == 0) ? config_nb_songs () - 1 : setlist_index - 1;
+					entry = config_song (setlist_index);
+					state = transport_set (TRANSPORT_SONG, entry->session);
+					// song tempo, at current half-time / double-time rate
+					if (entry->bpm) {
+						set_tapped_interval (600000000 / ((int64_t) entry->bpm * NB_TICKS));
+					}
+				}
+				else {
+					// wraps around at both ends
+					state = transport_update (step_session, ((pedal.value & NEXT) ? 1 : 0) + ((pedal.value & PREV) ? settings->sessions - 1 : 0));
+				}
+				index_tx += midi_session (midi_tx + index_tx, MIDI_BUF_SIZE - index_tx, transport_state () & TRANSPORT_SONG);
 
 				// send stop then pause/continue so music don't stop
-				midi_tx [index_tx++] = MIDI_STOP;
-				if (play || pause) midi_tx [index_tx++] = MIDI_PLAY;
+				index_tx += midi_stop (midi_tx + index_tx, MIDI_BUF_SIZE - index_tx);
+				if (state & TRANSPORT_RUNNING) index_tx += midi_start (midi_tx + index_tx, MIDI_BUF_SIZE - index_tx);
+				// every output restarts its ratio on the next tick, like USB
+				ratio_reset (&usb_ratio);
+				sync_out_reset ();
+				// new session starts from the beginning: locate time code to 00:00:00:00
+				mtc_locate (to_us_since_boot (get_absolute_time()), 0);
+
+				// song macro, once groovebox is on the new session
+				macro = entry ? config_macro (entry->macro) : NULL;
+				if (macro && index_tx + macro->lg <= MIDI_BUF_SIZE) {
+					for (bit = 0; bit < macro->lg; bit++) midi_tx [index_tx++] = macro->data [bit];
+				}
 			}
 
 
 			if (pedal.value & PLAY) {
-				// play / stop
-				if (play || pause) {		// if play or pause, then stop
-					midi_tx [index_tx++] = MIDI_STOP;
-					play = false;
-					pause = false;
+				// play / stop: decided and applied in one transition, so that a STOP received meanwhile is not undone
+				state = transport_update (transport_play_pedal, settings->count_in_bars != 0 && !clock_disabled);
+				if (state & TRANSPORT_RUNNING) {		// if play or pause, then stop
+					index_tx += midi_stop (midi_tx + index_tx, MIDI_BUF_SIZE - index_tx);
+					mtc_stop ();
 				}
-				else {
-					midi_tx [index_tx++] = MIDI_PLAY;
-					play = true;
+				else if (!(state & TRANSPORT_STARTING) && clock_disabled) {
+					// pedal clock disabled: groovebox plays on its own clock, no count-in nor pre-roll
+					transport_update (transport_start_play, 0);
+					index_tx += midi_start (midi_tx + index_tx, MIDI_BUF_SIZE - index_tx);
+					mtc_start (to_us_since_boot (get_absolute_time()), 0);
+					clock_tick = 0;
+				}
+				else if (!(state & TRANSPORT_STARTING)) {		// PLAY during count-in or pre-roll has cancelled it, otherwise start
+					// song with a tempo map: count-in at tempo of first bar, unless tempo has been tapped for this song
+					if (!tempo_map_suspended && (interval = tempo_map_start ()) != 0) {
+						set_tapped_interval (interval);
+					}
+
+					// start midi clock right away if it is not running yet
+					if (time_to_send_next_clock == 0xffffffffffffffff) {
+						time_to_send_next_clock = to_us_since_boot (get_absolute_time());
+						clock_run_ticks = 0;
+					}
+
+					if (settings->count_in_bars) {
+						// count-in: click for count_in_bars bars, which also serve as pre-roll
+						preroll = settings->count_in_bars * settings->beats_per_bar * NB_TICKS;
+					}
+					else {
+						// pre-roll: receivers need some ticks at target tempo to lock; rounded to whole beats
+						preroll = transport_preroll (clock_run_ticks, TRANSPORT_PREROLL_TICKS, NB_TICKS);
+					}
+
+					// MIDI_PLAY is sent by the tick schedule right after tick -1: receivers start on a tick boundary; the
+					// schedule runs in this loop, so it cannot see the starting state before clock_tick is set
+					clock_tick = -preroll;
 				}
 			}
 
 
 			if (pedal.value & CONTINUE) {
 				// pause / stop
-				if (play || pause) {		// if pause or play, then stop
-					midi_tx [index_tx++] = MIDI_STOP;
-					play = false;
-					pause = false;
+				state = transport_update (transport_continue_pedal, 0);
+				if (state & TRANSPORT_RUNNING) {		// if pause or play, then stop
+					index_tx += midi_stop (midi_tx + index_tx, MIDI_BUF_SIZE - index_tx);
+					mtc_stop ();
 				}
 				else {
-					midi_tx [index_tx++] = MIDI_CONTINUE;
-					pause = true;
+					index_tx += midi_continue (midi_tx + index_tx, MIDI_BUF_SIZE - index_tx);
+					mtc_continue (to_us_since_boot (get_absolute_time()));
 				}
 			}
 
@@ -303,8 +834,8 @@ int main() {
 			if (pedal.value & TEMPO) {
 				// Tap tempo functionality
 				
-				// get current time
-				this_press = to_us_since_boot (get_absolute_time());
+				// time of press: time of the report for a USB footswitch
+				this_press = pedal.time;
 	
 				// In case this is the first time we press the tempo pedal, then previous_press will be 0
 				// otherwise previous_press will have another value
@@ -319,39 +850,172 @@ int main() {
 	
 					// validate new time interval as time between ticks
 					// goal of having new time interval is that it allows to keep previous time interval in case of 1st press
-					time_interval_between_ticks = new_time_interval_between_ticks;
+					set_tapped_interval (new_time_interval_between_ticks);
 					// send stop then pause/continue so music don't stop
-					midi_tx [index_tx++] = MIDI_STOP;
-					if (play || pause) midi_tx [index_tx++] = MIDI_CONTINUE;
+					index_tx += midi_stop (midi_tx + index_tx, MIDI_BUF_SIZE - index_tx);
+					if (transport_state () & TRANSPORT_RUNNING) index_tx += midi_continue (midi_tx + index_tx, MIDI_BUF_SIZE - index_tx);
 					// set new time to send midi_clock
 					time_to_send_next_clock = this_press + time_interval_between_ticks;
 					if (send_clock (time_to_send_next_clock)) time_to_send_next_clock = time_of_last_clock + time_interval_between_ticks;
+					tap_sequence = true;
+					clock_run_ticks = 0;		// receivers have to lock on new tempo
+					clock_disabled = false;
+					tempo_map_suspended = true;		// tapped tempo holds for the rest of the song
 				}
 	
 				// in any case, current time (time of this press) becomes time of previous press, in order to prepare for next press
 				previous_press = this_press;
 			}
 
+			if (pedal.value & (HALF | DOUBLE)) {
+				// half-time / double-time on or off, relative to tapped tempo; switch happens on next boundary, phase is kept
+				if (pedal.value & HALF) next_rate = (next_rate == RATE_HALF) ? RATE_NORMAL : RATE_HALF;
+				if (pedal.value & DOUBLE) next_rate = (next_rate == RATE_DOUBLE) ? RATE_NORMAL : RATE_DOUBLE;
+
+				// keep clock within 40 to 240 BPM
+				new_time_interval_between_ticks = rate_interval (tapped_interval, next_rate);
+				if ((new_time_interval_between_ticks > BPM40_TICKS) || (new_time_interval_between_ticks < BPM240_TICKS)) next_rate = rate;
+
+				// clock not running: nothing to synchronize with, switch right away
+				if (time_to_send_next_clock == 0xffffffffffffffff) {
+					time_interval_between_ticks = rate_interval (tapped_interval, next_rate);
+					rate = next_rate;
+				}
+			}
+
 			if ((pedal.value == 0) && (pedal.change_value & TEMPO)) {
 				// no pedal pressed anymore and pedal previously pressed was TEMPO
 				// check how much time the previous pedal was pressed; if more than 2 sec, then disable the tap tempo fonctionality
 				if (pedal.change_time >= EXIT_FUNCTION) {
 					// set unreachable value for time to send next clock signal: nothing will be sent then
 					time_to_send_next_clock = 0xffffffffffffffff;
+					clock_disabled = true;
 	
 					// set functionality off (this is not really necessary)
 					previous_press = 0;
+					tap_sequence = false;
+					phase_correction = 0;
 				}
 			}
+
+			if ((pedal.value == 0) && (pedal.change_value & LOOPER)) {
+				// looper pedal released: short press records or toggles overdub, long press removes last overdub or clears loop;
+				// very long press while transport is stopped saves the groovebox dumps to the USB stick instead
+				if (pedal.change_time >= STICK_FUNCTION && stick_idle ()) backup_start ();
+				else if (pedal.change_time >= EXIT_FUNCTION) {
+					looper_undo ();
+					index_tx += looper_stop (midi_tx + index_tx, MIDI_BUF_SIZE - index_tx);
+				}
+				else looper_press ();
+			}
+
+			if ((pedal.value == 0) && (pedal.change_value & MOD)) {
+				// modulation pedal released: short press turns modulation on / off (lanes go back to their rest value when
+				// stopped), long press turns bass pedal mode on / off; very long press while transport is stopped sends the
+				// SysEx files of the RESTORE folder of the USB stick to the groovebox instead (it overwrites its sessions)
+				if (pedal.change_time >= STICK_FUNCTION && stick_idle ()) restore_start (RESTORE_RATE, RESTORE_GAP);
+				else if (pedal.change_time >= EXIT_FUNCTION) {
+					bass_enable (!bass_enabled ());
+					printf ("Bass pedals %s\r\n", bass_enabled () ? "on" : "off");
+				}
+				else if (mod_running ()) mod_stop ();
+				else mod_start ();
+			}
 		}
 
 
-		// send midi clock if required
-		if (send_clock (time_to_send_next_clock)) time_to_send_next_clock = time_of_last_clock + time_interval_between_ticks;
-		// if some data is present, send midi data and flush buffer
-		if (index_tx) {
-			send_midi (midi_tx, index_tx);
-			index_tx = 0;
+		// end of tap tempo sequence: its last tap is the downbeat
+		if (TAP_DOWNBEAT && tap_sequence && !pedal.value) {
+			this_press = to_us_since_boot (get_absolute_time());
+			if (this_press - previous_press > (uint64_t) (tapped_interval * NB_TICKS * TAP_SEQUENCE_END)) {
+				clock_downbeat (previous_press);
+				tap_sequence = false;
+			}
+		}
+
+		// send midi clock and time code if required
+		realtime_task ();
+		// follow tempo and phase of audio input
+		if (audio_task (&beat_period, &beat_time)) clock_follow (beat_period, beat_time);
+		// follow tempo and phase of drum triggers
+		if (drum_follow) {
+			drum_follow = false;
+			clock_follow (drum_period, drum_beat_time);
+		}
+		// mount a newly plugged USB stick; backups and restores are started from the LOOPER and MOD pedals
+		stick_task ();
+		index_tx += backup_task (to_us_since_boot (get_absolute_time()), midi_tx + index_tx, MIDI_BUF_SIZE - index_tx);
+		restore_task (connected ? midi_dev_addr : 0, to_us_since_boot (get_absolute_time()));
+
+		// transport as seen by the rest of this iteration
+		state = transport_state ();
+
+		// tempo map of current setlist entry, or of current session without setlist; followed from start of song
+		owner = config_nb_songs () ? setlist_index : (state & TRANSPORT_SONG);
+		if (owner != tempo_owner) {
+			tempo_owner = owner;
+			count = config_tempo_map (owner, config_nb_songs () == 0, &tempos);
+			tempo_map_load (tempos, count, NB_TICKS * settings->beats_per_bar);
+			tempo_map_suspended = false;
+			if (!(state & TRANSPORT_PLAY) && (interval = tempo_map_start ()) != 0) {
+				set_tapped_interval (interval);
+			}
+		}
+
+		// midi file of current session: opened while transport is stopped, then read ahead while it plays
+		if (!stick_ready ()) {
+			if (smf_ready ()) smf_close ();
+			smf_song = 0xFF;
+		}
+		else if (!(state & TRANSPORT_PLAY) && smf_song != (state & TRANSPORT_SONG)) {
+			smf_song = state & TRANSPORT_SONG;
+			snprintf (smf_path, sizeof (smf_path), SMF_PATH, (unsigned) smf_song + 1);
+			if (smf_open (smf_path)) printf ("Midi file %s\r\n", smf_path);
+		}
+		if (!(state & TRANSPORT_PLAY)) {
+			index_tx += smf_stop (midi_tx + index_tx, MIDI_BUF_SIZE - index_tx);
+			index_tx += looper_stop (midi_tx + index_tx, MIDI_BUF_SIZE - index_tx);
+		}
+		smf_task ();
+
+		// recording of groovebox midi, one file per song played; timestamps need the pedal clock
+		if ((state & TRANSPORT_PLAY) && !recording) {
+			recording = true;
+			record_interval = time_interval_between_ticks;
+			if (RECORD && time_to_send_next_clock != 0xffffffffffffffff) record_start (state & TRANSPORT_SONG, record_interval * NB_TICKS, settings->beats_per_bar);
+		}
+		else if (!(state & TRANSPORT_PLAY) && recording) {
+			recording = false;
+			record_stop (song_position (to_us_since_boot (get_absolute_time())));
+		}
+		if (recording && record_interval != time_interval_between_ticks) {
+			record_interval = time_interval_between_ticks;
+			record_tempo (song_position (to_us_since_boot (get_absolute_time())), record_interval * NB_TICKS);
+		}
+		record_task ();
+
+		// report jitter of incoming versus re-clocked midi clock
+		if (DEBUG_STATS && reclock_stats (&jitter)) {
+			printf("Re-clock: period %lu us, jitter in max %lu mean %lu us, jitter out max %lu mean %lu us\r\n",
+				(unsigned long) jitter.period, (unsigned long) jitter.in_max, (unsigned long) jitter.in_mean,
+				(unsigned long) jitter.out_max, (unsigned long) jitter.out_mean);
+		}
+
+		// report latency of bass pedal notes, from switch edge to USB flush
+		if (DEBUG_STATS && bass_stats (&latency)) {
+			printf("Bass pedals: latency max %lu mean %lu us, %lu over %u us\r\n", (unsigned long) latency.max,
+				(unsigned long) latency.mean, (unsigned long) latency.late, BASS_LATENCY_LIMIT);
+		}
+
+		// update led ring and OLED screen (frames are sent in the background)
+		show_status ();
+		// if some data is present, send midi data and flush buffer; while a restore is in the middle of a SysEx message,
+		// only realtime bytes go and the rest waits
+		if (index_tx && (lg = restore_sendable (midi_tx, index_tx)) != 0) {
+			sync_out_relay (midi_tx, lg);
+			send_midi (midi_tx, lg);
+			index_tx -= lg;
+			memmove (midi_tx, midi_tx + lg, index_tx);
 		}
 
 		// read MIDI events coming from groovebox and manage accordingly
@@ -371,14 +1035,42 @@ int main() {
 // therefore report_desc = NULL, desc_len = 0
 void tuh_midi_mount_cb(uint8_t dev_addr, uint8_t in_ep, uint8_t out_ep, uint8_t num_cables_rx, uint16_t num_cables_tx)
 {
+	const struct config_device * profile;
+	uint16_t vid, pid;
+
 	printf("MIDI device address = %u, IN endpoint %u has %u cables, OUT endpoint %u has %u cables\r\n",
 		dev_addr, in_ep & 0xf, num_cables_rx, out_ep & 0xf, num_cables_tx);
 
-	if (midi_dev_addr == 0) {
+	// device profile from configuration image: role of the device, whatever the order of connection
+	tuh_vid_pid_get (dev_addr, &vid, &pid);
+	profile = config_device (vid, pid);
+
+	if (profile && profile->role == CONFIG_ROLE_IGNORE) {
+		printf("MIDI device %04x:%04x is ignored by configuration\r\n", vid, pid);
+	}
+
+	else if (profile && profile->role == CONFIG_ROLE_DRUMS) {
+		if (drum_dev_addr == 0) {
+			drum_dev_addr = dev_addr;
+			drum_channel = (profile->channel == 255) ? settings->drum_channel : profile->channel;
+			drums_init (0);
+			printf("MIDI device address = %u is used as drum trigger input\r\n", dev_addr);
+		}
+	}
+
+	else if (midi_dev_addr == 0) {
 		// then no MIDI device is currently connected
 		midi_dev_addr = dev_addr;
 	}
 
+	else if (DRUM_FOLLOW && drum_dev_addr == 0 && profile == NULL) {
+		// a 2nd MIDI device is used as drum trigger input
+		drum_dev_addr = dev_addr;
+		drum_channel = settings->drum_channel;
+		drums_init (0);
+		printf("MIDI device address = %u is used as drum trigger input\r\n", dev_addr);
+	}
+
 	else {
 		printf("A different USB MIDI Device is already connected.\r\nOnly one device at a time is supported in this program\r\nDevice is disabled\r\n");
 	}
@@ -391,6 +1083,10 @@ void tuh_midi_umount_cb(uint8_t dev_addr, uint8_t instance)
 		midi_dev_addr = 0;
 		printf("MIDI device address = %d, instance = %d is unmounted\r\n", dev_addr, instance);
 	}
+	else if (dev_addr == drum_dev_addr) {
+		drum_dev_addr = 0;
+		printf("Drum trigger MIDI device address = %d, instance = %d is unmounted\r\n", dev_addr, instance);
+	}
 	else {
 		printf("Unused MIDI device address = %d, instance = %d is unmounted\r\n", dev_addr, instance);
 	}
@@ -403,37 +1099,66 @@ void tuh_midi_rx_cb(uint8_t dev_addr, uint32_t num_packets)
 	uint8_t *buffer;
 	uint32_t i;
 	uint32_t bytes_read;
+	uint64_t now;
 
 	// set midi_rx as buffer
 	buffer = midi_rx;
-	
+
+	// drum trigger input: kick and snare note-ons drive the drum follower, everything else is ignored
+	if (drum_dev_addr == dev_addr) {
+		now = to_us_since_boot (get_absolute_time());
+		while ((bytes_read = tuh_midi_stream_read(dev_addr, &cable_num, buffer, MIDI_RX_SIZE)) != 0) {
+			// status bytes cannot be confused with data bytes (< 0x80), so note-ons can be searched byte by byte
+			for (i = 0; i + 2 < bytes_read; i++) {
+				if ((buffer [i] == (0x90 | drum_channel)) && (buffer [i+2] != 0)) {
+					if (drums_note (buffer [i+1], now, &drum_period, &drum_beat_time)) drum_follow = true;
+				}
+			}
+		}
+		return;
+	}
+
 	if (midi_dev_addr == dev_addr)
 	{
+		// reception time of midi clock, for the re-clocker
+		now = to_us_since_boot (get_absolute_time());
 		if (num_packets != 0)
 		{
 			while (1) {
-				bytes_read = tuh_midi_stream_read(dev_addr, &cable_num, buffer, MIDI_BUF_SIZE);
+				bytes_read = tuh_midi_stream_read(dev_addr, &cable_num, buffer, MIDI_RX_SIZE);
 				if (bytes_read == 0) return;
 				if (cable_num == 0) {
+					// SysEx dumps go straight to the USB stick during a backup
+					backup_rx (buffer, bytes_read, now);
+					// performance is recorded to the USB stick while a song plays
+					record_rx (buffer, bytes_read, song_position (now));
+					looper_rx (buffer, bytes_read, song_position (now));
 					i = 0;
 					while (i < bytes_read) {
 						// test values received from groovebox via MIDI
 						switch (buffer [i]) {
-// This part is not needed as when we receive MIDI CLOCK signals from Novation Circuit, we cannot resend them
-// to the Novation Circuit device
-//							case MIDI_CLOCK:
+							// MIDI CLOCK signals from Novation Circuit cannot be resent to the Novation Circuit device,
+							// but they are re-clocked to DIN and analog outputs when the pedal clock is not running
+							case MIDI_CLOCK:
+								if (RECLOCK && time_to_send_next_clock == 0xffffffffffffffff) reclock_input (now);
+								break;
 							case MIDI_CONTINUE:
-								pause = true;
+								sync_out_byte (MIDI_CONTINUE);
+								transport_set (0, TRANSPORT_PAUSE);
+								mtc_continue (to_us_since_boot (get_absolute_time()));
 								break;
 							case MIDI_PLAY:
-								play = true;
+								sync_out_byte (MIDI_PLAY);
+								transport_set (0, TRANSPORT_PLAY);
+								mtc_start (to_us_since_boot (get_absolute_time()), 0);
 								break;
 							case MIDI_STOP:
-								play = false;
-								pause = false;
+								sync_out_byte (MIDI_STOP);
+								transport_set (TRANSPORT_ACTIVE, 0);
+								mtc_stop ();
 								break;
 							case MIDI_PRG_CHANGE:
-								if (buffer [i+1] <= 31) song = buffer [i+1];		// make sure song number is inside boudaries (0 to 31)
+								if (buffer [i+1] < settings->sessions) transport_set (TRANSPORT_SONG, buffer [i+1]);		// make sure song number is inside boudaries (0 to sessions - 1)
 								break;
 						}
 						switch (buffer [i] & 0xF0) {	// control only most significant nibble to increment index in buffer; event sorting is approximative, but should be enough
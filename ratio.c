@@ -0,0 +1,90 @@
+/**
+ * @file ratio.c
+ * @brief Clock divider / multiplier with fractional ratios (3:2, 4:3...), derived from the master tick schedule
+ *
+ * Output tick k is at master position k * den / num. Positions are kept exact, in 1/num of master tick, relative to the
+ * current master tick: on each master tick, output ticks at position 0 are sent right away, and those between 0 and num
+ * (before next master tick) are scheduled at time + position * interval / num. Over any number of master ticks the
+ * output count is exact, so outputs never drift from the master or from each other. Each master tick costs at most
+ * ceil(num / den) iterations, whatever the tempo, and only integer arithmetic is used.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include "ratio.h"
+
+
+// set ratio "num:den" (output ticks : master ticks), each between 1 and RATIO_MAX; output tick 0 is on master tick 0
+void ratio_init (struct clock_ratio * ratio, uint32_t num, uint32_t den)
+{
+	if (num < 1) num = 1;
+	if (num > RATIO_MAX) num = RATIO_MAX;
+	if (den < 1) den = 1;
+	if (den > RATIO_MAX) den = RATIO_MAX;
+
+	ratio->num = num;
+	ratio->den = den;
+	ratio_reset (ratio);
+}
+
+
+// restart ratio so that next master tick is also an output tick (eg. on MIDI_PLAY)
+void ratio_reset (struct clock_ratio * ratio)
+{
+	ratio->next = 0;
+	ratio->pending = 0;
+	ratio->first = 0;
+}
+
+
+// master tick sent at "time", next master tick expected "interval" (usec) later: returns the number of output ticks to send now,
+// and schedules the output ticks falling between this master tick and the next one
+uint32_t ratio_tick (struct clock_ratio * ratio, uint64_t time, uint32_t interval)
+{
+	uint32_t now = 0;
+
+	// output ticks scheduled before this master tick and not sent yet (tempo went up): send them now, never lose a tick
+	now += ratio->pending;
+	ratio->pending = 0;
+	ratio->first = 0;
+
+	// output ticks from this master tick up to next one
+	while (ratio->next < ratio->num) {
+		if (ratio->next == 0) now++;
+		else ratio->due [ratio->pending++] = time + ((uint64_t) ratio->next * interval) / ratio->num;
+		ratio->next += ratio->den;
+	}
+
+	// positions become relative to next master tick
+	ratio->next -= ratio->num;
+	return now;
+}
+
+
+// returns true if a scheduled output tick is due at "now" (usec), and takes it
+bool ratio_due (struct clock_ratio * ratio, uint64_t now)
+{
+	if (!ratio_peek (ratio, now)) return false;
+	ratio_take (ratio);
+	return true;
+}
+
+
+// returns true if a scheduled output tick is due at "now" (usec), without taking it: it stays due until ratio_take (),
+// so that a tick that could not be written yet is not lost
+bool ratio_peek (const struct clock_ratio * ratio, uint64_t now)
+{
+	return ratio->pending != 0 && now >= ratio->due [ratio->first];
+}
+
+
+// take the output tick found due by ratio_peek (), once it has been written
+void ratio_take (struct clock_ratio * ratio)
+{
+	if (ratio->pending == 0) return;
+	ratio->first++;
+	ratio->pending--;
+}
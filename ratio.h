@@ -0,0 +1,51 @@
+/**
+ * @file ratio.h
+ * @brief Clock divider / multiplier with fractional ratios (3:2, 4:3...), derived from the master tick schedule
+ *
+ * Output counts, spacing and realignment of every ratio: tools/hosttest/test_ratio.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _RATIO_H_
+#define _RATIO_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define RATIO_MAX	16		// maximum value of numerator and denominator
+
+// clock ratio state: output sends "num" ticks for every "den" master ticks
+struct clock_ratio {
+	uint32_t num;
+	uint32_t den;
+	uint32_t next;						// position of next output tick after current master tick, in 1/num of master tick
+	uint32_t pending;					// number of output ticks scheduled between master ticks, not sent yet
+	uint32_t first;						// index of first of them in "due"
+	uint64_t due [RATIO_MAX];			// times (usec) of scheduled output ticks
+};
+
+// set ratio "num:den" (output ticks : master ticks), each between 1 and RATIO_MAX; output tick 0 is on master tick 0
+void ratio_init (struct clock_ratio * ratio, uint32_t num, uint32_t den);
+
+// restart ratio so that next master tick is also an output tick (eg. on MIDI_PLAY)
+void ratio_reset (struct clock_ratio * ratio);
+
+// master tick sent at "time", next master tick expected "interval" (usec) later: returns the number of output ticks to send now,
+// and schedules the output ticks falling between this master tick and the next one
+uint32_t ratio_tick (struct clock_ratio * ratio, uint64_t time, uint32_t interval);
+
+// returns true if a scheduled output tick is due at "now" (usec), and takes it
+bool ratio_due (struct clock_ratio * ratio, uint64_t now);
+
+// returns true if a scheduled output tick is due at "now" (usec), without taking it: it stays due until ratio_take (),
+// so that a tick that could not be written yet is not lost
+bool ratio_peek (const struct clock_ratio * ratio, uint64_t now);
+
+// take the output tick found due by ratio_peek (), once it has been written
+void ratio_take (struct clock_ratio * ratio);
+
+#endif /* _RATIO_H_ */
@@ -0,0 +1,149 @@
+/**
+ * @file reclock.c
+ * @brief Re-clocker: follows an incoming (jittery) midi clock with a PLL, and regenerates evenly spaced ticks
+ *
+ * The PLL is a 2nd order loop in fixed point (usec Q8): for each incoming tick, the error between its arrival time
+ * and the predicted time corrects the phase by PHASE_SHIFT and the period by PERIOD_SHIFT.
+ * Each incoming tick schedules one regenerated tick at its filtered time plus RECLOCK_DELAY, so no tick is ever
+ * lost or added, and regenerated ticks come out with the jitter of the filtered times, not the jitter of USB.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include "reclock.h"
+
+#define PHASE_SHIFT		3			// phase gain: 1/8 of error
+#define PERIOD_SHIFT	7			// period gain: 1/128 of error (loop damping about 0.7)
+#define QUEUE_SIZE		8			// regenerated ticks waiting to be sent; power of 2
+#define QUEUE_MASK		(QUEUE_SIZE - 1)
+#define MAX_GAP			4			// input is considered stopped after this number of periods without tick
+
+// globals
+static uint32_t in_count = 0;			// number of incoming ticks since start (or restart after a stop)
+static uint64_t last_in = 0;			// arrival time of last incoming tick (usec)
+static int64_t period = 0;				// tick period (usec Q8)
+static int64_t estimate = 0;			// filtered time of last incoming tick (usec Q8)
+static uint64_t queue [QUEUE_SIZE];		// times of regenerated ticks to send (usec)
+static uint32_t queue_in = 0, queue_out = 0;
+static uint64_t last_out = 0;			// time of last regenerated tick (usec)
+static uint32_t out_count = 0;
+
+// jitter measurement window
+static uint32_t window_ticks = 0;
+static uint32_t in_max = 0, out_max = 0;
+static uint64_t in_sum = 0, out_sum = 0;
+static bool stats_ready = false;
+static struct reclock_stats last_stats;
+
+
+// absolute deviation of an interval (usec) from current period
+static uint32_t deviation (uint64_t interval)
+{
+	int64_t d = (int64_t) interval - (period >> 8);
+	return (uint32_t) (d < 0 ? -d : d);
+}
+
+
+// reset re-clocker
+void reclock_init (void)
+{
+	in_count = 0;
+	out_count = 0;
+	period = 0;
+	queue_in = queue_out = 0;
+	window_ticks = 0;
+	in_max = out_max = 0;
+	in_sum = out_sum = 0;
+	stats_ready = false;
+}
+
+
+// incoming clock tick received at "time" (usec)
+void reclock_input (uint64_t time)
+{
+	int64_t predicted, error;
+	uint32_t d;
+
+	// input stopped for a while: start again, as after a reset
+	if (in_count >= 2 && time - last_in > (uint64_t) ((period >> 8) * MAX_GAP)) in_count = 0;
+
+	if (in_count == 0) {
+		estimate = (int64_t) time << 8;
+	}
+	else if (in_count == 1) {
+		period = (int64_t) (time - last_in) << 8;
+		estimate = (int64_t) time << 8;
+	}
+	else {
+		// several ticks read at once (late USB polling): their arrival time says nothing, assume they are on time
+		if (time - last_in < (uint64_t) ((period >> 8) / 4)) time = (estimate + period) >> 8;
+
+		d = deviation (time - last_in);
+		if (d > in_max) in_max = d;
+		in_sum += d;
+
+		predicted = estimate + period;
+		error = ((int64_t) time << 8) - predicted;
+		estimate = predicted + (error >> PHASE_SHIFT);
+		period += error >> PERIOD_SHIFT;
+	}
+	last_in = time;
+	in_count++;
+
+	// one regenerated tick per incoming tick, at fixed delay after filtered time
+	if (queue_in - queue_out < QUEUE_SIZE) {
+		queue [queue_in & QUEUE_MASK] = (uint64_t) (estimate >> 8) + RECLOCK_DELAY;
+		queue_in++;
+	}
+}
+
+
+// returns true if a regenerated tick is due at "now" (usec); to be called as often as possible
+bool reclock_output (uint64_t now)
+{
+	uint32_t d;
+
+	if (queue_in == queue_out || now < queue [queue_out & QUEUE_MASK]) return false;
+	queue_out++;
+
+	// jitter measurement: only while PLL is running
+	if (out_count != 0 && in_count > 2) {
+		d = deviation (now - last_out);
+		if (d > out_max) out_max = d;
+		out_sum += d;
+		if (++window_ticks >= RECLOCK_STATS_TICKS) {
+			last_stats.period = (uint32_t) (period >> 8);
+			last_stats.in_max = in_max;
+			last_stats.in_mean = (uint32_t) (in_sum / window_ticks);
+			last_stats.out_max = out_max;
+			last_stats.out_mean = (uint32_t) (out_sum / window_ticks);
+			stats_ready = true;
+			window_ticks = 0;
+			in_max = out_max = 0;
+			in_sum = out_sum = 0;
+		}
+	}
+	last_out = now;
+	out_count++;
+	return true;
+}
+
+
+// tick period followed by the PLL (usec); 0 until 2 ticks have been received
+uint32_t reclock_period (void)
+{
+	return (in_count >= 2) ? (uint32_t) (period >> 8) : 0;
+}
+
+
+// returns true once every RECLOCK_STATS_TICKS regenerated ticks, with jitter measurements of the window
+bool reclock_stats (struct reclock_stats * stats)
+{
+	if (!stats_ready) return false;
+	*stats = last_stats;
+	stats_ready = false;
+	return true;
+}
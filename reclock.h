@@ -0,0 +1,46 @@
+/**
+ * @file reclock.h
+ * @brief Re-clocker: follows an incoming (jittery) midi clock with a PLL, and regenerates evenly spaced ticks
+ *
+ * Jitter in and out for a clock read through USB: tools/hosttest/test_reclock.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _RECLOCK_H_
+#define _RECLOCK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define RECLOCK_DELAY		3000		// fixed delay between incoming and regenerated ticks (usec); must be above input jitter
+#define RECLOCK_STATS_TICKS	(24 * 4 * 8)	// jitter measurement window: 8 bars
+
+// jitter measurements over a window: deviation of tick intervals from the period followed by the PLL
+struct reclock_stats {
+	uint32_t period;			// tick period at end of window (usec)
+	uint32_t in_max;			// maximum deviation of incoming tick intervals (usec)
+	uint32_t in_mean;			// mean absolute deviation of incoming tick intervals (usec)
+	uint32_t out_max;			// maximum deviation of regenerated tick intervals (usec)
+	uint32_t out_mean;			// mean absolute deviation of regenerated tick intervals (usec)
+};
+
+// reset re-clocker
+void reclock_init (void);
+
+// incoming clock tick received at "time" (usec)
+void reclock_input (uint64_t time);
+
+// returns true if a regenerated tick is due at "now" (usec); to be called as often as possible
+bool reclock_output (uint64_t now);
+
+// tick period followed by the PLL (usec); 0 until 2 ticks have been received
+uint32_t reclock_period (void);
+
+// returns true once every RECLOCK_STATS_TICKS regenerated ticks, with jitter measurements of the window
+bool reclock_stats (struct reclock_stats * stats);
+
+#endif /* _RECLOCK_H_ */
@@ -0,0 +1,246 @@
+/**
+ * @file record.c
+ * @brief Recording of midi received from the groovebox to Standard MIDI Files on the USB stick
+ *
+ * Received channel messages are timestamped with the song position of the pedal clock, and encoded as type 0 SMF
+ * events into a small ring of sector-sized chunks by the midi receive callback. The main loop writes full chunks to
+ * the file in the background. The SMF header is the start of the first chunk, so every write but the last one covers
+ * exactly one sector at a sector-aligned offset of the file, which FatFs sends to the stick without copying it.
+ * The length of the track is only known at the end: it is written over its placeholder when recording stops.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "ff.h"
+#include "stick.h"
+#include "record.h"
+
+#define CLOCK_PPQN		24
+#define RECORD_FOLDER	"0:/REC"
+#define RECORD_TAKES	1000		// REC/S01_000.MID to REC/S01_999.MID for first session
+#define PATH_SIZE		32
+#define HEADER_SIZE		22			// MThd chunk, and MTrk chunk header
+#define LENGTH_OFFSET	18			// offset of track length in file
+#define EVENT_SIZE		8			// largest event: delta (4 bytes), and meta event or channel message
+
+// states
+#define STATE_IDLE		0
+#define STATE_RECORD	1			// events are being recorded
+#define STATE_STOP		2			// last chunks are being written
+
+// globals
+static int state = STATE_IDLE;
+static FIL file;
+static uint8_t * chunks [RECORD_CHUNKS];			// taken from the sector pool while recording
+static uint32_t write_chunk = 0;		// oldest full chunk, next to be written
+static uint32_t ready = 0;				// number of full chunks; chunk being filled is the one after them
+static uint32_t fill = 0;				// bytes in chunk being filled
+static uint32_t last_tick = 0;			// tick of last recorded event
+static uint8_t message [3];				// channel message being received
+static uint32_t message_lg = 0;			// bytes of message received so far; 0 if none
+static uint32_t file_bytes = 0;			// bytes written to file
+static uint32_t lost = 0;				// events lost because the stick was too slow
+
+
+// append "lg" bytes to chunk being filled
+static void put (const uint8_t * data, uint32_t lg)
+{
+	uint32_t i;
+
+	for (i = 0; i < lg; i++) {
+		chunks [(write_chunk + ready) % RECORD_CHUNKS][fill++] = data [i];
+		if (fill == RECORD_CHUNK) {
+			ready++;
+			fill = 0;
+		}
+	}
+}
+
+
+// append event "data" of "lg" bytes at "position", preceded by its delta time; the event is lost if it does not fit.
+// Room for one more event is kept for the end of track, which is the "last" event
+static void put_event (uint32_t position, const uint8_t * data, uint32_t lg, bool last)
+{
+	uint8_t event [EVENT_SIZE];
+	uint32_t tick, delta, n = 0, shift;
+
+	// room left: free chunks, and end of chunk being filled
+	if (ready == RECORD_CHUNKS || (RECORD_CHUNKS - ready) * RECORD_CHUNK - fill < (last ? EVENT_SIZE : 2 * EVENT_SIZE)) {
+		lost++;
+		return;
+	}
+
+	// events are in reception order: an event timestamped before the last one (eg. during count-in) gets a delta of 0
+	tick = (uint32_t) (((uint64_t) position * RECORD_DIVISION) / (CLOCK_PPQN * 256));
+	delta = (tick > last_tick) ? tick - last_tick : 0;
+	if (delta > 0x0FFFFFFF) delta = 0x0FFFFFFF;
+	last_tick += delta;
+
+	// variable length quantity, most significant group first
+	for (shift = 21; shift > 0 && (delta >> shift) == 0; shift -= 7);
+	for (; shift > 0; shift -= 7) event [n++] = 0x80 | ((delta >> shift) & 0x7F);
+	event [n++] = delta & 0x7F;
+
+	memcpy (event + n, data, lg);
+	put (event, n + lg);
+}
+
+
+// write "lg" bytes of chunk "index" to file
+static void write_chunk_to_file (uint32_t index, uint32_t lg)
+{
+	UINT written = 0;
+
+	if (f_write (&file, chunks [index], lg, &written) != FR_OK || written != lg) printf ("Record: write error\r\n");
+	file_bytes += written;
+}
+
+
+// start recording session "song" into a new file of the stick, at tempo "usec_per_quarter" and with "beats_per_bar";
+// returns false if there is no stick, or a recording is running. To be called from the main loop, since the stick waits
+bool record_start (uint8_t song, uint32_t usec_per_quarter, uint8_t beats_per_bar)
+{
+	char path [PATH_SIZE];
+	uint32_t n;
+	FRESULT result = FR_EXIST;
+	// type 0, 1 track, RECORD_DIVISION ticks per quarter note; track length is written when recording stops
+	const uint8_t header [HEADER_SIZE] = { 'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1, RECORD_DIVISION >> 8, RECORD_DIVISION & 0xFF,
+		'M', 'T', 'r', 'k', 0, 0, 0, 0 };
+	const uint8_t signature [7] = { 0xFF, 0x58, 0x04, beats_per_bar, 2, CLOCK_PPQN, 8 };		// beats_per_bar/4
+
+	if (!stick_ready () || state != STATE_IDLE) return false;
+	if (!arena_get_blocks (ARENA_POOL_sector, chunks, RECORD_CHUNKS)) {
+		printf ("Record: no free buffer\r\n");
+		return false;
+	}
+
+	f_mkdir (RECORD_FOLDER);
+	for (n = 0; n < RECORD_TAKES && result == FR_EXIST; n++) {
+		snprintf (path, PATH_SIZE, "%s/S%02u_%03lu.MID", RECORD_FOLDER, (unsigned) song + 1, (unsigned long) n);
+		result = f_open (&file, path, FA_CREATE_NEW | FA_WRITE);
+	}
+	if (result != FR_OK) {
+		printf ("Record: cannot create file\r\n");
+		arena_put_blocks (ARENA_POOL_sector, chunks, RECORD_CHUNKS);
+		return false;
+	}
+
+	write_chunk = 0;
+	ready = 0;
+	fill = 0;
+	last_tick = 0;
+	message_lg = 0;
+	file_bytes = 0;
+	lost = 0;
+	put (header, HEADER_SIZE);
+	put_event (0, signature, sizeof (signature), false);
+	state = STATE_RECORD;
+	record_tempo (0, usec_per_quarter);
+	printf ("Record to %s\r\n", path);
+	return true;
+}
+
+
+// tempo change at "position" (1/256 of clock tick, 24 PPQN, from start of song)
+void record_tempo (uint32_t position, uint32_t usec_per_quarter)
+{
+	const uint8_t tempo [6] = { 0xFF, 0x51, 0x03, (usec_per_quarter >> 16) & 0xFF, (usec_per_quarter >> 8) & 0xFF, usec_per_quarter & 0xFF };
+
+	if (state == STATE_RECORD) put_event (position, tempo, sizeof (tempo), false);
+}
+
+
+// midi bytes received from the groovebox at "position"; channel messages are recorded, realtime, system and SysEx
+// messages are ignored. To be called from midi receive callback
+void record_rx (const uint8_t * buffer, uint32_t lg, uint32_t position)
+{
+	uint32_t i;
+	uint8_t byte;
+
+	if (state != STATE_RECORD) return;
+
+	for (i = 0; i < lg; i++) {
+		byte = buffer [i];
+		if (byte >= 0xF8) continue;			// realtime, may appear anywhere
+		if (byte >= 0xF0) {
+			message_lg = 0;					// system message or SysEx: skipped up to next channel message
+			continue;
+		}
+		if (byte & 0x80) {
+			message [0] = byte;
+			message_lg = 1;
+			continue;
+		}
+		if (message_lg == 0) continue;		// data without status
+
+		// running status is kept, so that a following message can reuse it
+		message [message_lg++] = byte;
+		if (message_lg == ((((message [0] & 0xF0) == 0xC0) || ((message [0] & 0xF0) == 0xD0)) ? 2 : 3)) {
+			put_event (position, message, message_lg, false);
+			message_lg = 1;
+		}
+	}
+}
+
+
+// end recording at "position": the file is completed and closed by the next calls to record_task ()
+void record_stop (uint32_t position)
+{
+	const uint8_t end [3] = { 0xFF, 0x2F, 0x00 };
+
+	if (state != STATE_RECORD) return;
+
+	put_event (position, end, sizeof (end), true);
+	state = STATE_STOP;
+}
+
+
+// write buffered chunks to the stick; to be called from the main loop, since writing to the stick waits
+void record_task (void)
+{
+	uint8_t length [4];
+	uint32_t track;
+	UINT written = 0;
+
+	if (state == STATE_IDLE) return;
+	if (!stick_ready ()) {
+		printf ("Record: stick removed\r\n");
+		state = STATE_IDLE;
+		arena_put_blocks (ARENA_POOL_sector, chunks, RECORD_CHUNKS);
+		return;
+	}
+
+	// one full chunk per call, so that the main loop keeps running during long recordings
+	if (ready) {
+		write_chunk_to_file (write_chunk, RECORD_CHUNK);
+		write_chunk = (write_chunk + 1) % RECORD_CHUNKS;
+		ready--;
+		return;
+	}
+	if (state != STATE_STOP) return;
+
+	// last chunk, then track length over its placeholder
+	if (fill) write_chunk_to_file (write_chunk, fill);
+	track = file_bytes - HEADER_SIZE;
+	length [0] = track >> 24;
+	length [1] = track >> 16;
+	length [2] = track >> 8;
+	length [3] = track;
+	if (f_lseek (&file, LENGTH_OFFSET) != FR_OK || f_write (&file, length, 4, &written) != FR_OK || written != 4) printf ("Record: write error\r\n");
+	f_close (&file);
+	state = STATE_IDLE;
+	arena_put_blocks (ARENA_POOL_sector, chunks, RECORD_CHUNKS);
+	printf ("Record done: %lu bytes, %lu events lost\r\n", (unsigned long) file_bytes, (unsigned long) lost);
+}
+
+
+// returns true if a recording is running, or being completed
+bool record_running (void)
+{
+	return state != STATE_IDLE;
+}
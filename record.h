@@ -0,0 +1,41 @@
+/**
+ * @file record.h
+ * @brief Recording of midi received from the groovebox to Standard MIDI Files on the USB stick
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _RECORD_H_
+#define _RECORD_H_
+
+#include "pico/stdlib.h"
+#include "arena.h"
+
+#define RECORD_CHUNK		ARENA_SECTOR			// bytes written to the stick at once: one sector
+#define RECORD_CHUNKS		ARENA_SECTORS_PER_USER	// chunks buffered while the stick is busy, taken from the sector pool
+#define RECORD_DIVISION		96			// ticks per quarter note of recorded files: 1/4 of clock tick
+
+// start recording session "song" into a new file of the stick, at tempo "usec_per_quarter" and with "beats_per_bar";
+// returns false if there is no stick, or a recording is running. To be called from the main loop, since the stick waits
+bool record_start (uint8_t song, uint32_t usec_per_quarter, uint8_t beats_per_bar);
+
+// tempo change at "position" (1/256 of clock tick, 24 PPQN, from start of song)
+void record_tempo (uint32_t position, uint32_t usec_per_quarter);
+
+// midi bytes received from the groovebox at "position"; channel messages are recorded, realtime, system and SysEx
+// messages are ignored. To be called from midi receive callback
+void record_rx (const uint8_t * buffer, uint32_t lg, uint32_t position);
+
+// end recording at "position": the file is completed and closed by the next calls to record_task ()
+void record_stop (uint32_t position);
+
+// write buffered chunks to the stick; to be called from the main loop, since writing to the stick waits
+void record_task (void);
+
+// returns true if a recording is running, or being completed
+bool record_running (void);
+
+#endif /* _RECORD_H_ */
@@ -0,0 +1,276 @@
+/**
+ * @file restore.c
+ * @brief Restore of SysEx files from the USB stick to the groovebox, double-buffered and paced
+ *
+ * Files are read one sector at a time into 2 buffers: the next sector is read when a write comes back short (the USB
+ * host task drains the full endpoint from the idle callback of the stick) or while pacing holds the next write back, so
+ * reads overlap sending instead of following it. Only the first sector of each file is read with the wire idle. Reads
+ * still wait for the stick (about 1 ms per sector): the realtime lane keeps running from the idle callback, the rest of
+ * the main loop waits. Sending goes up to the end of the current SysEx message at most, and is limited by pacing: a
+ * byte rate (token bucket) and a gap after each message. tuh_midi_stream_write () takes what fits in the USB endpoint;
+ * the rest of the buffer is sent on the next calls, from where the short write stopped.
+ *
+ * Inside a message, writes stop on a USB-MIDI packet boundary (3 bytes from its F0), so that realtime bytes sent
+ * meanwhile start a packet of their own; other midi bytes wait for the end of the message (restore_sendable ()).
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "ff.h"
+#include "tusb.h"
+#include "usb_midi_host.h"
+#include "stick.h"
+#include "restore.h"
+
+#define SYSEX_START		0xF0
+#define SYSEX_END		0xF7
+#define MIDI_REALTIME	0xF8		// first realtime byte (clock); realtime bytes may go inside a SysEx message
+#define PACKET_BYTES	3			// SysEx bytes per USB-MIDI packet
+#define NAME_SIZE		13			// 8.3 file name, and ending 0
+#define PATH_SIZE		32
+#define RATE_BURST		10000		// unused byte rate credit is kept for this time at most (usec)
+
+// states
+#define STATE_IDLE		0
+#define STATE_OPEN		1			// open next file
+#define STATE_SEND		2			// file is being sent
+
+// globals
+static int state = STATE_IDLE;
+static char names [RESTORE_FILES][NAME_SIZE];
+static FIL file;
+static bool end_of_file = false;
+static uint8_t * buffers [RESTORE_BUFFERS];			// taken from the sector pool while a restore runs
+static uint32_t lengths [RESTORE_BUFFERS];			// bytes in each buffer; 0 if buffer is empty
+static uint32_t current = 0;						// buffer being sent
+static uint32_t position = 0;						// next byte to send in current buffer
+static uint32_t message_bytes = 0;					// bytes of the SysEx message partly sent; 0 if none
+static uint32_t byte_rate = 0;						// pacing: bytes per second (0 for no limit), and gap after each message (usec)
+static uint32_t message_gap = 0;
+static uint64_t rate_time = 0;						// time up to which byte rate credit has been used (usec)
+static uint64_t resume_time = 0;					// end of gap after last message (usec)
+static struct restore_progress progress;
+
+
+// returns true if "name" ends with ".SYX"
+static bool is_sysex_file (const char * name)
+{
+	size_t lg = strlen (name);
+
+	return lg > 4 && (strcmp (name + lg - 4, ".SYX") == 0 || strcmp (name + lg - 4, ".syx") == 0);
+}
+
+
+// stop restore; a message left open is given up
+static void restore_end (void)
+{
+	if (state == STATE_SEND) f_close (&file);
+	state = STATE_IDLE;
+	message_bytes = 0;
+	arena_put_blocks (ARENA_POOL_sector, buffers, RESTORE_BUFFERS);
+	progress.running = false;
+	printf ("Restore done: %lu of %lu bytes\r\n", (unsigned long) progress.bytes, (unsigned long) progress.total);
+}
+
+
+// read next part of file into empty buffer "index"
+static void read_buffer (uint32_t index)
+{
+	UINT lg = 0;
+
+	if (f_read (&file, buffers [index], RESTORE_BUFFER, &lg) != FR_OK) lg = 0;
+	lengths [index] = lg;
+	if (lg < RESTORE_BUFFER) end_of_file = true;
+}
+
+
+// double buffering: the other buffer is read while the wire has something else to do, ie. the endpoint is full or
+// pacing holds the next bytes back
+static void read_ahead (void)
+{
+	if (lengths [current ^ 1] == 0 && !end_of_file) read_buffer (current ^ 1);
+}
+
+
+// start sending the files of RESTORE_FOLDER, at most "rate" bytes per second (0: as fast as USB takes them) and with
+// "gap" usec of silence after each SysEx message, so that receiver can store it; returns false if there is nothing to restore
+bool restore_start (uint32_t rate, uint32_t gap)
+{
+	DIR dir;
+	FILINFO info;
+	char name [NAME_SIZE];
+	uint32_t i, j;
+
+	if (!stick_ready () || state != STATE_IDLE) return false;
+	if (f_opendir (&dir, RESTORE_FOLDER) != FR_OK) return false;
+
+	memset (&progress, 0, sizeof (progress));
+	while (progress.files < RESTORE_FILES && f_readdir (&dir, &info) == FR_OK && info.fname [0] != 0) {
+		if ((info.fattrib & AM_DIR) || !is_sysex_file (info.fname)) continue;
+
+		// insert in name order: sessions and patches are restored in a predictable order
+		strncpy (name, info.fname, NAME_SIZE - 1);
+		name [NAME_SIZE - 1] = 0;
+		for (i = 0; i < progress.files && strcmp (names [i], name) < 0; i++);
+		for (j = progress.files; j > i; j--) strcpy (names [j], names [j - 1]);
+		strcpy (names [i], name);
+		progress.files++;
+		progress.total += info.fsize;
+	}
+	f_closedir (&dir);
+	if (progress.files == 0) return false;
+	if (!arena_get_blocks (ARENA_POOL_sector, buffers, RESTORE_BUFFERS)) {
+		printf ("Restore: no free buffer\r\n");
+		return false;
+	}
+
+	byte_rate = rate;
+	message_gap = gap;
+	message_bytes = 0;
+	progress.running = true;
+	state = STATE_OPEN;
+	printf ("Restore of %lu files, %lu bytes\r\n", (unsigned long) progress.files, (unsigned long) progress.total);
+	return true;
+}
+
+
+// send what pacing allows to midi device "dev_addr" (0 if it is gone: restore stops), and read the next part of file
+// while the previous one is sent; to be called from the main loop, since reading the stick waits
+void restore_task (uint8_t dev_addr, uint64_t now)
+{
+	char path [PATH_SIZE];
+	uint32_t lg, written, i, cut;
+	uint64_t credit;
+	bool last = false;
+
+	if (state == STATE_IDLE) return;
+	if (!stick_ready () || dev_addr == 0) {
+		restore_end ();
+		return;
+	}
+
+	if (state == STATE_OPEN) {
+		if (progress.file == progress.files) {
+			restore_end ();
+			return;
+		}
+		snprintf (path, PATH_SIZE, "%s/%s", RESTORE_FOLDER, names [progress.file]);
+		if (f_open (&file, path, FA_READ) != FR_OK) {
+			printf ("Restore: cannot open %s\r\n", path);
+			progress.file++;
+			return;
+		}
+		printf ("Restore: %s\r\n", names [progress.file]);
+		end_of_file = false;
+		lengths [1] = 0;
+		current = 0;
+		position = 0;
+		read_buffer (0);
+		rate_time = now;
+		state = STATE_SEND;
+	}
+
+	// current buffer is sent: go on with the other one, or with next file (a message left open by its file is given up)
+	if (position == lengths [current]) {
+		lengths [current] = 0;
+		read_ahead ();
+		if (lengths [current ^ 1] == 0) {
+			f_close (&file);
+			message_bytes = 0;
+			progress.file++;
+			state = STATE_OPEN;
+			return;
+		}
+		current ^= 1;
+		position = 0;
+	}
+
+	// pacing: gap after last message, then byte rate
+	if (now < resume_time) {
+		read_ahead ();
+		return;
+	}
+	lg = lengths [current] - position;
+	if (byte_rate) {
+		if ((int64_t) (now - rate_time) > RATE_BURST) rate_time = now - RATE_BURST;
+		credit = ((int64_t) (now - rate_time) > 0) ? ((now - rate_time) * byte_rate) / 1000000 : 0;
+		if (credit == 0) {
+			read_ahead ();
+			return;
+		}
+		if (lg > credit) lg = (uint32_t) credit;
+	}
+
+	// never past the end of a message, so that its gap can follow
+	for (i = 0; i < lg; i++) {
+		if (buffers [current][position + i] == SYSEX_END) {
+			lg = i + 1;
+			last = true;
+			break;
+		}
+	}
+
+	// inside a message, stop on a packet boundary; the bytes that complete a packet left open by a short write go
+	// out even if they are fewer than a packet. At the end of the buffer, the packet is completed from the next one
+	if (!last && position + lg < lengths [current] && (message_bytes || buffers [current][position] == SYSEX_START)) {
+		cut = (message_bytes + lg) % PACKET_BYTES;
+		if (cut <= lg) lg -= cut;
+		if (lg == 0) return;
+	}
+
+	// the endpoint may take only part of it: next call resumes from there
+	written = tuh_midi_stream_write (dev_addr, 0, &buffers [current][position], lg);
+	if (written == 0) {
+		read_ahead ();
+		return;
+	}
+	tuh_midi_stream_flush (dev_addr);
+	position += written;
+	progress.bytes += written;
+	if (byte_rate) rate_time += ((uint64_t) written * 1000000) / byte_rate;
+	if (buffers [current][position - 1] == SYSEX_END) {
+		message_bytes = 0;
+		resume_time = now + message_gap;
+	}
+	else if (message_bytes || buffers [current][position - written] == SYSEX_START) message_bytes += written;
+	if (written < lg) read_ahead ();
+}
+
+
+// returns true while a SysEx message is partly sent: other midi messages must wait, or they would land inside it
+bool restore_in_message (void)
+{
+	return message_bytes != 0;
+}
+
+
+// "buffer" of "lg" bytes is about to be sent to the midi device: moves the bytes that may go now to its start, the
+// others keep their order after them; returns the number of bytes that may go. All of them outside a SysEx message,
+// only realtime bytes inside one, and none while its last USB-MIDI packet is partly written
+uint32_t restore_sendable (uint8_t * buffer, uint32_t lg)
+{
+	uint32_t i, n = 0;
+	uint8_t byte;
+
+	if (message_bytes == 0) return lg;
+	if (message_bytes % PACKET_BYTES) return 0;
+	for (i = 0; i < lg; i++) {
+		if (buffer [i] < MIDI_REALTIME) continue;
+		byte = buffer [i];
+		memmove (buffer + n + 1, buffer + n, i - n);
+		buffer [n++] = byte;
+	}
+	return n;
+}
+
+
+// progress of current or last restore
+void restore_progress (struct restore_progress * p)
+{
+	*p = progress;
+}
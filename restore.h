@@ -0,0 +1,50 @@
+/**
+ * @file restore.h
+ * @brief Restore of SysEx files from the USB stick to the groovebox, double-buffered and paced
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _RESTORE_H_
+#define _RESTORE_H_
+
+#include "pico/stdlib.h"
+#include "arena.h"
+
+#define RESTORE_FOLDER	"0:/RESTORE"	// every .SYX file of this folder is sent, in name order
+#define RESTORE_BUFFER	ARENA_SECTOR			// bytes read from the stick at once: one sector, from the sector pool
+#define RESTORE_BUFFERS	2				// sector blocks taken: one is read while the other one is sent
+#define RESTORE_FILES	32				// maximum number of files restored
+
+// progress of a restore
+struct restore_progress {
+	bool running;
+	uint32_t file;			// file being sent (0 to files - 1)
+	uint32_t files;			// number of files
+	uint32_t bytes;			// bytes sent
+	uint32_t total;			// bytes of all files
+};
+
+// start sending the files of RESTORE_FOLDER, at most "rate" bytes per second (0: as fast as USB takes them) and with
+// "gap" usec of silence after each SysEx message, so that receiver can store it; returns false if there is nothing to restore
+bool restore_start (uint32_t rate, uint32_t gap);
+
+// send what pacing allows to midi device "dev_addr" (0 if it is gone: restore stops), and read the next part of file
+// while the previous one is sent; to be called from the main loop, since reading the stick waits
+void restore_task (uint8_t dev_addr, uint64_t now);
+
+// returns true while a SysEx message is partly sent: other midi messages must wait, or they would land inside it
+bool restore_in_message (void);
+
+// "buffer" of "lg" bytes is about to be sent to the midi device: moves the bytes that may go now to its start, the
+// others keep their order after them; returns the number of bytes that may go. All of them outside a SysEx message,
+// only realtime bytes inside one, and none while its last USB-MIDI packet is partly written
+uint32_t restore_sendable (uint8_t * buffer, uint32_t lg);
+
+// progress of current or last restore
+void restore_progress (struct restore_progress * progress);
+
+#endif /* _RESTORE_H_ */
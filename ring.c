@@ -0,0 +1,141 @@
+/**
+ * @file ring.c
+ * @brief Status display on a WS2812 led ring (or strip), driven by PIO and fed by DMA
+ *
+ * The ring has a framebuffer of GRB pixels. When status changes, only the pixels showing the old and the
+ * new values are recomputed, then a DMA channel paced by the PIO TX FIFO pushes the whole frame to the
+ * ws2812 PIO program. Updating the ring costs a few pixel computations and a DMA start.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "ws2812.pio.h"
+#include "ring.h"
+
+#define RING_FREQ		800000		// WS2812 bit rate (Hz)
+#define RING_LATCH		300			// low time after a frame so that leds latch it (usec); 280 usec for newer WS2812B
+#define RING_FRAME_TIME	((RING_LEDS * 24 * 1000000) / RING_FREQ + RING_LATCH)	// minimum time between 2 frames (usec)
+
+// colors, as GRB in the 24 upper bits of a 32-bit word
+#define GRB(r,g,b)		(((uint32_t) (g) << 24) | ((uint32_t) (r) << 16) | ((uint32_t) (b) << 8))
+#define COLOR_OFF		GRB (0, 0, 0)
+#define COLOR_SONG		GRB (0, 0, 48)
+#define COLOR_SONG_HIGH	GRB (32, 0, 48)		// sessions RING_LEDS and above
+#define COLOR_NO_DEVICE	GRB (48, 0, 0)
+#define COLOR_STOP		GRB (8, 8, 8)
+#define COLOR_PLAY		GRB (0, 64, 0)
+#define COLOR_PAUSE		GRB (48, 32, 0)
+#define COLOR_COUNT_IN	GRB (64, 16, 0)
+
+// globals
+static bool ring_enabled = false;
+static PIO ring_pio = NULL;
+static uint ring_sm = 0;
+static int ring_dma = -1;
+static uint32_t frame [RING_LEDS];			// framebuffer, read by DMA
+static struct ring_status shown;			// status currently in framebuffer
+static bool frame_dirty = true;				// framebuffer has not been sent yet
+static uint64_t time_of_last_frame = 0;		// time when last frame was started (usec since boot)
+
+
+// color of pixel "i" for status
+static uint32_t pixel_color (uint i, const struct ring_status * status)
+{
+	// beat position pixel is on top, colored by transport state
+	if (i == status->position) {
+		switch (status->transport) {
+			case RING_PLAY: return COLOR_PLAY;
+			case RING_PAUSE: return COLOR_PAUSE;
+			case RING_COUNT_IN: return COLOR_COUNT_IN;
+			default: return COLOR_STOP;
+		}
+	}
+
+	// session pixel, red if there is no device to control
+	if (i == (uint) (status->song % RING_LEDS)) {
+		if (!status->connected) return COLOR_NO_DEVICE;
+		return (status->song < RING_LEDS) ? COLOR_SONG : COLOR_SONG_HIGH;
+	}
+
+	return COLOR_OFF;
+}
+
+
+// set "gpio" as WS2812 data output; does nothing if gpio is NO_RING_GPIO
+void ring_init (uint gpio)
+{
+	dma_channel_config config;
+	uint offset;
+	uint i;
+
+	if (gpio == NO_RING_GPIO) return;
+
+	ring_pio = pio0;
+	offset = pio_add_program (ring_pio, &ws2812_program);
+	ring_sm = pio_claim_unused_sm (ring_pio, true);
+	ws2812_program_init (ring_pio, ring_sm, offset, gpio, RING_FREQ);
+
+	// DMA pushes the frame to the state machine TX FIFO, one pixel per word
+	ring_dma = dma_claim_unused_channel (true);
+	config = dma_channel_get_default_config (ring_dma);
+	channel_config_set_transfer_data_size (&config, DMA_SIZE_32);
+	channel_config_set_read_increment (&config, true);
+	channel_config_set_write_increment (&config, false);
+	channel_config_set_dreq (&config, pio_get_dreq (ring_pio, ring_sm, true));
+	dma_channel_configure (ring_dma, &config, &ring_pio->txf [ring_sm], frame, RING_LEDS, false);
+
+	// initial frame: compute every pixel once
+	shown.song = 0;
+	shown.transport = RING_STOP;
+	shown.position = 0;
+	shown.connected = false;
+	for (i = 0; i < RING_LEDS; i++) frame [i] = pixel_color (i, &shown);
+	frame_dirty = true;
+	ring_enabled = true;
+}
+
+
+// show status on the ring: only pixels affected by a change are recomputed, and the frame is pushed by DMA in the background;
+// if the previous frame is still being sent, the update is postponed to a later call
+void ring_task (const struct ring_status * status)
+{
+	uint dirty [4];
+	uint nb_dirty = 0;
+	uint i;
+	uint64_t now;
+
+	if (!ring_enabled) return;
+
+	// do not touch framebuffer while DMA reads it, and let leds latch previous frame
+	now = to_us_since_boot (get_absolute_time ());
+	if (dma_channel_is_busy (ring_dma) || (now - time_of_last_frame < RING_FRAME_TIME)) return;
+
+	// pixels showing old and new values of what has changed
+	if (status->position != shown.position || status->transport != shown.transport) {
+		dirty [nb_dirty++] = shown.position;
+		dirty [nb_dirty++] = status->position;
+	}
+	if (status->song != shown.song || status->connected != shown.connected) {
+		dirty [nb_dirty++] = shown.song % RING_LEDS;
+		dirty [nb_dirty++] = status->song % RING_LEDS;
+	}
+
+	shown = *status;
+	for (i = 0; i < nb_dirty; i++) {
+		if (dirty [i] < RING_LEDS) frame [dirty [i]] = pixel_color (dirty [i], &shown);
+	}
+	if (nb_dirty) frame_dirty = true;
+
+	// push frame
+	if (frame_dirty) {
+		dma_channel_set_read_addr (ring_dma, frame, false);
+		dma_channel_set_trans_count (ring_dma, RING_LEDS, true);
+		time_of_last_frame = now;
+		frame_dirty = false;
+	}
+}
@@ -0,0 +1,40 @@
+/**
+ * @file ring.h
+ * @brief Status display on a WS2812 led ring (or strip), driven by PIO and fed by DMA
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _RING_H_
+#define _RING_H_
+
+#include "pico/stdlib.h"
+
+#define NO_RING_GPIO	255		// no led ring
+#define RING_LEDS		16		// number of leds in the ring
+
+// transport state shown on the ring
+#define RING_STOP		0
+#define RING_PLAY		1
+#define RING_PAUSE		2
+#define RING_COUNT_IN	3
+
+// what is shown on the ring
+struct ring_status {
+	uint8_t song;			// session number: lit pixel (blue for sessions 0 to RING_LEDS-1, purple above); red if not connected
+	uint8_t transport;		// transport state: color of beat position pixel
+	uint8_t position;		// beat position: pixel index (0 to RING_LEDS-1) moving around the ring once per bar
+	bool connected;			// connection status to USB MIDI device
+};
+
+// set "gpio" as WS2812 data output; does nothing if gpio is NO_RING_GPIO
+void ring_init (uint gpio);
+
+// show status on the ring: only pixels affected by a change are recomputed, and the frame is pushed by DMA in the background;
+// if the previous frame is still being sent, the update is postponed to a later call
+void ring_task (const struct ring_status * status);
+
+#endif /* _RING_H_ */
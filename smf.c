@@ -0,0 +1,385 @@
+/**
+ * @file smf.c
+ * @brief Standard MIDI File (type 0 and 1) playback from the USB stick, locked to the pedal clock
+ *
+ * Each track has a small read-ahead buffer, refilled from the stick by the main loop. Tracks are merged with a min-heap
+ * keyed by the tick of their next event: playback pops the earliest track, sends its event and pushes it back with the
+ * tick of its following event. Playback only reads from the buffers: a track whose next event is not fully buffered
+ * yet leaves the heap, and is pushed back by the main loop after refill.
+ * Position comes from the clock engine in clock ticks, and is only scaled to the file division: tempo changes of the
+ * file are ignored, and tapping a new tempo stretches playback right away.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include <string.h>
+#include "ff.h"
+#include "midi_msg.h"
+#include "smf.h"
+
+#define CLOCK_PPQN		24
+#define META_EVENT		0xFF
+#define META_END		0x2F		// end of track
+#define SYSEX_START		0xF0
+#define SYSEX_ESCAPE	0xF7
+#define CC_ALL_NOTES_OFF	123
+
+// track state
+struct track {
+	uint32_t offset;				// file offset of next byte to read into buffer
+	uint32_t end;					// file offset of end of track
+	uint8_t buffer [SMF_READ_AHEAD];
+	uint32_t head;					// next byte to parse
+	uint32_t count;					// bytes in buffer
+	uint32_t start;					// file offset of start of track data
+	uint32_t tick;					// tick of next event (file division)
+	uint32_t skip;					// bytes of a meta or SysEx event still to skip
+	uint8_t status;					// running status
+	bool queued;					// track is in heap: its next event tick is known
+	bool done;						// end of track reached
+};
+
+_Static_assert (sizeof (struct track) * SMF_TRACKS <= ARENA_SIZEOF (smf_tracks), "tracks fit their arena buffer");
+
+// globals
+static FIL file;
+static bool file_open = false;
+static uint32_t division = 0;				// ticks per quarter note of the file
+static struct track * const tracks = (struct track *) arena.smf_tracks;
+static uint32_t nb_tracks = 0;
+static uint8_t heap [SMF_TRACKS];			// track indexes, earliest next event first
+static uint32_t heap_size = 0;
+static bool playing = false;				// events have been played since start or last stop
+static bool rewind_pending = false;
+static uint16_t channels = 0;				// channels played, for all notes off
+
+
+// read "lg" bytes at "offset" of file; returns true if they could all be read
+static bool read_at (uint32_t offset, uint8_t * data, uint32_t lg)
+{
+	UINT got = 0;
+
+	return f_lseek (&file, offset) == FR_OK && f_read (&file, data, lg, &got) == FR_OK && got == lg;
+}
+
+
+// big-endian values of file
+static uint32_t be32 (const uint8_t * data)
+{
+	return ((uint32_t) data [0] << 24) | ((uint32_t) data [1] << 16) | ((uint32_t) data [2] << 8) | data [3];
+}
+
+
+static uint32_t be16 (const uint8_t * data)
+{
+	return ((uint32_t) data [0] << 8) | data [1];
+}
+
+
+// heap ordering: earliest tick first, then lowest track index (conductor track of type 1 first)
+static bool earlier (uint8_t a, uint8_t b)
+{
+	return (tracks [a].tick < tracks [b].tick) || (tracks [a].tick == tracks [b].tick && a < b);
+}
+
+
+static void heap_push (uint8_t index)
+{
+	uint32_t i = heap_size++;
+	uint8_t swap;
+
+	heap [i] = index;
+	while (i > 0 && earlier (heap [i], heap [(i - 1) / 2])) {
+		swap = heap [i];
+		heap [i] = heap [(i - 1) / 2];
+		heap [(i - 1) / 2] = swap;
+		i = (i - 1) / 2;
+	}
+	tracks [index].queued = true;
+}
+
+
+static void heap_pop (void)
+{
+	uint32_t i = 0, child;
+	uint8_t swap;
+
+	tracks [heap [0]].queued = false;
+	heap [0] = heap [--heap_size];
+	while ((child = 2 * i + 1) < heap_size) {
+		if (child + 1 < heap_size && earlier (heap [child + 1], heap [child])) child++;
+		if (!earlier (heap [child], heap [i])) break;
+		swap = heap [i];
+		heap [i] = heap [child];
+		heap [child] = swap;
+		i = child;
+	}
+}
+
+
+// decode a variable length quantity at "head" of track buffer; returns number of bytes, 0 if not fully buffered
+static uint32_t read_vlq (const struct track * t, uint32_t head, uint32_t * value)
+{
+	uint32_t i;
+
+	*value = 0;
+	for (i = 0; i < 4 && head + i < t->count; i++) {
+		*value = (*value << 7) | (t->buffer [head + i] & 0x7F);
+		if ((t->buffer [head + i] & 0x80) == 0) return i + 1;
+	}
+	return 0;
+}
+
+
+// fill track buffer from file; waits for the stick, so it is only called from the main loop
+static void refill (struct track * t)
+{
+	uint32_t lg;
+	UINT got = 0;
+
+	// keep unparsed bytes at start of buffer; playback only reads between head and count, so the end of the buffer can be
+	// read while playback goes on
+	memmove (t->buffer, t->buffer + t->head, t->count - t->head);
+	t->count -= t->head;
+	t->head = 0;
+
+	lg = SMF_READ_AHEAD - t->count;
+	if (lg > t->end - t->offset) lg = t->end - t->offset;
+	if (lg == 0) return;
+	if (f_lseek (&file, t->offset) != FR_OK || f_read (&file, t->buffer + t->count, lg, &got) != FR_OK) return;
+	t->count += got;
+	t->offset += got;
+}
+
+
+// skip rest of a meta or SysEx event, then get tick of next event and queue track; track stays out of heap if its
+// data is not buffered yet
+static void advance (uint8_t index)
+{
+	struct track * t = &tracks [index];
+	uint32_t lg, delta;
+
+	if (t->done || t->queued) return;
+
+	lg = t->count - t->head;
+	if (lg > t->skip) lg = t->skip;
+	t->head += lg;
+	t->skip -= lg;
+	if (t->skip) return;
+
+	if (t->head == t->count && t->offset == t->end) {
+		t->done = true;		// track without end of track event
+		return;
+	}
+	lg = read_vlq (t, t->head, &delta);
+	if (lg == 0) return;
+	t->head += lg;
+	t->tick += delta;
+	heap_push (index);
+}
+
+
+// put all tracks back at their start
+static void rewind_tracks (void)
+{
+	uint32_t i;
+	struct track * t;
+
+	heap_size = 0;
+	for (i = 0; i < nb_tracks; i++) {
+		t = &tracks [i];
+		t->offset = t->start;
+		t->head = t->count = 0;
+		t->tick = 0;
+		t->skip = 0;
+		t->status = 0;
+		t->queued = false;
+		t->done = false;
+		refill (t);
+		advance (i);
+	}
+}
+
+
+// open file "path" of the stick and prepare it to play from its start; returns false if it is not a type 0 or 1 SMF
+// to be called from the main loop, since reading the stick waits
+bool smf_open (const char * path)
+{
+	uint8_t chunk [14];
+	uint32_t offset, lg, declared;
+
+	smf_close ();
+	if (f_open (&file, path, FA_READ) != FR_OK) return false;
+	file_open = true;
+
+	// header: format 0 or 1, division in ticks per quarter note (SMPTE divisions are not supported)
+	if (!read_at (0, chunk, 14) || memcmp (chunk, "MThd", 4) != 0 || be32 (chunk + 4) < 6 || be16 (chunk + 8) > 1 ||
+		(chunk [12] & 0x80) || be16 (chunk + 12) == 0) {
+		smf_close ();
+		return false;
+	}
+	declared = be16 (chunk + 10);
+	division = be16 (chunk + 12);
+
+	// track chunks; other chunks are skipped
+	offset = 8 + be32 (chunk + 4);
+	nb_tracks = 0;
+	while (nb_tracks < SMF_TRACKS && nb_tracks < declared && read_at (offset, chunk, 8)) {
+		lg = be32 (chunk + 4);
+		if (memcmp (chunk, "MTrk", 4) == 0) {
+			tracks [nb_tracks].start = offset + 8;
+			tracks [nb_tracks].end = offset + 8 + lg;
+			if (tracks [nb_tracks].end > f_size (&file)) tracks [nb_tracks].end = f_size (&file);
+			nb_tracks++;
+		}
+		offset += 8 + lg;
+	}
+	if (nb_tracks == 0) {
+		smf_close ();
+		return false;
+	}
+
+	playing = false;
+	rewind_pending = false;
+	channels = 0;
+	rewind_tracks ();
+	return true;
+}
+
+
+// close file, if any
+void smf_close (void)
+{
+	if (file_open) f_close (&file);
+	file_open = false;
+	nb_tracks = 0;
+	heap_size = 0;
+}
+
+
+// returns true if a file is open
+bool smf_ready (void)
+{
+	return file_open;
+}
+
+
+// refill read-ahead buffers of tracks, and rewind file after a stop; to be called from the main loop
+void smf_task (void)
+{
+	uint32_t i;
+
+	if (!file_open) return;
+
+	if (rewind_pending) {
+		rewind_pending = false;
+		rewind_tracks ();
+		return;
+	}
+
+	for (i = 0; i < nb_tracks; i++) {
+		if (tracks [i].done) continue;
+		if (tracks [i].count - tracks [i].head < SMF_READ_AHEAD / 2) refill (&tracks [i]);
+		advance (i);
+	}
+}
+
+
+// write into "buffer" of "size" bytes the events of all tracks up to "position", in 1/256 of clock tick (24 PPQN) from
+// start of song; returns number of bytes written. Only uses read-ahead data, so it never waits for the stick
+uint32_t smf_play (uint32_t position, uint8_t * buffer, uint32_t size)
+{
+	uint32_t tick, n = 0, lg, data, vlq, value;
+	uint8_t index, status, type;
+	struct track * t;
+
+	if (!file_open || rewind_pending) return 0;
+
+	tick = (uint32_t) (((uint64_t) position * division) / (CLOCK_PPQN * 256));
+	while (heap_size && tracks [heap [0]].tick <= tick) {
+		index = heap [0];
+		t = &tracks [index];
+		if (t->head == t->count) {
+			heap_pop ();		// starved: pushed back after refill
+			continue;
+		}
+
+		status = t->buffer [t->head];
+		lg = (status & 0x80) ? 1 : 0;
+		if (lg == 0) status = t->status;		// running status
+		if (status < 0x80) {
+			// data without status: corrupt track
+			heap_pop ();
+			t->done = true;
+			continue;
+		}
+
+		if (status == META_EVENT) {
+			// type, length, data
+			if (t->head + 2 > t->count || (vlq = read_vlq (t, t->head + 2, &value)) == 0) {
+				heap_pop ();
+				continue;
+			}
+			type = t->buffer [t->head + 1];
+			heap_pop ();
+			t->head += 2 + vlq;
+			t->skip = value;
+			if (type == META_END) t->done = true;
+			else advance (index);
+			continue;
+		}
+
+		if (status == SYSEX_START || status == SYSEX_ESCAPE) {
+			// length, data: not sent
+			if ((vlq = read_vlq (t, t->head + 1, &value)) == 0) {
+				heap_pop ();
+				continue;
+			}
+			heap_pop ();
+			t->head += 1 + vlq;
+			t->skip = value;
+			advance (index);
+			continue;
+		}
+
+		// channel message, sent with its status byte
+		data = ((status & 0xF0) == 0xC0 || (status & 0xF0) == 0xD0) ? 1 : 2;
+		if (t->head + lg + data > t->count) {
+			heap_pop ();
+			continue;
+		}
+		if (n + 1 + data > size) break;		// no room left: next call
+		buffer [n++] = status;
+		memcpy (buffer + n, t->buffer + t->head + lg, data);
+		n += data;
+		t->status = status;
+		t->head += lg + data;
+		channels |= 1 << (status & 0x0F);
+		playing = true;
+
+		heap_pop ();
+		advance (index);
+	}
+	return n;
+}
+
+
+// stop playback: write all notes off of the channels that were played into "buffer" of "size" bytes, and rewind file
+// on next smf_task (); returns number of bytes written
+uint32_t smf_stop (uint8_t * buffer, uint32_t size)
+{
+	uint32_t n = 0, channel;
+
+	if (!file_open || !playing) return 0;
+
+	for (channel = 0; channel < 16; channel++) {
+		if (channels & (1 << channel)) n += midi_control_change (buffer + n, size - n, channel, CC_ALL_NOTES_OFF, 0);
+	}
+	channels = 0;
+	playing = false;
+	rewind_pending = true;
+	return n;
+}
@@ -0,0 +1,41 @@
+/**
+ * @file smf.h
+ * @brief Standard MIDI File (type 0 and 1) playback from the USB stick, locked to the pedal clock
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _SMF_H_
+#define _SMF_H_
+
+#include "pico/stdlib.h"
+#include "arena.h"
+
+#define SMF_TRACKS		ARENA_SMF_TRACKS		// maximum number of tracks played
+#define SMF_READ_AHEAD	ARENA_SMF_READ_AHEAD	// bytes of each track read ahead from the stick
+
+// open file "path" of the stick and prepare it to play from its start; returns false if it is not a type 0 or 1 SMF
+// to be called from the main loop, since reading the stick waits
+bool smf_open (const char * path);
+
+// close file, if any
+void smf_close (void);
+
+// returns true if a file is open
+bool smf_ready (void);
+
+// refill read-ahead buffers of tracks, and rewind file after a stop; to be called from the main loop
+void smf_task (void);
+
+// write into "buffer" of "size" bytes the events of all tracks up to "position", in 1/256 of clock tick (24 PPQN) from
+// start of song; returns number of bytes written. Only uses read-ahead data, so it never waits for the stick
+uint32_t smf_play (uint32_t position, uint8_t * buffer, uint32_t size);
+
+// stop playback: write all notes off of the channels that were played into "buffer" of "size" bytes, and rewind file
+// on next smf_task (); returns number of bytes written
+uint32_t smf_stop (uint8_t * buffer, uint32_t size);
+
+#endif /* _SMF_H_ */
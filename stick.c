@@ -0,0 +1,172 @@
+/**
+ * @file stick.c
+ * @brief USB stick (mass storage) on the USB host, as FatFs drive 0
+ *
+ * This is the disk I/O layer of FatFs (diskio.h) on top of TinyUSB MSC host. Each sector transfer is started with
+ * tuh_msc_read10 () or tuh_msc_write10 (), then the USB host task runs until its completion callback; the idle function
+ * is called in this loop as well, so that realtime messages (midi clock) are sent while the stick is busy.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include <stdio.h>
+#include "tusb.h"
+#include "ff.h"
+#include "diskio.h"
+#include "stick.h"
+
+#define STICK_LUN		0
+
+// globals
+static void (*idle_function) (void) = NULL;
+static uint8_t stick_addr = 0;			// USB address of the stick; 0 if none
+static bool mount_pending = false;		// stick connected, file system not mounted yet
+static bool mounted = false;
+static volatile bool busy = false;		// transfer in progress
+static FATFS fs;
+
+
+// end of a transfer
+static bool transfer_done (uint8_t dev_addr, tuh_msc_complete_data_t const * cb_data)
+{
+	(void) dev_addr;
+	(void) cb_data;
+
+	busy = false;
+	return true;
+}
+
+
+// run USB host (and idle function) until end of transfer
+static void wait_transfer (void)
+{
+	while (busy && stick_addr != 0) {
+		tuh_task ();
+		if (idle_function) idle_function ();
+	}
+}
+
+
+// "idle" is called while waiting for a USB transfer to or from the stick, so that midi clock keeps running
+void stick_init (void (*idle) (void))
+{
+	idle_function = idle;
+}
+
+
+// mounts the file system of a newly connected stick; returns true once, on the call where stick becomes ready
+// must be called from the main loop (not from a USB callback), since mounting reads the stick
+bool stick_task (void)
+{
+	if (!mount_pending) return false;
+
+	mount_pending = false;
+	mounted = (f_mount (&fs, "0:", 1) == FR_OK);
+	if (!mounted) printf ("USB stick: no FAT file system\r\n");
+	return mounted;
+}
+
+
+// returns true if a stick is connected and its file system is mounted
+bool stick_ready (void)
+{
+	return mounted && stick_addr != 0;
+}
+
+
+// TinyUSB: mass storage device mounted or unmounted
+void tuh_msc_mount_cb (uint8_t dev_addr)
+{
+	if (stick_addr != 0) return;		// only one stick
+
+	stick_addr = dev_addr;
+	mount_pending = true;
+	printf ("USB stick address = %u: %lu sectors of %lu bytes\r\n", dev_addr,
+		(unsigned long) tuh_msc_get_block_count (dev_addr, STICK_LUN), (unsigned long) tuh_msc_get_block_size (dev_addr, STICK_LUN));
+}
+
+
+void tuh_msc_umount_cb (uint8_t dev_addr)
+{
+	if (dev_addr != stick_addr) return;
+
+	stick_addr = 0;
+	mount_pending = false;
+	busy = false;
+	if (mounted) f_unmount ("0:");
+	mounted = false;
+	printf ("USB stick address = %u is unmounted\r\n", dev_addr);
+}
+
+
+// FatFs disk I/O layer: drive 0 is the stick
+DSTATUS disk_status (BYTE pdrv)
+{
+	return (pdrv == 0 && stick_addr != 0 && tuh_msc_mounted (stick_addr)) ? 0 : STA_NODISK;
+}
+
+
+DSTATUS disk_initialize (BYTE pdrv)
+{
+	return disk_status (pdrv);
+}
+
+
+DRESULT disk_read (BYTE pdrv, BYTE * buff, LBA_t sector, UINT count)
+{
+	if (disk_status (pdrv) != 0) return RES_NOTRDY;
+
+	busy = true;
+	if (!tuh_msc_read10 (stick_addr, STICK_LUN, buff, sector, (uint16_t) count, transfer_done, 0)) {
+		busy = false;
+		return RES_ERROR;
+	}
+	wait_transfer ();
+	return (stick_addr != 0) ? RES_OK : RES_NOTRDY;
+}
+
+
+DRESULT disk_write (BYTE pdrv, const BYTE * buff, LBA_t sector, UINT count)
+{
+	if (disk_status (pdrv) != 0) return RES_NOTRDY;
+
+	busy = true;
+	if (!tuh_msc_write10 (stick_addr, STICK_LUN, buff, sector, (uint16_t) count, transfer_done, 0)) {
+		busy = false;
+		return RES_ERROR;
+	}
+	wait_transfer ();
+	return (stick_addr != 0) ? RES_OK : RES_NOTRDY;
+}
+
+
+DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void * buff)
+{
+	if (disk_status (pdrv) != 0) return RES_NOTRDY;
+
+	switch (cmd) {
+		case CTRL_SYNC:
+			return RES_OK;		// every write waits for its completion
+		case GET_SECTOR_COUNT:
+			*((LBA_t *) buff) = tuh_msc_get_block_count (stick_addr, STICK_LUN);
+			return RES_OK;
+		case GET_SECTOR_SIZE:
+			*((WORD *) buff) = (WORD) tuh_msc_get_block_size (stick_addr, STICK_LUN);
+			return RES_OK;
+		case GET_BLOCK_SIZE:
+			*((DWORD *) buff) = 1;		// erase block size unknown
+			return RES_OK;
+		default:
+			return RES_PARERR;
+	}
+}
+
+
+// FatFs file time: no real time clock, files are dated 2022-01-01
+DWORD get_fattime (void)
+{
+	return ((DWORD) (2022 - 1980) << 25) | (1 << 21) | (1 << 16);
+}
@@ -0,0 +1,26 @@
+/**
+ * @file stick.h
+ * @brief USB stick (mass storage) on the USB host, as FatFs drive 0
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _STICK_H_
+#define _STICK_H_
+
+#include "pico/stdlib.h"
+
+// "idle" is called while waiting for a USB transfer to or from the stick, so that midi clock keeps running
+void stick_init (void (*idle) (void));
+
+// mounts the file system of a newly connected stick; returns true once, on the call where stick becomes ready
+// must be called from the main loop (not from a USB callback), since mounting reads the stick
+bool stick_task (void);
+
+// returns true if a stick is connected and its file system is mounted
+bool stick_ready (void);
+
+#endif /* _STICK_H_ */
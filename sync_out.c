@@ -0,0 +1,134 @@
+/**
+ * @file sync_out.c
+ * @brief Clock outputs besides USB: DIN MIDI out (UART) and analog sync pulse
+ *
+ * Writes to the UART never wait: a realtime byte goes to the TX FIFO if there is room, and is dropped otherwise
+ * (at 31250 baud the 32-byte FIFO only fills up if something else floods the DIN output).
+ * Analog pulses are ended by a timer alarm.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include "hardware/uart.h"
+#include "ratio.h"
+#include "sync_out.h"
+
+#define DIN_UART		uart1
+#define DIN_BAUDRATE	31250
+#define MIDI_CLOCK		0xF8
+#define MIDI_PLAY		0xFA
+#define MIDI_CONTINUE	0xFB
+#define MIDI_STOP		0xFC
+
+// globals
+static bool din_enabled = false;
+static uint pulse_gpio = NO_SYNC_GPIO;
+static uint32_t ticks = 0;					// analog output ticks since last MIDI_PLAY, for analog pulse division
+static struct clock_ratio din_ratio = { .num = 1, .den = 1 };
+static struct clock_ratio pulse_ratio = { .num = 1, .den = 1 };
+
+
+// alarm callback: end of analog sync pulse
+static int64_t pulse_off (alarm_id_t id, void * user_data)
+{
+	(void) id;
+	(void) user_data;
+
+	gpio_put (pulse_gpio, false);
+	return 0;		// do not reschedule
+}
+
+
+// set "din_gpio" as DIN MIDI out (UART1 TX: 4, 8, 20 or 24) and "gpio" as analog sync output; NO_SYNC_GPIO if not present
+void sync_out_init (uint din_gpio, uint gpio)
+{
+	if (din_gpio != NO_SYNC_GPIO) {
+		uart_init (DIN_UART, DIN_BAUDRATE);
+		gpio_set_function (din_gpio, GPIO_FUNC_UART);
+		din_enabled = true;
+	}
+
+	if (gpio != NO_SYNC_GPIO) {
+		pulse_gpio = gpio;
+		gpio_init (gpio);
+		gpio_set_dir (gpio, GPIO_OUT);
+		gpio_put (gpio, false);
+	}
+}
+
+
+// one tick of DIN output
+static void din_tick (void)
+{
+	if (din_enabled && uart_is_writable (DIN_UART)) uart_putc_raw (DIN_UART, MIDI_CLOCK);
+}
+
+
+// one 24 PPQN tick of analog output, divided down to SYNC_PPQN pulses
+static void pulse_tick (void)
+{
+	if (pulse_gpio == NO_SYNC_GPIO) return;
+
+	if ((ticks % (24 / SYNC_PPQN)) == 0) {
+		gpio_put (pulse_gpio, true);
+		add_alarm_in_us (SYNC_PULSE_LENGTH, pulse_off, NULL, true);
+	}
+	ticks++;
+}
+
+
+// set clock ratio of "output" (SYNC_DIN or SYNC_PULSE) to "num" output ticks for "den" master ticks; default is 1:1
+void sync_out_ratio (int output, uint32_t num, uint32_t den)
+{
+	ratio_init ((output == SYNC_DIN) ? &din_ratio : &pulse_ratio, num, den);
+}
+
+
+// master 24 PPQN clock tick sent at "time", next one expected "interval" (usec) later: send or schedule ticks of each output
+void sync_out_tick (uint64_t time, uint32_t interval)
+{
+	uint32_t n;
+
+	for (n = ratio_tick (&din_ratio, time, interval); n > 0; n--) din_tick ();
+	for (n = ratio_tick (&pulse_ratio, time, interval); n > 0; n--) pulse_tick ();
+}
+
+
+// send output ticks scheduled between master ticks that are due at "now" (usec)
+void sync_out_task (uint64_t now)
+{
+	while (ratio_due (&din_ratio, now)) din_tick ();
+	while (ratio_due (&pulse_ratio, now)) pulse_tick ();
+}
+
+
+// restart clock ratios and analog pulse division, so that next master tick is output tick 0 of every output
+void sync_out_reset (void)
+{
+	ticks = 0;
+	ratio_reset (&din_ratio);
+	ratio_reset (&pulse_ratio);
+}
+
+
+// send realtime message (MIDI_PLAY, MIDI_STOP, MIDI_CONTINUE) to DIN MIDI out; MIDI_PLAY also realigns outputs on next master tick
+void sync_out_byte (uint8_t byte)
+{
+	if (byte == MIDI_PLAY) sync_out_reset ();
+	if (din_enabled && uart_is_writable (DIN_UART)) uart_putc_raw (DIN_UART, byte);
+}
+
+
+// send transport messages found in a midi stream (as sent to USB) to DIN MIDI out
+void sync_out_relay (const uint8_t * buffer, uint32_t lg)
+{
+	uint32_t i;
+
+	// data bytes are below 0x80, so transport bytes can be searched byte by byte
+	for (i = 0; i < lg; i++) {
+		if (buffer [i] == MIDI_PLAY || buffer [i] == MIDI_CONTINUE || buffer [i] == MIDI_STOP) sync_out_byte (buffer [i]);
+	}
+}
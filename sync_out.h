@@ -0,0 +1,45 @@
+/**
+ * @file sync_out.h
+ * @brief Clock outputs besides USB: DIN MIDI out (UART) and analog sync pulse
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _SYNC_OUT_H_
+#define _SYNC_OUT_H_
+
+#include "pico/stdlib.h"
+
+#define NO_SYNC_GPIO		255		// output not present
+#define SYNC_PPQN			4		// analog sync pulses per quarter note (must divide 24)
+#define SYNC_PULSE_LENGTH	5000	// analog sync pulse length (usec)
+
+// outputs
+#define SYNC_DIN			0
+#define SYNC_PULSE			1
+
+// set "din_gpio" as DIN MIDI out (UART1 TX: 4, 8, 20 or 24) and "gpio" as analog sync output; NO_SYNC_GPIO if not present
+void sync_out_init (uint din_gpio, uint gpio);
+
+// set clock ratio of "output" (SYNC_DIN or SYNC_PULSE) to "num" output ticks for "den" master ticks; default is 1:1
+void sync_out_ratio (int output, uint32_t num, uint32_t den);
+
+// master 24 PPQN clock tick sent at "time", next one expected "interval" (usec) later: send or schedule ticks of each output
+void sync_out_tick (uint64_t time, uint32_t interval);
+
+// send output ticks scheduled between master ticks that are due at "now" (usec)
+void sync_out_task (uint64_t now);
+
+// restart clock ratios and analog pulse division, so that next master tick is output tick 0 of every output
+void sync_out_reset (void);
+
+// send realtime message (MIDI_PLAY, MIDI_STOP, MIDI_CONTINUE) to DIN MIDI out; MIDI_PLAY also realigns outputs on next master tick
+void sync_out_byte (uint8_t byte);
+
+// send transport messages found in a midi stream (as sent to USB) to DIN MIDI out
+void sync_out_relay (const uint8_t * buffer, uint32_t lg);
+
+#endif /* _SYNC_OUT_H_ */
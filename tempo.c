@@ -0,0 +1,94 @@
+/**
+ * @file tempo.c
+ * @brief Tempo map of the current song: tempo steps and ramps at given bars, followed by the clock engine
+ *
+ * Each entry of the map starts a segment, which lasts up to the next entry. Tick periods are computed once per segment
+ * when the map is loaded, in 1/65536 usec: a start period, and a step added on each tick for ramps (ramps are linear in
+ * tick period). Following the map then costs the same per tick as a constant tempo. Periods are given in whole usec,
+ * and the fraction left over by each tick is carried to the next one, so that the mean period is the one of the map.
+ * This does not keep the clock on a grid: each tick is scheduled from the time the previous one was actually sent.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include "tempo.h"
+
+#define CLOCK_PPQN		24
+#define FRACTION_BITS	16
+
+// segment of the map
+struct tempo_segment {
+	int32_t start;				// first tick of segment, from start of song
+	int64_t interval;			// time between ticks at start of segment (1/65536 usec)
+	int64_t step;				// added to interval on each tick of segment (1/65536 usec); 0 for a constant tempo
+};
+
+// globals
+static struct tempo_segment segments [TEMPO_SEGMENTS];
+static uint32_t nb_segments = 0;
+static uint32_t segment = 0;			// segment of last tick
+static int64_t carry = 0;				// fraction of usec not yet given to a tick (1/65536 usec)
+
+
+// time between ticks at "bpm" (1/10 BPM), in 1/65536 usec
+static int64_t bpm_interval (uint16_t bpm)
+{
+	return ((int64_t) 600000000 << FRACTION_BITS) / ((int64_t) bpm * CLOCK_PPQN);
+}
+
+
+// precompute the tick periods of map "entries" ("count" entries, from config_tempo_map ()) for bars of "bar_ticks"
+// clock ticks; count of 0 clears the map
+void tempo_map_load (const struct config_tempo * entries, uint32_t count, uint32_t bar_ticks)
+{
+	uint32_t i;
+	int32_t length;
+
+	if (count > TEMPO_SEGMENTS) count = TEMPO_SEGMENTS;
+	for (i = 0; i < count; i++) {
+		segments [i].start = (int32_t) (entries [i].bar - 1) * (int32_t) bar_ticks;
+		segments [i].interval = bpm_interval (entries [i].bpm);
+		segments [i].step = 0;
+	}
+
+	// ramps reach the period of the next entry on its first tick
+	for (i = 0; i + 1 < count; i++) {
+		if (!(entries [i].flags & CONFIG_TEMPO_RAMP)) continue;
+		length = segments [i + 1].start - segments [i].start;
+		segments [i].step = (segments [i + 1].interval - segments [i].interval) / length;
+	}
+
+	nb_segments = count;
+	segment = 0;
+	carry = 0;
+}
+
+
+// time (usec) between ticks at start of song, before it is played; 0 if map does not start on first bar
+int64_t tempo_map_start (void)
+{
+	return (nb_segments && segments [0].start == 0) ? segments [0].interval >> FRACTION_BITS : 0;
+}
+
+
+// time (usec) between clock tick "tick" (from start of song) and the next one; 0 if map does not set the tempo there
+int64_t tempo_map_interval (int32_t tick)
+{
+	int64_t interval;
+
+	if (nb_segments == 0 || tick < segments [0].start) return 0;
+
+	// segment of tick: the next one in the normal course of the song, searched again when the song is restarted
+	if (tick < segments [segment].start) {
+		segment = 0;
+		carry = 0;
+	}
+	while (segment + 1 < nb_segments && tick >= segments [segment + 1].start) segment++;
+
+	interval = segments [segment].interval + segments [segment].step * (tick - segments [segment].start) + carry;
+	carry = interval & ((1 << FRACTION_BITS) - 1);
+	return interval >> FRACTION_BITS;
+}
@@ -0,0 +1,29 @@
+/**
+ * @file tempo.h
+ * @brief Tempo map of the current song: tempo steps and ramps at given bars, followed by the clock engine
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _TEMPO_H_
+#define _TEMPO_H_
+
+#include "pico/stdlib.h"
+#include "config.h"
+
+#define TEMPO_SEGMENTS	CONFIG_MAP_TEMPOS	// tempo changes of a song that are followed; longer maps are refused by config_check ()
+
+// precompute the tick periods of map "entries" ("count" entries, from config_tempo_map ()) for bars of "bar_ticks"
+// clock ticks; count of 0 clears the map
+void tempo_map_load (const struct config_tempo * entries, uint32_t count, uint32_t bar_ticks);
+
+// time (usec) between ticks at start of song, before it is played; 0 if map does not start on first bar
+int64_t tempo_map_start (void);
+
+// time (usec) between clock tick "tick" (from start of song) and the next one; 0 if map does not set the tempo there
+int64_t tempo_map_interval (int32_t tick);
+
+#endif /* _TEMPO_H_ */
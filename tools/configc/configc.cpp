@@ -0,0 +1,421 @@
+/**
+ * @file configc.cpp
+ * @brief Compiles a text configuration into the binary image read in place by the pedal (see config.h)
+ *
+ * usage: configc <input.cfg> <output.bin>
+ *
+ * The input is made of sections, each followed by "key = value" lines; '#' starts a comment. Numbers are decimal,
+ * except vid, pid and macro bytes that are hexadecimal. Sessions and midi channels are numbered from 1, as on devices.
+ *
+ *   [settings]
+ *   pedal.prev = 11            # gpio of each pedal: prev, next, play, continue, tempo, half, double, looper, mod; "none" if absent
+ *   sessions = 32
+ *   beats_per_bar = 4
+ *   count_in_bars = 1
+ *   mtc_fps = 25
+ *   drum_channel = 10
+ *   looper_bars = 2
+ *
+ *   [macro intro]              # named macro: midi bytes sent after a session change
+ *   bytes = B0 07 64
+ *
+ *   [song]                     # setlist entry, in setlist order
+ *   name = Opener
+ *   session = 3
+ *   bpm = 121.5                # optional
+ *   macro = intro              # optional
+ *   tempo = 9 132              # optional tempo map, one line per change (32 at most): from bar 9 on, 132 BPM
+ *   tempo = 17 120 ramp        # "ramp": tempo goes linearly to the one of the next line, reached at its bar
+ *   tempo = 25 100
+ *
+ *   [session 5]                # tempo map of a session, used when there is no setlist
+ *   tempo = 1 90
+ *
+ *   [device]                   # role of a USB MIDI device
+ *   vid = 1235
+ *   pid = 0002
+ *   role = groovebox           # groovebox, drums or ignore
+ *   channel = 10               # optional, drums only
+ *
+ * Every error is reported with its line number, and no image is written if there is one. The image is finally checked
+ * with the same code as the firmware, so an image written by configc is always accepted by the pedal.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+extern "C" {
+#include "config.h"
+}
+
+// the image is read in place by the pico: layout must not depend on the host compiler
+static_assert (sizeof (struct config_header) == 40, "config_header layout");
+static_assert (sizeof (struct config_settings) == 16, "config_settings layout");
+static_assert (sizeof (struct config_song) == 16, "config_song layout");
+static_assert (sizeof (struct config_macro) == 32, "config_macro layout");
+static_assert (sizeof (struct config_device) == 8, "config_device layout");
+static_assert (sizeof (struct config_tempo) == 8, "config_tempo layout");
+
+namespace {
+
+const char * pedal_names [CONFIG_PEDALS] = { "prev", "next", "play", "continue", "tempo", "half", "double", "looper", "mod" };
+
+// song and device sections refer to values checked at the end (macro names, sessions)
+struct pending_song {
+	struct config_song song;
+	std::string macro;
+	int line;
+};
+
+struct pending_tempo {
+	struct config_tempo tempo;
+	int line;
+};
+
+class compiler {
+public:
+	compiler ()
+	{
+		// defaults of picovation.c
+		const uint8_t gpios [CONFIG_PEDALS] = { 11, 15, 14, 12, 13, 10, 9, 8, 7 };
+		std::memcpy (settings.pedal_gpio, gpios, sizeof (gpios));
+		settings.sessions = 32;
+		settings.beats_per_bar = 4;
+		settings.count_in_bars = 1;
+		settings.mtc_fps = 25;
+		settings.drum_channel = 9;
+		settings.looper_bars = 2;
+	}
+
+	bool parse (std::istream & in);
+	std::vector<uint8_t> build ();
+	bool ok () const { return errors == 0; }
+
+private:
+	void error (int line, const std::string & message)
+	{
+		std::cerr << "line " << line << ": " << message << "\n";
+		errors++;
+	}
+	long number (int line, const std::string & value, long min, long max, int base = 10);
+	void section (int line, const std::string & name);
+	void key (int line, const std::string & key, const std::string & value);
+	void tempo (int line, const std::string & value, uint8_t owner, uint8_t flags);
+
+	struct config_settings settings {};
+	std::vector<pending_song> songs;
+	std::vector<struct config_macro> macros;
+	std::map<std::string, size_t> macro_index;
+	std::vector<struct config_device> devices;
+	std::vector<pending_tempo> tempos;
+	std::string current;
+	uint8_t session = 0;			// session of current session section
+	int errors = 0;
+};
+
+
+std::string trim (const std::string & s)
+{
+	size_t first = s.find_first_not_of (" \t\r");
+	size_t last = s.find_last_not_of (" \t\r");
+	return (first == std::string::npos) ? "" : s.substr (first, last - first + 1);
+}
+
+
+long compiler::number (int line, const std::string & value, long min, long max, int base)
+{
+	char * end;
+	long n = std::strtol (value.c_str (), &end, base);
+
+	if (value.empty () || *end != 0) error (line, "not a number: " + value);
+	else if (n < min || n > max) error (line, value + " is out of range (" + std::to_string (min) + " to " + std::to_string (max) + ")");
+	else return n;
+	return min;
+}
+
+
+void compiler::section (int line, const std::string & name)
+{
+	std::string type = name.substr (0, name.find (' '));
+
+	current = type;
+	if (type == "settings") return;
+
+	if (type == "song") {
+		if (songs.size () == CONFIG_MAX_SONGS) error (line, "too many songs");
+		pending_song p {};
+		p.song.macro = CONFIG_NO_MACRO;
+		p.line = line;
+		songs.push_back (p);
+	}
+	else if (type == "macro") {
+		std::string macro_name = trim (name.substr (type.size ()));
+		if (macro_name.empty ()) error (line, "macro has no name");
+		if (macro_index.count (macro_name)) error (line, "macro " + macro_name + " is defined twice");
+		if (macros.size () == CONFIG_MAX_MACROS) error (line, "too many macros");
+		struct config_macro m {};
+		macro_index [macro_name] = macros.size ();
+		macros.push_back (m);
+	}
+	else if (type == "session") {
+		session = number (line, trim (name.substr (type.size ())), 1, 64) - 1;
+	}
+	else if (type == "device") {
+		if (devices.size () == CONFIG_MAX_DEVICES) error (line, "too many devices");
+		struct config_device d {};
+		d.channel = 255;
+		devices.push_back (d);
+	}
+	else {
+		error (line, "unknown section " + name);
+		current.clear ();
+	}
+}
+
+
+void compiler::key (int line, const std::string & key, const std::string & value)
+{
+	if (current == "settings") {
+		for (int i = 0; i < CONFIG_PEDALS; i++) {
+			if (key == std::string ("pedal.") + pedal_names [i]) {
+				settings.pedal_gpio [i] = (value == "none") ? CONFIG_NO_GPIO : number (line, value, 0, 29);
+				return;
+			}
+		}
+		if (key == "sessions") settings.sessions = number (line, value, 1, 64);
+		else if (key == "beats_per_bar") settings.beats_per_bar = number (line, value, 1, 16);
+		else if (key == "count_in_bars") settings.count_in_bars = number (line, value, 0, 8);
+		else if (key == "mtc_fps") {
+			settings.mtc_fps = number (line, value, 0, 30);
+			if (settings.mtc_fps != 0 && settings.mtc_fps != 24 && settings.mtc_fps != 25 && settings.mtc_fps != 30) error (line, "mtc_fps must be 0, 24, 25 or 30");
+		}
+		else if (key == "drum_channel") settings.drum_channel = number (line, value, 1, 16) - 1;
+		else if (key == "looper_bars") settings.looper_bars = number (line, value, 1, 16);
+		else error (line, "unknown setting " + key);
+	}
+	else if (current == "song") {
+		pending_song & p = songs.back ();
+		if (key == "name") {
+			if (value.size () > CONFIG_NAME_SIZE) error (line, "name is longer than " + std::to_string (CONFIG_NAME_SIZE) + " characters");
+			std::strncpy (p.song.name, value.c_str (), CONFIG_NAME_SIZE);
+		}
+		else if (key == "session") p.song.session = number (line, value, 1, 64) - 1;
+		else if (key == "macro") p.macro = value;
+		else if (key == "tempo") tempo (line, value, (uint8_t) (songs.size () - 1), 0);
+		else if (key == "bpm") {
+			double bpm = std::atof (value.c_str ());
+			if (bpm < 40.0 || bpm > 240.0) error (line, "bpm must be between 40 and 240");
+			else p.song.bpm = (uint16_t) (bpm * 10.0 + 0.5);
+		}
+		else error (line, "unknown song key " + key);
+	}
+	else if (current == "macro") {
+		struct config_macro & m = macros.back ();
+		if (key != "bytes") {
+			error (line, "unknown macro key " + key);
+			return;
+		}
+		std::istringstream bytes (value);
+		std::string byte;
+		m.lg = 0;
+		while (bytes >> byte) {
+			if (m.lg == CONFIG_MACRO_SIZE) {
+				error (line, "macro is longer than " + std::to_string (CONFIG_MACRO_SIZE) + " bytes");
+				return;
+			}
+			m.data [m.lg++] = number (line, byte, 0, 0xFF, 16);
+		}
+	}
+	else if (current == "session") {
+		if (key == "tempo") tempo (line, value, session, CONFIG_TEMPO_SESSION);
+		else error (line, "unknown session key " + key);
+	}
+	else if (current == "device") {
+		struct config_device & d = devices.back ();
+		if (key == "vid") d.vid = number (line, value, 0, 0xFFFF, 16);
+		else if (key == "pid") d.pid = number (line, value, 0, 0xFFFF, 16);
+		else if (key == "channel") d.channel = number (line, value, 1, 16) - 1;
+		else if (key == "role") {
+			if (value == "groovebox") d.role = CONFIG_ROLE_GROOVEBOX;
+			else if (value == "drums") d.role = CONFIG_ROLE_DRUMS;
+			else if (value == "ignore") d.role = CONFIG_ROLE_IGNORE;
+			else error (line, "unknown role " + value);
+		}
+		else error (line, "unknown device key " + key);
+	}
+	else error (line, "key outside of a section");
+}
+
+
+// tempo map line: bar, bpm, and optional "ramp"
+void compiler::tempo (int line, const std::string & value, uint8_t owner, uint8_t flags)
+{
+	std::istringstream fields (value);
+	std::string bar, bpm, ramp, extra;
+	pending_tempo p {};
+
+	fields >> bar >> bpm >> ramp >> extra;
+	if (bpm.empty () || !extra.empty () || (!ramp.empty () && ramp != "ramp")) {
+		error (line, "expected tempo = <bar> <bpm> [ramp]");
+		return;
+	}
+	if (tempos.size () == CONFIG_MAX_TEMPOS) error (line, "too many tempo changes");
+	p.tempo.bar = number (line, bar, 1, 0xFFFF);
+	double value_bpm = std::atof (bpm.c_str ());
+	if (value_bpm < 40.0 || value_bpm > 240.0) error (line, "bpm must be between 40 and 240");
+	else p.tempo.bpm = (uint16_t) (value_bpm * 10.0 + 0.5);
+	p.tempo.owner = owner;
+	p.tempo.flags = flags | (ramp.empty () ? 0 : CONFIG_TEMPO_RAMP);
+	p.line = line;
+	tempos.push_back (p);
+}
+
+
+bool compiler::parse (std::istream & in)
+{
+	std::string text;
+	int line = 0;
+
+	while (std::getline (in, text)) {
+		line++;
+		text = trim (text.substr (0, text.find ('#')));
+		if (text.empty ()) continue;
+
+		if (text.front () == '[') {
+			if (text.back () != ']') error (line, "missing ]");
+			else section (line, trim (text.substr (1, text.size () - 2)));
+			continue;
+		}
+
+		size_t equal = text.find ('=');
+		if (equal == std::string::npos) {
+			error (line, "expected key = value");
+			continue;
+		}
+		key (line, trim (text.substr (0, equal)), trim (text.substr (equal + 1)));
+	}
+
+	// references, once everything is known
+	for (pending_song & p : songs) {
+		if (p.song.session >= settings.sessions) error (p.line, "session is above the number of sessions");
+		if (p.macro.empty ()) continue;
+		auto m = macro_index.find (p.macro);
+		if (m == macro_index.end ()) error (p.line, "unknown macro " + p.macro);
+		else p.song.macro = (uint8_t) m->second;
+	}
+
+	// tempo maps: entries of a map are grouped, in bar order
+	std::stable_sort (tempos.begin (), tempos.end (), [] (const pending_tempo & a, const pending_tempo & b) {
+		return std::make_tuple (a.tempo.flags & CONFIG_TEMPO_SESSION, a.tempo.owner, a.tempo.bar) <
+			std::make_tuple (b.tempo.flags & CONFIG_TEMPO_SESSION, b.tempo.owner, b.tempo.bar);
+	});
+	for (size_t i = 0, run = 1; i < tempos.size (); i++, run++) {
+		const struct config_tempo & t = tempos [i].tempo;
+		bool last = (i + 1 == tempos.size ()) || tempos [i + 1].tempo.owner != t.owner ||
+			(tempos [i + 1].tempo.flags & CONFIG_TEMPO_SESSION) != (t.flags & CONFIG_TEMPO_SESSION);
+		if (run == CONFIG_MAP_TEMPOS + 1) error (tempos [i].line, "more than " + std::to_string (CONFIG_MAP_TEMPOS) + " tempo changes in a map");
+		if ((t.flags & CONFIG_TEMPO_SESSION) && t.owner >= settings.sessions) error (tempos [i].line, "session is above the number of sessions");
+		if (!last && tempos [i + 1].tempo.bar == t.bar) error (tempos [i + 1].line, "two tempo changes on bar " + std::to_string (t.bar));
+		if (last && (t.flags & CONFIG_TEMPO_RAMP)) error (tempos [i].line, "ramp needs a following tempo change");
+		if (last) run = 0;
+	}
+	return ok ();
+}
+
+
+// append "count" records to image, aligned on 4 bytes; returns their offset
+template <typename T> uint32_t append (std::vector<uint8_t> & image, const T * records, size_t count)
+{
+	uint32_t offset;
+
+	while (image.size () & 3) image.push_back (0);
+	offset = (uint32_t) image.size ();
+	image.insert (image.end (), (const uint8_t *) records, (const uint8_t *) (records + count));
+	return offset;
+}
+
+
+std::vector<uint8_t> compiler::build ()
+{
+	std::vector<uint8_t> image (sizeof (struct config_header), 0);
+	std::vector<struct config_song> records;
+	struct config_header header {};
+
+	for (const pending_song & p : songs) records.push_back (p.song);
+
+	append (image, &settings, 1);
+	header.songs_offset = append (image, records.data (), records.size ());
+	header.macros_offset = append (image, macros.data (), macros.size ());
+	header.devices_offset = append (image, devices.data (), devices.size ());
+	std::vector<struct config_tempo> tempo_records;
+	for (const pending_tempo & p : tempos) tempo_records.push_back (p.tempo);
+	header.tempos_offset = append (image, tempo_records.data (), tempo_records.size ());
+
+	header.magic = CONFIG_MAGIC;
+	header.version = CONFIG_VERSION;
+	header.header_size = sizeof (struct config_header);
+	header.size = (uint32_t) image.size ();
+	header.nb_songs = (uint16_t) songs.size ();
+	header.nb_macros = (uint16_t) macros.size ();
+	header.nb_devices = (uint16_t) devices.size ();
+	header.nb_tempos = (uint16_t) tempos.size ();
+	header.crc = config_crc (image.data () + sizeof (struct config_header), header.size - sizeof (struct config_header));
+	std::memcpy (image.data (), &header, sizeof (header));
+	return image;
+}
+
+} // namespace
+
+
+int main (int argc, char * argv [])
+{
+	const uint16_t one = 1;
+	compiler c;
+
+	if (argc != 3) {
+		std::cerr << "usage: configc <input.cfg> <output.bin>\n";
+		return 2;
+	}
+	if (*(const uint8_t *) &one != 1) {
+		std::cerr << "configc must run on a little-endian host, as the pico\n";
+		return 2;
+	}
+
+	std::ifstream in (argv [1]);
+	if (!in) {
+		std::cerr << "cannot open " << argv [1] << "\n";
+		return 1;
+	}
+	if (!c.parse (in)) return 1;
+
+	std::vector<uint8_t> image = c.build ();
+	if (image.size () > CONFIG_FLASH_SIZE || !config_check (image.data (), CONFIG_FLASH_SIZE)) {
+		std::cerr << "image does not pass the firmware checks\n";
+		return 1;
+	}
+
+	std::ofstream out (argv [2], std::ios::binary);
+	out.write ((const char *) image.data (), image.size ());
+	if (!out) {
+		std::cerr << "cannot write " << argv [2] << "\n";
+		return 1;
+	}
+	std::printf ("%s: %zu bytes, %u songs, %u macros, %u devices, %u tempo changes\n", argv [2], image.size (),
+		(unsigned) ((const struct config_header *) image.data ())->nb_songs, (unsigned) ((const struct config_header *) image.data ())->nb_macros,
+		(unsigned) ((const struct config_header *) image.data ())->nb_devices, (unsigned) ((const struct config_header *) image.data ())->nb_tempos);
+	return 0;
+}
@@ -0,0 +1,37 @@
+/**
+ * @file ff.h
+ * @brief Host stand-in for FatFs: the types and functions used by the modules under test, which the tests define on a
+ * simulated stick
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _FF_H_
+#define _FF_H_
+
+#include <stdint.h>
+
+typedef unsigned int UINT;
+typedef uint8_t BYTE;
+typedef char TCHAR;
+
+typedef enum { FR_OK = 0, FR_DISK_ERR, FR_NO_FILE } FRESULT;
+
+typedef struct { int index; uint32_t position; } FIL;		// file of the simulated stick, and read position
+typedef struct { int index; } DIR;							// next entry of the simulated folder
+typedef struct { uint32_t fsize; char fname [13]; BYTE fattrib; } FILINFO;
+
+#define FA_READ		0x01
+#define AM_DIR		0x10
+
+FRESULT f_open (FIL * fp, const TCHAR * path, BYTE mode);
+FRESULT f_close (FIL * fp);
+FRESULT f_read (FIL * fp, void * buffer, UINT btr, UINT * br);
+FRESULT f_opendir (DIR * dp, const TCHAR * path);
+FRESULT f_closedir (DIR * dp);
+FRESULT f_readdir (DIR * dp, FILINFO * fno);
+
+#endif /* _FF_H_ */
@@ -0,0 +1,24 @@
+/**
+ * @file hosttest.h
+ * @brief Checks of the host tests: a failed check is reported with its line, and the test goes on
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _HOSTTEST_H_
+#define _HOSTTEST_H_
+
+#include <stdio.h>
+
+static int hosttest_failures = 0;
+
+// report "cond" if it is false
+#define CHECK(cond)		do { if (!(cond)) { printf ("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); hosttest_failures++; } } while (0)
+
+// exit code of the test
+#define HOSTTEST_RESULT()	(hosttest_failures ? 1 : 0)
+
+#endif /* _HOSTTEST_H_ */
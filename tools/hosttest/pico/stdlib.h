@@ -0,0 +1,37 @@
+/**
+ * @file stdlib.h
+ * @brief Host stand-in for the pico SDK header: the types used by the interfaces of the modules under test, and the gpio
+ * and timer functions they call, which the tests define on a simulated clock and simulated pins
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _PICO_STDLIB_H_
+#define _PICO_STDLIB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef unsigned int uint;
+
+#define __not_in_flash_func(name)	name
+
+#define GPIO_IRQ_EDGE_FALL	0x4
+#define GPIO_IRQ_EDGE_RISE	0x8
+#define GPIO_OUT			1
+
+typedef void (* gpio_irq_callback_t) (uint gpio, uint32_t events);
+
+uint32_t time_us_32 (void);
+void gpio_init (uint gpio);
+void gpio_set_dir (uint gpio, bool out);
+void gpio_put (uint gpio, bool value);
+bool gpio_get (uint gpio);
+void gpio_set_irq_enabled (uint gpio, uint32_t events, bool enabled);
+void gpio_set_irq_enabled_with_callback (uint gpio, uint32_t events, bool enabled, gpio_irq_callback_t callback);
+
+#endif /* _PICO_STDLIB_H_ */
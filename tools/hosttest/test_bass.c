@@ -0,0 +1,188 @@
+/**
+ * @file test_bass.c
+ * @brief Bass pedal mode: latency from switch edge to USB flush, on a simulated main loop and bouncing switches
+ *
+ * Presses and releases of the pedals bounce for up to BOUNCE_TIME; the edge interrupt runs at the time of each edge.
+ * A pass of the main loop lasts "loop" usec, and one pass in SLOW_EVERY lasts "slow" usec (eg. a screen update); each
+ * pass ends with the realtime lane: bass_task (), then flush and bass_flushed (). Latency is taken three ways: from
+ * the first edge of each press to the flush that carried its note-on, from bass_stats (), and from the edges of the
+ * probe output, the way a scope measures it on the pedal. None may exceed the longest pass: the firmware adds no wait
+ * of its own, bounces play no note, and note-offs wait for BASS_RELEASE_DEBOUNCE.
+ *
+ * ./test_bass [loop] [slow]		(latency for another main loop, usec)
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include <stdlib.h>
+#include "bass.h"
+#include "hosttest.h"
+
+#define NB_PINS			30
+#define PROBE			15
+#define LOOP			100			// usec, main loop pass
+#define SLOW			600			// usec, slow pass
+#define SLOW_EVERY		50			// one pass in SLOW_EVERY is slow
+#define BOUNCE_TIME		3000		// usec, bounces after each press and release
+#define BOUNCES			6			// edges of a bounce, at most
+#define PRESSES			(4 * BASS_STATS_NOTES)
+#define MAX_EDGES		(2 * (BOUNCES + 1))
+
+// globals
+static uint32_t now = 1000;
+static bool level [NB_PINS];						// switch open (pulled up) when true
+static gpio_irq_callback_t callback = NULL;
+static uint32_t irq_enabled = 0;					// one bit per gpio
+static uint32_t probe_edges = 0;
+static uint32_t probe_time = 0;
+
+
+// simulated SDK: clock and gpios
+uint32_t time_us_32 (void)
+{
+	return now;
+}
+
+void gpio_init (uint gpio)
+{
+	(void) gpio;
+}
+
+void gpio_set_dir (uint gpio, bool out)
+{
+	(void) gpio;
+	(void) out;
+}
+
+void gpio_put (uint gpio, bool value)
+{
+	if (gpio == PROBE && value != level [PROBE]) {
+		probe_edges++;
+		probe_time = now;
+	}
+	level [gpio] = value;
+}
+
+bool gpio_get (uint gpio)
+{
+	return level [gpio];
+}
+
+void gpio_set_irq_enabled (uint gpio, uint32_t events, bool enabled)
+{
+	(void) events;
+	if (enabled) irq_enabled |= 1u << gpio;
+	else irq_enabled &= ~(1u << gpio);
+}
+
+void gpio_set_irq_enabled_with_callback (uint gpio, uint32_t events, bool enabled, gpio_irq_callback_t cb)
+{
+	callback = cb;
+	gpio_set_irq_enabled (gpio, events, enabled);
+}
+
+
+// edges of a switch going to level "open" from "time", into "times" and "levels": bounces, then the final level; returns
+// number of edges
+static uint32_t bounce (uint32_t time, bool open, uint32_t * times, bool * levels)
+{
+	uint32_t i, n = (rand () % (BOUNCES / 2 + 1)) * 2 + 1;
+
+	for (i = 0; i < n; i++) {
+		times [i] = time + (i ? (uint32_t) (rand () % BOUNCE_TIME) : 0);
+		if (i && times [i] <= times [i - 1]) times [i] = times [i - 1] + 1;
+		levels [i] = (i % 2) ? !open : open;
+	}
+	return n;
+}
+
+
+int main (int argc, char * argv [])
+{
+	static const uint8_t gpios [] = { 2, 3, 4, 5 }, notes [] = { 36, 38, 40, 41 };
+	uint32_t loop = (argc > 1) ? (uint32_t) atoi (argv [1]) : LOOP, slow = (argc > 2) ? (uint32_t) atoi (argv [2]) : SLOW;
+	uint32_t times [MAX_EDGES], edges, e, p, pass = 0, pass_end, press_time, latency, latency_max = 0, probe_max = 0;
+	uint32_t note_ons = 0, note_offs = 0, late = 0, windows = 0, stats_max = 0, lg, i, pin;
+	uint64_t latency_sum = 0;
+	bool levels [MAX_EDGES], flushed, note_on;
+	uint8_t buffer [64];
+	struct bass_stats stats;
+
+	srand (7);
+	for (pin = 0; pin < NB_PINS; pin++) level [pin] = (pin != PROBE);
+	bass_init (gpios, notes, sizeof (gpios), 0, 100, 0);
+	bass_probe_init (PROBE);
+	bass_enable (true);
+
+	for (p = 0; p < PRESSES; p++) {
+		pin = gpios [rand () % sizeof (gpios)];
+
+		// press then release of one pedal, held 50 to 300 ms, edges in time order
+		press_time = now + (uint32_t) (rand () % 20000);
+		edges = bounce (press_time, false, times, levels);
+		edges += bounce (times [edges - 1] + 50000 + (uint32_t) (rand () % 250000), true, times + edges, levels + edges);
+		flushed = false;
+
+		// main loop passes until note-off has gone out
+		for (e = 0; e < edges || note_offs < p + 1; pass++) {
+			pass_end = now + ((pass % SLOW_EVERY == 0) ? slow : loop);
+
+			// edges during the pass: interrupt runs at their time
+			for (; e < edges && times [e] < pass_end; e++) {
+				now = times [e];
+				level [pin] = levels [e];
+				if (irq_enabled & (1u << pin)) callback (pin, levels [e] ? GPIO_IRQ_EDGE_RISE : GPIO_IRQ_EDGE_FALL);
+			}
+			now = pass_end;
+
+			// realtime lane
+			lg = bass_task (buffer, sizeof (buffer));
+			if (lg == 0) continue;
+			note_on = false;
+			for (i = 0; i + 2 < lg; i += 3) {
+				if ((buffer [i] & 0xF0) != 0x90) continue;
+				if (buffer [i + 2]) {
+					CHECK (!flushed);				// one note-on per press, whatever the bounces
+					flushed = true;
+					note_on = true;
+					note_ons++;
+					latency = now - press_time;
+					latency_sum += latency;
+					if (latency > latency_max) latency_max = latency;
+					if (latency > BASS_LATENCY_LIMIT) late++;
+				}
+				else {
+					CHECK (now - times [edges - 1] >= BASS_RELEASE_DEBOUNCE);
+					note_offs++;
+				}
+			}
+			bass_flushed ();
+			if (note_on) {
+				CHECK (probe_edges == note_ons);
+				if (probe_time - press_time > probe_max) probe_max = probe_time - press_time;
+			}
+			if (bass_stats (&stats)) {
+				if (stats.max > stats_max) stats_max = stats.max;
+				CHECK (stats.mean <= stats.max);
+				windows++;
+			}
+		}
+	}
+
+	printf ("loop %lu us, 1 pass in %u of %lu us: latency max %lu mean %lu us, %lu over %u us; bass_stats max %lu us; probe max %lu us\n",
+		(unsigned long) loop, SLOW_EVERY, (unsigned long) slow, (unsigned long) latency_max,
+		(unsigned long) (latency_sum / note_ons), (unsigned long) late, BASS_LATENCY_LIMIT, (unsigned long) stats_max,
+		(unsigned long) probe_max);
+	CHECK (note_ons == PRESSES && note_offs == PRESSES);
+	CHECK (probe_edges == PRESSES);
+	CHECK (windows == PRESSES / BASS_STATS_NOTES);
+	CHECK (latency_max <= (loop > slow ? loop : slow));
+	CHECK (probe_max == latency_max);
+	CHECK (stats_max + 1 >= latency_max && stats_max <= latency_max);		// interrupt stamps odd times, 0 being "none"
+	if (argc == 1) CHECK (late == 0);
+
+	return HOSTTEST_RESULT ();
+}
@@ -0,0 +1,184 @@
+/**
+ * @file test_beat.c
+ * @brief Beat tracker against WAV files of known tempo: tempo, phase, time to lock and processing time per frame
+ *
+ * usage: test_beat                   drum loops at several tempos are written to WAV files, then tracked
+ *        test_beat <file.wav> <bpm>  benchmark on a recording; its first beat is not known, so phase is not checked
+ *
+ * Files are resampled to BEAT_SAMPLE_RATE and scaled to the 12-bit unsigned samples of the ADC, then fed to the
+ * tracker one frame at a time, as audio.c does. Every estimate given once locked has to be in the right octave,
+ * except for tempos far from the 120 BPM of the prior, where the tracker may take eighth notes or half notes for
+ * beats: then half or double tempo is accepted, as clock_follow () folds it into the octave of the running clock.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "beat.h"
+#include "wav.h"
+#include "hosttest.h"
+
+#define TEMPO_TOLERANCE		0.02		// relative error of beat period
+#define PHASE_TOLERANCE		0.030		// sec
+#define LOCK_TIME			12.0		// sec, from start of file
+#define LOOP_SECONDS		30
+#define PI					3.14159265358979323846
+
+// result of tracking a file
+struct tracking {
+	bool locked;
+	double lock_time;			// sec
+	double period;				// sec, last locked estimate
+	double worst;				// sec, locked estimate furthest from "expected"
+	double last_beat;			// sec
+	double frame_usec;			// processing time per frame, on the host
+};
+
+
+// drum loop at "bpm": kick on beats 1 and 3, snare on 2 and 4, hi-hat on eighths, over background noise; first beat
+// at "offset" sec
+static int16_t * drum_loop (double bpm, uint32_t rate, double offset, uint32_t * count)
+{
+	double beat = 60.0 / bpm, t, dt, x;
+	uint32_t i;
+	int eighth;
+	int16_t * samples;
+
+	*count = rate * LOOP_SECONDS;
+	samples = malloc (*count * sizeof (int16_t));
+	srand (1);
+	for (i = 0; i < *count; i++) {
+		t = (double) i / rate;
+		x = 0.02 * ((double) rand () / RAND_MAX - 0.5);
+		if (t >= offset) {
+			eighth = (int) floor ((t - offset) / (beat / 2));
+			dt = t - offset - eighth * (beat / 2);
+			if (eighth % 4 == 0) x += 0.8 * sin (2 * PI * 55 * dt) * exp (-dt / 0.08);						// kick
+			if (eighth % 4 == 2) x += 0.5 * ((double) rand () / RAND_MAX - 0.5) * exp (-dt / 0.05);		// snare
+			x += 0.15 * ((double) rand () / RAND_MAX - 0.5) * exp (-dt / 0.01);								// hi-hat
+		}
+		if (x > 1.0) x = 1.0;
+		if (x < -1.0) x = -1.0;
+		samples [i] = (int16_t) (x * 32767);
+	}
+	return samples;
+}
+
+
+// distance of "period" to "expected" period, or to its half and double if "octave"
+static double distance (double period, double expected, bool octave)
+{
+	double d = fabs (period - expected);
+
+	if (octave && fabs (period - expected / 2) < d) d = fabs (period - expected / 2);
+	if (octave && fabs (period - expected * 2) < d) d = fabs (period - expected * 2);
+	return d;
+}
+
+
+// track "count" "samples" at "rate" (Hz), of "expected" period (sec), in the right octave unless "octave"
+static void track (const int16_t * samples, uint32_t count, uint32_t rate, double expected, bool octave, struct tracking * result)
+{
+	uint16_t frame [BEAT_HOP];
+	struct beat_estimate estimate;
+	uint32_t frames = 0, i;
+	double position, a;
+	int32_t x;
+	size_t index;
+	clock_t start;
+
+	result->locked = false;
+	result->worst = expected;
+	beat_init ();
+	start = clock ();
+	for (position = 0; ; frames++) {
+		// linear interpolation to BEAT_SAMPLE_RATE, then 12-bit unsigned
+		for (i = 0; i < BEAT_HOP; i++, position += (double) rate / BEAT_SAMPLE_RATE) {
+			index = (size_t) position;
+			if (index + 1 >= count) break;
+			a = position - index;
+			x = (int32_t) ((1 - a) * samples [index] + a * samples [index + 1]);
+			frame [i] = (uint16_t) ((x >> 4) + 2048);
+		}
+		if (i < BEAT_HOP) break;
+
+		if (beat_process (frame, &estimate) && estimate.locked) {
+			if (!result->locked) result->lock_time = (double) (frames + 1) * BEAT_HOP / BEAT_SAMPLE_RATE;
+			result->locked = true;
+			result->period = estimate.period / 1e6;
+			result->last_beat = (double) estimate.last_beat / BEAT_SAMPLE_RATE;
+			if (distance (result->period, expected, octave) > distance (result->worst, expected, octave)) result->worst = result->period;
+		}
+	}
+	result->frame_usec = frames ? (1e6 * (clock () - start) / CLOCKS_PER_SEC) / frames : 0;
+}
+
+
+// track WAV file "path" of tempo "bpm", its first beat at "offset" sec (negative if not known); half or double tempo
+// accepted if "octave"
+static void check_file (const char * path, double bpm, double offset, bool octave)
+{
+	struct tracking result;
+	uint32_t count, rate;
+	int16_t * samples = wav_read (path, &count, &rate);
+	double period = 60.0 / bpm, grid, phase;
+
+	CHECK (samples != NULL);
+	if (samples == NULL) return;
+	track (samples, count, rate, period, octave, &result);
+	free (samples);
+
+	printf ("%s: %.1f BPM", path, bpm);
+	if (!result.locked) printf (": not locked\n");
+	else {
+		// beats of the expected period, or of its half or double when it is the one reported
+		grid = period;
+		if (octave && fabs (result.period - period / 2) < fabs (result.period - grid)) grid = period / 2;
+		if (octave && fabs (result.period - period * 2) < fabs (result.period - grid)) grid = period * 2;
+		phase = fmod (result.last_beat - offset, grid);
+		if (phase > grid / 2) phase -= grid;
+		printf (": %.2f BPM (worst %.2f), locked after %.2f s", 60.0 / result.period, 60.0 / result.worst, result.lock_time);
+		if (offset >= 0) printf (", phase error %+.1f ms", phase * 1000);
+		printf (", %.1f us per frame\n", result.frame_usec);
+	}
+
+	CHECK (result.locked);
+	CHECK (!result.locked || distance (result.worst, period, octave) <= period * TEMPO_TOLERANCE);
+	CHECK (!result.locked || result.lock_time <= LOCK_TIME);
+	CHECK (!result.locked || offset < 0 || fabs (phase) <= PHASE_TOLERANCE);
+}
+
+
+int main (int argc, char * argv [])
+{
+	static const struct { double bpm; uint32_t rate; bool octave; } loops [] = {
+		{ 70, BEAT_SAMPLE_RATE, true }, { 85, BEAT_SAMPLE_RATE, false }, { 90, BEAT_SAMPLE_RATE, false },
+		{ 100, BEAT_SAMPLE_RATE, false }, { 110, BEAT_SAMPLE_RATE, false }, { 120, BEAT_SAMPLE_RATE, false },
+		{ 140, BEAT_SAMPLE_RATE, false }, { 150, BEAT_SAMPLE_RATE, false }, { 165, BEAT_SAMPLE_RATE, false },
+		{ 180, BEAT_SAMPLE_RATE, true }, { 104, 44100, false }, { 132.5, 44100, false }
+	};
+	char path [64];
+	int16_t * samples;
+	uint32_t count, i;
+	double offset;
+
+	if (argc == 3) {
+		check_file (argv [1], atof (argv [2]), -1, false);
+		return HOSTTEST_RESULT ();
+	}
+
+	for (i = 0; i < sizeof (loops) / sizeof (loops [0]); i++) {
+		offset = 0.1 + 0.05 * i;
+		snprintf (path, sizeof (path), "loop_%g_%u.wav", loops [i].bpm, loops [i].rate);
+		samples = drum_loop (loops [i].bpm, loops [i].rate, offset, &count);
+		CHECK (wav_write (path, samples, count, loops [i].rate));
+		free (samples);
+		check_file (path, loops [i].bpm, offset, loops [i].octave);
+	}
+	return HOSTTEST_RESULT ();
+}
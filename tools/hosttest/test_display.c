@@ -0,0 +1,134 @@
+/**
+ * @file test_display.c
+ * @brief Status screen renderer: dirty regions sent to a simulated SSD1306 keep it equal to the framebuffer
+ *
+ * Dirty regions are copied into a simulated display memory, the way the OLED driver sends them. After each render,
+ * the simulated memory has to match a screen rendered from scratch with the same status, and only the pages of the
+ * fields that changed may be sent. The screen is printed in text, as a preview of the layout.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include <string.h>
+#include "display.h"
+#include "hosttest.h"
+
+// globals
+static uint8_t screen [DISPLAY_PAGES][DISPLAY_WIDTH];		// simulated display memory
+
+
+// send dirty regions to the simulated display; returns a mask of the pages sent, with the number of bytes in "bytes"
+static uint32_t flush (uint32_t * bytes)
+{
+	const uint8_t * data;
+	uint8_t page, column;
+	uint32_t lg, pages = 0;
+
+	*bytes = 0;
+	while ((lg = display_next_dirty (&page, &column, &data)) != 0) {
+		CHECK (page < DISPLAY_PAGES && column + lg <= DISPLAY_WIDTH);
+		CHECK (!(pages & (1u << page)));			// one run per page
+		memcpy (&screen [page][column], data, lg);
+		pages |= 1u << page;
+		*bytes += lg;
+	}
+	return pages;
+}
+
+
+// returns true if the simulated display shows "status" as rendered from scratch; the renderer is left on "status"
+static bool shows (const struct display_status * status)
+{
+	uint8_t saved [DISPLAY_PAGES][DISPLAY_WIDTH];
+	uint32_t bytes;
+
+	memcpy (saved, screen, sizeof (screen));
+	display_init ();
+	display_render (status);
+	flush (&bytes);
+	return memcmp (saved, screen, sizeof (screen)) == 0;
+}
+
+
+// print the simulated display, one character per pixel, rows 2 by 2
+static void print_screen (void)
+{
+	uint32_t row, x, top, bottom;
+
+	for (row = 0; row < DISPLAY_PAGES * 8; row += 2) {
+		for (x = 0; x < DISPLAY_WIDTH; x++) {
+			top = (screen [row / 8][x] >> (row % 8)) & 1;
+			bottom = (screen [row / 8][x] >> (row % 8 + 1)) & 1;
+			putchar (top ? (bottom ? '#' : '"') : (bottom ? '.' : ' '));
+		}
+		putchar ('\n');
+	}
+}
+
+
+int main (void)
+{
+	struct display_status status = { .bpm = 1200, .song = 0, .transport = DISPLAY_STOP, .bar = 1, .beat = 1, .connected = true,
+		.activity = DISPLAY_NO_ACTIVITY, .progress = 0 };
+	uint32_t pages, bytes;
+
+	// first render: whole screen is sent, including the clearing of the display
+	display_init ();
+	display_render (&status);
+	pages = flush (&bytes);
+	CHECK (pages == 0xFF);
+	CHECK (bytes == DISPLAY_PAGES * DISPLAY_WIDTH);
+	print_screen ();
+
+	// same status: nothing to send
+	display_render (&status);
+	CHECK (flush (&bytes) == 0);
+
+	// next beat: bar.beat pages only
+	status.beat = 2;
+	status.transport = DISPLAY_PLAY;
+	display_render (&status);
+	pages = flush (&bytes);
+	CHECK (pages == ((1u << 5) | (1u << 6) | (1u << 7)));
+	CHECK (shows (&status));
+
+	// tempo: 120.0 to 120.5 only redraws the last digit
+	status.bpm = 1205;
+	display_render (&status);
+	pages = flush (&bytes);
+	CHECK (pages == ((1u << 0) | (1u << 1)));
+	CHECK (bytes <= 2 * 2 * 2 * 6);
+	CHECK (shows (&status));
+
+	// backup progress replaces transport state; "NO USB" when device is gone; back to transport state
+	status.activity = DISPLAY_BACKUP;
+	status.progress = 42;
+	status.connected = false;
+	display_render (&status);
+	CHECK (flush (&bytes) == (1u << 5));
+	CHECK (shows (&status));
+	print_screen ();
+	status.activity = DISPLAY_NO_ACTIVITY;
+	status.connected = true;
+	display_render (&status);
+	flush (&bytes);
+	CHECK (shows (&status));
+
+	// count-in bars and fields at their widest
+	status.transport = DISPLAY_COUNT_IN;
+	status.bar = -1;
+	status.song = 31;
+	status.bpm = 2400;
+	display_render (&status);
+	flush (&bytes);
+	CHECK (shows (&status));
+	status.bar = 9999;
+	display_render (&status);
+	flush (&bytes);
+	CHECK (shows (&status));
+
+	return HOSTTEST_RESULT ();
+}
@@ -0,0 +1,56 @@
+/**
+ * @file test_drums.c
+ * @brief Drum follower: locking on a steady beat, and keeping lock through early hits and simultaneous notes
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include "drums.h"
+#include "hosttest.h"
+
+#define KICK		36
+#define SNARE		38
+#define PERIOD		500000		// 120 BPM (usec)
+#define START		1000000
+
+
+int main (void)
+{
+	uint32_t period = 0;
+	uint64_t beat = 0, t;
+	bool locked = false;
+	int i;
+
+	// steady kicks lock the follower on their tempo
+	drums_init (0);
+	for (i = 0; i < 8; i++) locked = drums_note (KICK, START + (uint64_t) i * PERIOD, &period, &beat);
+	CHECK (locked);
+	CHECK (period == PERIOD);
+	CHECK (beat == START + 7 * PERIOD);
+
+	// early kick puts last beat of grid after it; snare of the same USB packet (same time) is the same hit
+	t = START + 8 * PERIOD - 40000;
+	CHECK (drums_note (KICK, t, &period, &beat));
+	CHECK (beat > t);
+	CHECK (!drums_note (SNARE, t, &period, &beat));
+	CHECK (drums_note (KICK, START + 9 * PERIOD, &period, &beat));
+
+	// early kick, then snare a bit later but still before last beat of grid: same beat, lock is kept
+	t = START + 10 * PERIOD - 40000;
+	CHECK (drums_note (KICK, t, &period, &beat));
+	CHECK (!drums_note (SNARE, t + 1000, &period, &beat));
+	CHECK (drums_note (KICK, START + 11 * PERIOD, &period, &beat));
+	CHECK (period > PERIOD * 9 / 10 && period < PERIOD * 11 / 10);
+
+	// drummer stops: grid is dropped, and locks again after a few beats
+	t = START + 20 * PERIOD;
+	CHECK (!drums_note (KICK, t, &period, &beat));
+	CHECK (!drums_note (KICK, t + PERIOD, &period, &beat));
+	for (i = 2; i < 5; i++) locked = drums_note (KICK, t + (uint64_t) i * PERIOD, &period, &beat);
+	CHECK (locked);
+
+	return HOSTTEST_RESULT ();
+}
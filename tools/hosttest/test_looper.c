@@ -0,0 +1,104 @@
+/**
+ * @file test_looper.c
+ * @brief Looper: recorded events are not echoed on their recording pass, and play on every pass after STOP then PLAY
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include "looper.h"
+#include "hosttest.h"
+
+#define BAR_TICKS	96
+#define BARS		1
+#define PREROLL		48
+
+// globals
+struct arena_layout arena;
+
+
+// tick "tick" of the song: returns true if the loop sends note "note" on it
+static bool plays (int32_t tick, uint8_t note)
+{
+	uint8_t buffer [64];
+	uint32_t lg, i;
+
+	looper_tick (tick, BAR_TICKS, BARS);
+	lg = looper_play (buffer, sizeof (buffer));
+	for (i = 0; i + 2 < lg; i += 3) {
+		if (buffer [i] == 0x90 && buffer [i + 1] == note) return true;
+	}
+	return false;
+}
+
+
+// note on then off of "note" received from the groovebox at "tick"
+static void receive (int32_t tick, uint8_t note)
+{
+	uint8_t on [3] = { 0x90, note, 100 }, off [3] = { 0x80, note, 0 };
+
+	looper_rx (on, 3, (uint32_t) tick << 8);
+	looper_rx (off, 3, (uint32_t) (tick + 4) << 8);
+}
+
+
+// STOP then PLAY: transport stop, then the song restarts from its first tick (after a pre-roll)
+static void restart (void)
+{
+	uint8_t buffer [64];
+
+	// all notes off on channel 0, the channel of the loop
+	CHECK (looper_stop (buffer, sizeof (buffer)) == 3);
+	CHECK (buffer [0] == 0xB0 && buffer [1] == 123 && buffer [2] == 0);
+}
+
+
+int main (void)
+{
+	looper_init ();
+	looper_press ();
+	CHECK (looper_state () == LOOPER_ARMED);
+
+	// first pass records note 60 at tick 10: not echoed while it is recorded, played on the next pass
+	CHECK (!plays (0, 60));
+	CHECK (looper_state () == LOOPER_RECORD);
+	receive (10, 60);
+	CHECK (!plays (10, 60));
+	CHECK (plays (BAR_TICKS + 10, 60));
+	CHECK (looper_state () == LOOPER_PLAY);
+
+	// overdub on pass 2, note 62 at tick 30: played from pass 3 on
+	looper_press ();
+	CHECK (looper_state () == LOOPER_OVERDUB);
+	receive (2 * BAR_TICKS + 30, 62);
+	CHECK (!plays (2 * BAR_TICKS + 30, 62));
+	looper_press ();
+	CHECK (plays (3 * BAR_TICKS + 30, 62));
+
+	// STOP then PLAY: every pass of the song plays both notes, including pass 0 and 2
+	restart ();
+	CHECK (!plays (-PREROLL, 60));
+	CHECK (plays (10, 60));
+	CHECK (plays (30, 62));
+	CHECK (plays (2 * BAR_TICKS + 10, 60));
+	CHECK (plays (2 * BAR_TICKS + 30, 62));
+
+	// overdub on pass 1, stopped before the end of the pass: played on pass 1 after PLAY
+	looper_press ();
+	receive (BAR_TICKS + 50, 64);
+	CHECK (!plays (BAR_TICKS + 50, 64));
+	looper_press ();
+	restart ();
+	CHECK (plays (50, 64));
+	CHECK (plays (BAR_TICKS + 50, 64));
+
+	// remove last overdub: its note is gone, the others stay
+	looper_undo ();
+	CHECK (!plays (BAR_TICKS + 50, 64));
+	CHECK (plays (BAR_TICKS + 30, 62));
+	CHECK (plays (BAR_TICKS + 10, 60));
+
+	return HOSTTEST_RESULT ();
+}
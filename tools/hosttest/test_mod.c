@@ -0,0 +1,96 @@
+/**
+ * @file test_mod.c
+ * @brief Modulation lanes: rate limits, per-tick budget, rest values, and no gap when the song restarts from its pre-roll
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include <stddef.h>
+#include "mod.h"
+#include "hosttest.h"
+
+#define BEAT_TICKS	24
+#define PREROLL		48			// song restarts on tick -PREROLL, as after a PLAY without count-in
+
+// globals
+static const struct mod_lane lanes [] = {
+	{ .channel = 0, .cc = 74, .shape = MOD_SHAPE_TRIANGLE, .beats = 4, .low = 0, .high = 127, .rest = 64, .min_ticks = 6 },
+	{ .channel = 1, .cc = 1, .shape = MOD_SHAPE_RAMP, .beats = 1, .low = 0, .high = 127, .rest = MOD_NO_REST, .min_ticks = 1 },
+	{ .channel = 2, .cc = 10, .shape = MOD_SHAPE_SINE, .beats = 2, .low = 127, .high = 0, .rest = 0, .min_ticks = 1 },
+};
+
+
+// clock tick "tick": returns number of CC messages sent on controller "cc", with the last value in "value"
+static uint32_t sent (int32_t tick, uint8_t cc, uint8_t * value)
+{
+	uint8_t buffer [64];
+	uint32_t lg, i, count = 0;
+
+	lg = mod_tick (tick, buffer, sizeof (buffer));
+	CHECK (lg % 3 == 0 && lg <= 3 * MOD_MAX_PER_TICK);
+	for (i = 0; i + 2 < lg; i += 3) {
+		CHECK ((buffer [i] & 0xF0) == 0xB0 && buffer [i + 1] < 128 && buffer [i + 2] < 128);
+		if (buffer [i + 1] == cc) {
+			*value = buffer [i + 2];
+			count++;
+		}
+	}
+	return count;
+}
+
+
+int main (void)
+{
+	static const struct mod_lane bad [] = {
+		{ .channel = 0, .cc = 1, .shape = MOD_SHAPE_RAMP, .beats = 1, .low = 0, .high = 127, .rest = 0, .min_ticks = 1 },
+		{ .channel = 0, .cc = 2, .shape = MOD_SHAPE_STEPS, .beats = 1, .rest = 0, .min_ticks = 1, .nb_steps = 2, .steps = { 0, 128 } },
+	};
+	int32_t tick, last = 0, gap = 0;
+	uint32_t count = 0;
+	uint8_t value = 0;
+
+	// table is cut at the first lane with an out of range value
+	mod_init (bad, 2);
+	CHECK (mod_start ());
+	for (tick = 0; tick < BEAT_TICKS; tick++) count += sent (tick, 2, &value);
+	CHECK (count == 0);
+
+	mod_init (lanes, sizeof (lanes) / sizeof (lanes [0]));
+	CHECK (mod_start ());
+	CHECK (!mod_start ());
+
+	// first bars: rate limit of the triangle lane, at most one tick late because of the per-tick budget of 3 lanes
+	for (tick = 0; tick < 8 * BEAT_TICKS; tick++) {
+		if (sent (tick, 74, &value)) {
+			if (count > 0) CHECK (tick - last >= 6 && tick - last <= 6 + 1);
+			last = tick;
+			count++;
+		}
+	}
+	CHECK (count >= 8 * BEAT_TICKS / (6 + 1));
+
+	// song restarts from its pre-roll: the triangle lane goes on at its rate, without waiting for the old song position
+	for (tick = -PREROLL, count = 0; tick < 0; tick++) {
+		if (sent (tick, 74, &value)) {
+			if (count == 0) gap = tick + PREROLL;
+			count++;
+		}
+	}
+	CHECK (gap <= 1);
+	CHECK (count >= PREROLL / (6 + 1));
+
+	// stop: lanes go to their rest values, except MOD_NO_REST, then nothing more is sent
+	mod_stop ();
+	CHECK (!mod_running ());
+	value = 0xFF;
+	for (tick = 0, count = 0; tick < 4; tick++) count += sent (tick, 74, &value);
+	CHECK (count == 1 && value == 64);
+	for (tick = 0, count = 0; tick < 4; tick++) count += sent (tick, 1, &value);
+	CHECK (count == 0);
+	CHECK (mod_tick (4, (uint8_t [64]) { 0 }, 64) == 0);
+
+	return HOSTTEST_RESULT ();
+}
@@ -0,0 +1,122 @@
+/**
+ * @file test_preroll.c
+ * @brief Pre-roll simulator: settling time of receiver tempo estimators fed by the pedal clock through USB
+ *
+ * The pedal streams clock ticks at target tempo; each tick reaches the receiver at the start of the next USB frame
+ * (1 ms), plus up to USB_JITTER of polling delay. Two common kinds of receivers estimate the tempo from the ticks:
+ * - average: mean of the last 24 intervals (one beat);
+ * - filter: one-pole low pass on intervals, of gain 1/8.
+ * A receiver has settled when its estimate stays within TOLERANCE of the target tempo from then on. Starts are
+ * simulated from a stopped clock (receiver has no estimate) and right after a tap changed the tempo (receiver starts
+ * from the previous tempo, the worst case). Every receiver has to settle before MIDI_PLAY, which goes out after the
+ * ticks of transport_preroll (); a start with no pre-roll is shown for comparison.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include <stdlib.h>
+#include <math.h>
+#include "transport.h"
+#include "hosttest.h"
+
+#define NB_TICKS		24
+#define USB_FRAME		1000		// usec
+#define USB_JITTER		300			// usec
+#define TOLERANCE		0.015		// relative error of tempo estimate
+#define SIM_TICKS		480			// ticks simulated per start
+#define FILTER_GAIN		8
+#define AVERAGE			24
+
+#define RECEIVER_AVERAGE	0
+#define RECEIVER_FILTER		1
+
+// start of the clock
+struct start {
+	double from_bpm;			// tempo of the clock before the start; 0 if it was stopped
+	double bpm;					// target tempo
+};
+
+
+// tempo estimated by "receiver" after each of SIM_TICKS ticks of a clock at "bpm" reaching it through USB, in
+// "estimate" (BPM); receiver starts from "from_bpm" (0 for none)
+static void simulate (int receiver, double from_bpm, double bpm, double * estimate)
+{
+	double period = 60e6 / (bpm * NB_TICKS), sent, arrival, previous = 0, interval, filtered = 0, sum = 0;
+	double window [AVERAGE];
+	int i, n = 0;
+
+	// intervals of the previous tempo fill the receiver history
+	for (i = 0; i < AVERAGE; i++) window [i] = from_bpm ? 60e6 / (from_bpm * NB_TICKS) : 0;
+	if (from_bpm) {
+		filtered = window [0];
+		sum = window [0] * AVERAGE;
+		n = AVERAGE;
+	}
+
+	srand (2);
+	for (i = 0; i < SIM_TICKS; i++) {
+		sent = 1000000 + i * period;
+		arrival = ceil (sent / USB_FRAME) * USB_FRAME + (rand () % (USB_JITTER + 1));
+		if (i > 0 || from_bpm) {
+			interval = (i > 0) ? arrival - previous : window [0];
+			if (receiver == RECEIVER_AVERAGE) {
+				sum += interval - window [i % AVERAGE];
+				window [i % AVERAGE] = interval;
+				if (n < AVERAGE) n++;
+				filtered = sum / n;
+			}
+			else filtered = (filtered == 0) ? interval : filtered + (interval - filtered) / FILTER_GAIN;
+		}
+		previous = arrival;
+		estimate [i] = filtered ? 60e6 / (filtered * NB_TICKS) : 0;
+	}
+}
+
+
+// first tick from which "estimate" stays within TOLERANCE of "bpm"
+static int settling (const double * estimate, double bpm)
+{
+	int i;
+
+	for (i = SIM_TICKS - 1; i >= 0; i--) {
+		if (fabs (estimate [i] - bpm) > bpm * TOLERANCE) return i + 1;
+	}
+	return 0;
+}
+
+
+int main (void)
+{
+	static const struct start starts [] = { { 0, 90 }, { 0, 120 }, { 0, 160 }, { 120, 90 }, { 90, 140 }, { 140, 70 } };
+	static const char * const names [] = { "average", "filter" };
+	double estimate [SIM_TICKS];
+	int32_t preroll = transport_preroll (0, TRANSPORT_PREROLL_TICKS, NB_TICKS);
+	int receiver, settled, worst = 0;
+	uint32_t i;
+
+	// pre-roll rule: whole beats, and only what receivers still need
+	CHECK (transport_preroll (0, 48, 24) == 48);
+	CHECK (transport_preroll (30, 48, 24) == 24);
+	CHECK (transport_preroll (47, 48, 24) == 1);
+	CHECK (transport_preroll (1000, 48, 24) == 1);
+
+	printf ("pre-roll of %d ticks; receiver, start: settling time (ticks), tempo error at MIDI_PLAY without and with pre-roll\n", preroll);
+	for (receiver = RECEIVER_AVERAGE; receiver <= RECEIVER_FILTER; receiver++) {
+		for (i = 0; i < sizeof (starts) / sizeof (starts [0]); i++) {
+			simulate (receiver, starts [i].from_bpm, starts [i].bpm, estimate);
+			settled = settling (estimate, starts [i].bpm);
+			if (settled > worst) worst = settled;
+			// MIDI_PLAY right after tick "preroll - 1": receiver starts on tick "preroll" with the estimate of tick "preroll - 1"
+			printf ("%-8s %3g -> %3g BPM: %3d ticks, ", names [receiver], starts [i].from_bpm, starts [i].bpm, settled);
+			if (estimate [0] == 0) printf ("no estimate without, ");
+			else printf ("%+.1f%% without, ", 100 * (estimate [0] - starts [i].bpm) / starts [i].bpm);
+			printf ("%+.1f%% with\n", 100 * (estimate [preroll - 1] - starts [i].bpm) / starts [i].bpm);
+			CHECK (settled <= preroll);
+		}
+	}
+	printf ("worst settling time: %d ticks\n", worst);
+	return HOSTTEST_RESULT ();
+}
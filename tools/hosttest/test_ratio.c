@@ -0,0 +1,94 @@
+/**
+ * @file test_ratio.c
+ * @brief Clock ratios: exact output count, even spacing of output ticks, realignment on reset (MIDI_PLAY, session change),
+ * and no tick lost when it cannot be written right away
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include "ratio.h"
+#include "hosttest.h"
+
+#define INTERVAL	20833		// usec between master ticks, 120 BPM
+#define MASTER		(24 * 16)	// master ticks simulated per ratio: 4 bars
+#define STEP		10			// usec, main loop
+
+
+// run "ratio" for "master" master ticks from "start" (usec); output tick times in "out" (at most "max"); returns the
+// number of output ticks
+static uint32_t run (struct clock_ratio * ratio, uint64_t start, uint32_t master, uint64_t * out, uint32_t max)
+{
+	uint32_t i, n, count = 0;
+	uint64_t time, now;
+
+	for (i = 0; i < master; i++) {
+		time = start + (uint64_t) i * INTERVAL;
+		for (n = ratio_tick (ratio, time, INTERVAL); n > 0; n--) {
+			if (count < max) out [count] = time;
+			count++;
+		}
+		for (now = time; now < time + INTERVAL; now += STEP) {
+			while (ratio_due (ratio, now)) {
+				if (count < max) out [count] = now;
+				count++;
+			}
+		}
+	}
+	return count;
+}
+
+
+int main (void)
+{
+	static uint64_t out [MASTER * RATIO_MAX];
+	struct clock_ratio ratio;
+	uint32_t num, den, count, i;
+	int64_t spacing, expected;
+
+	// every ratio: num output ticks for den master ticks, evenly spaced within the main loop step
+	for (num = 1; num <= RATIO_MAX; num++) {
+		for (den = 1; den <= RATIO_MAX; den++) {
+			ratio_init (&ratio, num, den);
+			count = run (&ratio, 0, MASTER * den, out, 0);
+			CHECK (count == MASTER * num);
+		}
+	}
+	for (num = 1; num <= RATIO_MAX; num++) {
+		ratio_init (&ratio, num, 3);
+		count = run (&ratio, 0, MASTER, out, MASTER * RATIO_MAX);
+		expected = (int64_t) INTERVAL * 3 / num;
+		for (i = 1; i < count; i++) {
+			spacing = (int64_t) (out [i] - out [i - 1]);
+			CHECK (spacing >= expected - STEP && spacing <= expected + STEP);
+		}
+	}
+
+	// reset in the middle of a 3:2 cycle (session change): next master tick is output tick 0, nothing left pending
+	ratio_init (&ratio, 3, 2);
+	run (&ratio, 0, 1, out, MASTER * RATIO_MAX);
+	ratio_reset (&ratio);
+	CHECK (!ratio_due (&ratio, INTERVAL));
+	CHECK (ratio_tick (&ratio, INTERVAL, INTERVAL) == 1);
+	count = run (&ratio, 2 * INTERVAL, 2 * 2 - 1, out, MASTER * RATIO_MAX);
+	CHECK (count + 1 == 2 * 3);
+
+	// a tick peeked but not written (lane full) stays due until it is taken
+	ratio_init (&ratio, 2, 1);
+	CHECK (ratio_tick (&ratio, 0, INTERVAL) == 1);
+	CHECK (!ratio_peek (&ratio, INTERVAL / 2 - 1));
+	CHECK (ratio_peek (&ratio, INTERVAL / 2) && ratio_peek (&ratio, INTERVAL / 2));
+	ratio_take (&ratio);
+	CHECK (!ratio_peek (&ratio, INTERVAL / 2));
+	CHECK (ratio_tick (&ratio, INTERVAL, INTERVAL) == 1);
+	CHECK (ratio_peek (&ratio, INTERVAL + INTERVAL / 2));
+	CHECK (ratio_tick (&ratio, 2 * INTERVAL, INTERVAL) == 2);		// never written: sent with next master tick
+
+	// clamped to 1..RATIO_MAX
+	ratio_init (&ratio, 0, RATIO_MAX + 1);
+	CHECK (ratio.num == 1 && ratio.den == RATIO_MAX);
+
+	return HOSTTEST_RESULT ();
+}
@@ -0,0 +1,86 @@
+/**
+ * @file test_reclock.c
+ * @brief Re-clocker: jitter of incoming and regenerated ticks for a groovebox clock read through USB
+ *
+ * The groovebox sends evenly spaced ticks; each one is read at the start of the next USB frame (1 ms), plus up to
+ * USB_JITTER of polling delay, and sometimes two ticks are read in the same poll. The main loop calls
+ * reclock_output () every LOOP_PERIOD. Jitter is the one reported by reclock_stats (), the figures the firmware prints
+ * with DEBUG_STATS. No tick may be lost or added, and the PLL has to follow a tempo change.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include <stdlib.h>
+#include <math.h>
+#include "reclock.h"
+#include "hosttest.h"
+
+#define NB_TICKS		24
+#define USB_FRAME		1000		// usec
+#define USB_JITTER		300			// usec
+#define LATE_POLL		50			// one poll in LATE_POLL is a frame late, and reads 2 ticks at once
+#define LOOP_PERIOD		20			// usec, main loop
+#define WINDOWS			4			// jitter windows of RECLOCK_STATS_TICKS simulated per tempo
+#define OUT_MAX			200			// usec, maximum jitter of regenerated ticks once locked
+#define PERIOD_TOLERANCE	0.002	// relative error of period followed
+
+
+// run groovebox clock at "bpm" from "start" (usec) for WINDOWS jitter windows; time of next tick in "start";
+// regenerated ticks counted in "out"; stats of last window in "stats"; returns number of windows reported
+static uint32_t run (double bpm, uint64_t * start, uint32_t * out, struct reclock_stats * stats)
+{
+	double period = 60e6 / (bpm * NB_TICKS);
+	uint32_t ticks = WINDOWS * RECLOCK_STATS_TICKS, i, windows = 0;
+	uint64_t sent, arrival, now = *start;
+	struct reclock_stats window;
+
+	for (i = 0; i < ticks; i++) {
+		sent = *start + (uint64_t) (i * period);
+		arrival = (sent / USB_FRAME + 1) * USB_FRAME + (uint64_t) (rand () % (USB_JITTER + 1));
+		if (rand () % LATE_POLL == 0) arrival += USB_FRAME;
+		for (; now < arrival; now += LOOP_PERIOD) {
+			if (reclock_output (now)) (*out)++;
+		}
+		reclock_input (arrival);
+		if (reclock_stats (&window)) {
+			*stats = window;
+			windows++;
+			printf ("%6.1f BPM: period %lu us, jitter in max %lu mean %lu us, jitter out max %lu mean %lu us\n", bpm,
+				(unsigned long) window.period, (unsigned long) window.in_max, (unsigned long) window.in_mean,
+				(unsigned long) window.out_max, (unsigned long) window.out_mean);
+		}
+	}
+	*start += (uint64_t) (ticks * period);
+	return windows;
+}
+
+
+int main (void)
+{
+	static const double tempos [] = { 120, 90, 174.5 };
+	struct reclock_stats stats;
+	uint64_t start = 1000000, now;
+	uint32_t out = 0, i, windows;
+
+	srand (3);
+	reclock_init ();
+	for (i = 0; i < sizeof (tempos) / sizeof (tempos [0]); i++) {
+		windows = run (tempos [i], &start, &out, &stats);
+		CHECK (windows >= WINDOWS - 1);
+		// last window, locked on the new tempo: period followed, jitter of USB removed
+		CHECK (fabs (stats.period - 60e6 / (tempos [i] * NB_TICKS)) <= 60e6 / (tempos [i] * NB_TICKS) * PERIOD_TOLERANCE);
+		CHECK (stats.in_max > USB_FRAME / 2);
+		CHECK (stats.out_max <= OUT_MAX);
+		CHECK (stats.out_mean * 4 < stats.in_mean);
+	}
+
+	// flush queue: one regenerated tick per incoming tick
+	for (now = start; now < start + 2 * RECLOCK_DELAY; now += LOOP_PERIOD) {
+		if (reclock_output (now)) out++;
+	}
+	CHECK (out == WINDOWS * RECLOCK_STATS_TICKS * (sizeof (tempos) / sizeof (tempos [0])));
+	return HOSTTEST_RESULT ();
+}
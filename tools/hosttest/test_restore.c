@@ -0,0 +1,344 @@
+/**
+ * @file test_restore.c
+ * @brief SysEx restore: clock ticks and other midi interleaved with a paced restore, through a simulated USB-MIDI stream
+ *
+ * The stream packs bytes into USB-MIDI packets as the host driver does, into an endpoint of ENDPOINT_PACKETS packets
+ * drained one packet every PACKET_TIME, so that writes come back short. A realtime byte written while a SysEx packet
+ * is partly filled is packed into it as data: this is the corruption the restore has to avoid. The main loop runs
+ * restore_task () and a realtime lane that sends a clock tick every TICK and a CC every CC_PERIOD through
+ * restore_sendable (); reads of the stick last READ_TIME, with the lane and the endpoint running meanwhile, as from the
+ * idle callback of the stick. The device has to receive the files byte for byte, every clock tick in a packet of its
+ * own, and every CC outside the SysEx messages. Beyond what the endpoint holds, the wire may only wait for the first
+ * read of each file, and a paced restore has to take the time of its byte rate and gaps. The groovebox unplugged in
+ * the middle of a message ends the restore and releases the lane.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include <string.h>
+#include "ff.h"
+#include "stick.h"
+#include "restore.h"
+#include "hosttest.h"
+
+#define DEV_ADDR			1
+#define LOOP				50			// usec, main loop pass
+#define READ_TIME			1000		// usec, read of a sector
+#define ENDPOINT_PACKETS	16			// packets held by the endpoint
+#define PACKET_TIME			62			// usec, one packet drained
+#define TICK				2000		// usec between clock ticks
+#define CC_PERIOD			7000		// usec between CC messages
+#define LANE_SIZE			64
+#define FILES				2
+#define FILE_MAX			4096
+#define RATE				3125		// bytes per second of the paced restore, as DIN MIDI
+#define GAP					2000		// usec after each message of the paced restore
+#define SIM_TIME			10000000	// usec, at most per restore
+
+// simulated stick
+struct sim_file {
+	const char * name;
+	uint8_t data [FILE_MAX];
+	uint32_t size;
+};
+
+// globals
+struct arena_layout arena;
+static uint8_t sector_blocks [RESTORE_BUFFERS][RESTORE_BUFFER];
+static bool sector_taken [RESTORE_BUFFERS];
+static struct sim_file files [FILES + 1] = { { .name = "B.SYX" }, { .name = "README.TXT" }, { .name = "A.SYX" } };
+static uint64_t now = 0;
+static uint32_t read_idle = 0;					// usec the endpoint was empty while reading the stick
+static uint32_t endpoint = 0;					// packets in the endpoint
+static uint64_t drained = 0;					// time up to which the endpoint has been drained
+static uint8_t packet [3];						// packet being filled by the stream, and its bytes
+static uint32_t packet_lg = 0;
+static uint8_t received [2 * FILES * FILE_MAX];	// bytes received by the device, except clock ticks in their own packet
+static uint32_t nb_received = 0;
+static uint32_t clocks_received = 0;
+static uint8_t lane [LANE_SIZE];				// realtime lane
+static uint32_t lane_lg = 0;
+static uint32_t clocks_sent = 0, ccs_sent = 0;
+static uint64_t next_tick = 0, next_cc = 0;
+
+
+// simulated arena: the sector pool
+bool arena_get_blocks (enum arena_pool pool, uint8_t ** blocks, uint32_t count)
+{
+	uint32_t i;
+
+	CHECK (pool == ARENA_POOL_sector && count == RESTORE_BUFFERS && !sector_taken [0]);
+	for (i = 0; i < count; i++) {
+		blocks [i] = sector_blocks [i];
+		sector_taken [i] = true;
+	}
+	return true;
+}
+
+void arena_put_blocks (enum arena_pool pool, uint8_t ** blocks, uint32_t count)
+{
+	uint32_t i;
+
+	(void) pool;
+	for (i = 0; i < count; i++) {
+		if (blocks [i]) sector_taken [i] = false;
+		blocks [i] = NULL;
+	}
+}
+
+
+// device receives a packet
+static void receive (void)
+{
+	if (packet_lg == 1 && packet [0] >= 0xF8) clocks_received++;
+	else {
+		memcpy (received + nb_received, packet, packet_lg);
+		nb_received += packet_lg;
+	}
+	packet_lg = 0;
+	endpoint++;
+}
+
+
+// simulated USB-MIDI stream: a byte is taken only if the endpoint has room for a packet
+uint32_t tuh_midi_stream_write (uint8_t dev_addr, uint8_t cable_num, uint8_t const * buffer, uint32_t bufsize)
+{
+	uint32_t i;
+	uint8_t byte;
+
+	(void) cable_num;
+	CHECK (dev_addr == DEV_ADDR);
+	for (i = 0; i < bufsize && endpoint < ENDPOINT_PACKETS; i++) {
+		byte = buffer [i];
+		if (byte >= 0xF8 && packet_lg == 0) {
+			packet [packet_lg++] = byte;
+			receive ();
+			continue;
+		}
+		// a realtime byte inside a packet being filled goes into it, as data
+		packet [packet_lg++] = byte;
+		if (packet_lg == 3 || byte == 0xF7) receive ();
+	}
+	return i;
+}
+
+uint32_t tuh_midi_stream_flush (uint8_t dev_addr)
+{
+	(void) dev_addr;
+	return 0;
+}
+
+
+// endpoint drained up to "now"
+static void drain (void)
+{
+	for (; drained + PACKET_TIME <= now; drained += PACKET_TIME) {
+		if (endpoint) endpoint--;
+	}
+}
+
+
+// realtime lane: clock ticks and CC messages, sent as far as a restore allows
+static void lane_task (void)
+{
+	uint32_t lg;
+
+	drain ();
+	if (now >= next_tick && lane_lg < LANE_SIZE) {
+		lane [lane_lg++] = 0xF8;
+		clocks_sent++;
+		next_tick += TICK;
+	}
+	if (now >= next_cc && lane_lg + 3 <= LANE_SIZE) {
+		lane [lane_lg++] = 0xB0;
+		lane [lane_lg++] = 74;
+		lane [lane_lg++] = (uint8_t) (ccs_sent & 0x7F);
+		ccs_sent++;
+		next_cc += CC_PERIOD;
+	}
+	if (lane_lg && (lg = restore_sendable (lane, lane_lg)) != 0) {
+		lg = tuh_midi_stream_write (DEV_ADDR, 0, lane, lg);
+		lane_lg -= lg;
+		memmove (lane, lane + lg, lane_lg);
+	}
+}
+
+
+// simulated stick: 2 SysEx files and a text file in the RESTORE folder
+bool stick_ready (void)
+{
+	return true;
+}
+
+FRESULT f_opendir (DIR * dp, const TCHAR * path)
+{
+	CHECK (strcmp (path, RESTORE_FOLDER) == 0);
+	dp->index = 0;
+	return FR_OK;
+}
+
+FRESULT f_readdir (DIR * dp, FILINFO * fno)
+{
+	memset (fno, 0, sizeof (*fno));
+	if (dp->index > FILES) return FR_OK;
+	strcpy (fno->fname, files [dp->index].name);
+	fno->fsize = files [dp->index].size;
+	dp->index++;
+	return FR_OK;
+}
+
+FRESULT f_closedir (DIR * dp)
+{
+	(void) dp;
+	return FR_OK;
+}
+
+FRESULT f_open (FIL * fp, const TCHAR * path, BYTE mode)
+{
+	int i;
+
+	CHECK (mode == FA_READ);
+	for (i = 0; i <= FILES; i++) {
+		if (strcmp (path + strlen (RESTORE_FOLDER) + 1, files [i].name) == 0) {
+			fp->index = i;
+			fp->position = 0;
+			return FR_OK;
+		}
+	}
+	return FR_NO_FILE;
+}
+
+FRESULT f_close (FIL * fp)
+{
+	(void) fp;
+	return FR_OK;
+}
+
+// a read waits for the stick; lane and endpoint keep running from the idle callback
+FRESULT f_read (FIL * fp, void * buffer, UINT btr, UINT * br)
+{
+	const struct sim_file * f = &files [fp->index];
+	uint64_t end = now + READ_TIME;
+
+	for (; now < end; now += LOOP) {
+		if (endpoint == 0) read_idle += LOOP;
+		lane_task ();
+	}
+	*br = (f->size - fp->position < btr) ? f->size - fp->position : btr;
+	memcpy (buffer, f->data + fp->position, *br);
+	fp->position += *br;
+	return FR_OK;
+}
+
+
+// SysEx messages of lengths not multiple of a packet, spanning sectors
+static void make_files (void)
+{
+	static const uint32_t lengths [] = { 5, 700, 3, 64, 129, 2, 1000, 17 };
+	uint32_t f, m, i;
+	struct sim_file * file;
+
+	for (f = 0; f < FILES; f++) {
+		file = &files [f * 2];
+		file->size = 0;
+		for (m = 0; m < sizeof (lengths) / sizeof (lengths [0]); m++) {
+			file->data [file->size++] = 0xF0;
+			for (i = 0; i < lengths [m] + f; i++) file->data [file->size++] = (uint8_t) ((i * 7 + m + f) & 0x7F);
+			file->data [file->size++] = 0xF7;
+		}
+	}
+	strcpy ((char *) files [1].data, "not a SysEx file");
+	files [1].size = 16;
+}
+
+
+// run a restore at "rate" with "gap" to its end; returns its duration (usec)
+static uint64_t run (uint32_t rate, uint32_t gap)
+{
+	struct restore_progress progress;
+	uint64_t start;
+	uint32_t i, ccs = 0, messages = 0, lg, expected = 0;
+	bool sysex = false;
+
+	nb_received = clocks_received = clocks_sent = ccs_sent = 0;
+	read_idle = 0;
+	start = next_tick = next_cc = drained = now;
+	CHECK (restore_start (rate, gap));
+	do {
+		restore_task (DEV_ADDR, now);
+		lane_task ();
+		now += LOOP;
+		restore_progress (&progress);
+	} while (progress.running && now < start + SIM_TIME);
+	CHECK (!progress.running && progress.bytes == progress.total);
+	for (; lane_lg; now += LOOP) lane_task ();
+
+	// clock ticks in their own packet; files in name order, with CC messages between SysEx messages only
+	CHECK (clocks_received == clocks_sent);
+	for (i = 0; i < nb_received; i++) {
+		if (received [i] == 0xF0) sysex = true;
+		if (sysex) {
+			CHECK (received [i] < 0x80 || received [i] == 0xF0 || received [i] == 0xF7);
+			received [expected++] = received [i];
+		}
+		else if (received [i] == 0xB0 && i + 2 < nb_received) {
+			ccs++;
+			i += 2;
+		}
+		if (received [i] == 0xF7) {
+			sysex = false;
+			messages++;
+		}
+	}
+	CHECK (ccs == ccs_sent);
+	lg = files [2].size;
+	CHECK (expected == files [2].size + files [0].size);
+	CHECK (memcmp (received, files [2].data, lg) == 0 && memcmp (received + lg, files [0].data, files [0].size) == 0);
+
+	printf ("rate %lu B/s, gap %lu us: %lu bytes, %lu messages in %lu ms; %lu clock ticks, %lu CC; wire idle %lu us while reading\n",
+		(unsigned long) rate, (unsigned long) gap, (unsigned long) progress.bytes, (unsigned long) messages,
+		(unsigned long) ((now - start) / 1000), (unsigned long) clocks_received, (unsigned long) ccs,
+		(unsigned long) read_idle);
+	return now - start;
+}
+
+
+int main (void)
+{
+	struct restore_progress progress;
+	uint64_t duration, paced;
+	uint32_t messages = 2 * 8;
+
+	make_files ();
+
+	// as fast as USB takes it: the wire only waits for the first read of each file; other reads start with a full
+	// endpoint, which holds about a read of data
+	run (0, 0);
+	restore_progress (&progress);
+	CHECK (read_idle <= FILES * READ_TIME + (progress.total / RESTORE_BUFFER + FILES) * (READ_TIME - ENDPOINT_PACKETS * PACKET_TIME + LOOP));
+
+	// paced: takes the time of its byte rate and gaps, reads fit in between
+	duration = run (RATE, GAP);
+	restore_progress (&progress);
+	paced = ((uint64_t) progress.total * 1000000) / RATE + (uint64_t) messages * GAP;
+	CHECK (duration <= paced + paced / 20 + FILES * READ_TIME);
+
+	// groovebox unplugged in the middle of a message: restore ends, and the lane goes again
+	CHECK (restore_start (0, 0));
+	for (; !restore_in_message (); now += LOOP) {
+		restore_task (DEV_ADDR, now);
+		drain ();
+	}
+	lane [0] = 0xB0;
+	CHECK (restore_sendable (lane, 1) == 0);
+	restore_task (0, now);
+	restore_progress (&progress);
+	CHECK (!progress.running && !restore_in_message ());
+	CHECK (restore_sendable (lane, 1) == 1);
+	CHECK (!sector_taken [0] && !sector_taken [1]);
+
+	return HOSTTEST_RESULT ();
+}
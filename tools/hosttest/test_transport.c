@@ -0,0 +1,70 @@
+/**
+ * @file test_transport.c
+ * @brief Transport state: transitions of the pedals and of the tick schedule, and their retry when the word changes
+ *
+ * A writer in another context is simulated by a transition that changes the state word the first time it is called,
+ * between the load and the compare-and-swap of transport_update (): the transition has to be applied again to the
+ * new state, and the returned state has to be the one it was actually applied to.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include <stdbool.h>
+#include "transport.h"
+#include "hosttest.h"
+
+// globals
+static uint32_t calls = 0;
+
+
+// PLAY pedal, while a STOP is received right after the state word has been read
+static uint32_t play_pedal_interrupted (uint32_t state, uint32_t arg)
+{
+	if (calls++ == 0) transport_set (TRANSPORT_ACTIVE, 0);
+	return transport_play_pedal (state, arg);
+}
+
+
+int main (void)
+{
+	uint32_t state;
+
+	// PLAY pedal: start with or without count-in, cancel while starting, stop while playing; song is kept
+	CHECK (transport_play_pedal (3, false) == (3 | TRANSPORT_STARTING));
+	CHECK (transport_play_pedal (3, true) == (3 | TRANSPORT_STARTING | TRANSPORT_COUNT_IN));
+	CHECK (transport_play_pedal (3 | TRANSPORT_STARTING | TRANSPORT_COUNT_IN, false) == 3);
+	CHECK (transport_play_pedal (3 | TRANSPORT_PLAY, false) == 3);
+	CHECK (transport_play_pedal (3 | TRANSPORT_PAUSE, true) == 3);
+
+	// end of count-in or pre-roll: play only if still starting
+	CHECK (transport_start_play (3 | TRANSPORT_STARTING | TRANSPORT_COUNT_IN, 0) == (3 | TRANSPORT_PLAY));
+	CHECK (transport_start_play (3 | TRANSPORT_STARTING, 0) == (3 | TRANSPORT_PLAY));
+	CHECK (transport_start_play (3, 0) == 3);
+	CHECK (transport_start_play (3 | TRANSPORT_PAUSE, 0) == (3 | TRANSPORT_PAUSE));
+
+	// CONTINUE pedal: resume when stopped or starting, stop when running
+	CHECK (transport_continue_pedal (3, 0) == (3 | TRANSPORT_PAUSE));
+	CHECK (transport_continue_pedal (3 | TRANSPORT_STARTING | TRANSPORT_COUNT_IN, 0) == (3 | TRANSPORT_PAUSE));
+	CHECK (transport_continue_pedal (3 | TRANSPORT_PLAY, 0) == 3);
+	CHECK (transport_continue_pedal (3 | TRANSPORT_PAUSE, 0) == 3);
+
+	// transport_set: clear then set, previous state returned
+	CHECK (transport_set (0, 5 | TRANSPORT_PLAY) == 0);
+	CHECK (transport_set (TRANSPORT_SONG, 7) == (5 | TRANSPORT_PLAY));
+	CHECK (transport_state () == (7 | TRANSPORT_PLAY));
+
+	// transition that changes nothing: state returned, nothing written
+	CHECK (transport_update (transport_start_play, 0) == (7 | TRANSPORT_PLAY));
+	CHECK (transport_state () == (7 | TRANSPORT_PLAY));
+
+	// PLAY pedal while playing, and STOP received meanwhile: pedal is applied again to the stopped state and starts
+	state = transport_update (play_pedal_interrupted, false);
+	CHECK (calls == 2);
+	CHECK (state == 7);
+	CHECK (transport_state () == (7 | TRANSPORT_STARTING));
+
+	return HOSTTEST_RESULT ();
+}
@@ -0,0 +1,17 @@
+/**
+ * @file tusb.h
+ * @brief Host stand-in for TinyUSB: the modules under test only need usb_midi_host.h
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _TUSB_H_
+#define _TUSB_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#endif /* _TUSB_H_ */
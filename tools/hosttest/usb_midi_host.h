@@ -0,0 +1,20 @@
+/**
+ * @file usb_midi_host.h
+ * @brief Host stand-in for the USB MIDI host driver: the stream functions used by the modules under test, which the
+ * tests define on a simulated endpoint
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _USB_MIDI_HOST_H_
+#define _USB_MIDI_HOST_H_
+
+#include <stdint.h>
+
+uint32_t tuh_midi_stream_write (uint8_t dev_addr, uint8_t cable_num, uint8_t const * buffer, uint32_t bufsize);
+uint32_t tuh_midi_stream_flush (uint8_t dev_addr);
+
+#endif /* _USB_MIDI_HOST_H_ */
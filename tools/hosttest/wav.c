@@ -0,0 +1,101 @@
+/**
+ * @file wav.c
+ * @brief WAV files of the host tests: 16-bit PCM, written mono, read mixed down to mono
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wav.h"
+
+// little endian fields
+static void put16 (uint8_t * p, uint32_t v) { p [0] = v; p [1] = v >> 8; }
+static void put32 (uint8_t * p, uint32_t v) { put16 (p, v); put16 (p + 2, v >> 16); }
+static uint32_t get16 (const uint8_t * p) { return p [0] | (p [1] << 8); }
+static uint32_t get32 (const uint8_t * p) { return get16 (p) | (get16 (p + 2) << 16); }
+
+
+// write "count" mono "samples" at "rate" (Hz) to "path"; returns false on error
+bool wav_write (const char * path, const int16_t * samples, uint32_t count, uint32_t rate)
+{
+	uint8_t header [44], data [2];
+	uint32_t i;
+	FILE * f = fopen (path, "wb");
+	bool ok;
+
+	if (f == NULL) return false;
+	memcpy (header, "RIFF", 4);
+	put32 (header + 4, 36 + count * 2);
+	memcpy (header + 8, "WAVEfmt ", 8);
+	put32 (header + 16, 16);
+	put16 (header + 20, 1);				// PCM
+	put16 (header + 22, 1);				// mono
+	put32 (header + 24, rate);
+	put32 (header + 28, rate * 2);
+	put16 (header + 32, 2);
+	put16 (header + 34, 16);
+	memcpy (header + 36, "data", 4);
+	put32 (header + 40, count * 2);
+	ok = fwrite (header, sizeof (header), 1, f) == 1;
+	for (i = 0; ok && i < count; i++) {
+		put16 (data, (uint16_t) samples [i]);
+		ok = fwrite (data, 2, 1, f) == 1;
+	}
+	return (fclose (f) == 0) && ok;
+}
+
+
+// read 16-bit PCM "path", channels mixed down to mono; returns samples (to be freed) and their "count" and "rate",
+// NULL on error
+int16_t * wav_read (const char * path, uint32_t * count, uint32_t * rate)
+{
+	uint8_t chunk [8], fmt [16];
+	uint32_t size, channels = 0, i, c;
+	int32_t sum;
+	int16_t * samples = NULL;
+	uint8_t * frames;
+	FILE * f = fopen (path, "rb");
+
+	if (f == NULL) return NULL;
+	if (fread (chunk, 8, 1, f) != 1 || memcmp (chunk, "RIFF", 4) || fread (chunk, 4, 1, f) != 1 || memcmp (chunk, "WAVE", 4)) {
+		fclose (f);
+		return NULL;
+	}
+
+	// chunks up to data; fmt must come first
+	while (fread (chunk, 8, 1, f) == 1) {
+		size = get32 (chunk + 4);
+		if (!memcmp (chunk, "fmt ", 4) && size >= 16) {
+			if (fread (fmt, 16, 1, f) != 1) break;
+			if (get16 (fmt) != 1 || get16 (fmt + 14) != 16) break;		// 16-bit PCM only
+			channels = get16 (fmt + 2);
+			*rate = get32 (fmt + 4);
+			fseek (f, (long) ((size - 16) + (size & 1)), SEEK_CUR);
+		}
+		else if (!memcmp (chunk, "data", 4) && channels != 0) {
+			*count = size / (2 * channels);
+			frames = malloc ((size_t) *count * 2 * channels);
+			samples = malloc ((size_t) *count * sizeof (int16_t));
+			if (frames && samples && fread (frames, 2 * channels, *count, f) == *count) {
+				for (i = 0; i < *count; i++) {
+					for (sum = 0, c = 0; c < channels; c++) sum += (int16_t) get16 (frames + (i * channels + c) * 2);
+					samples [i] = (int16_t) (sum / (int32_t) channels);
+				}
+			}
+			else {
+				free (samples);
+				samples = NULL;
+			}
+			free (frames);
+			break;
+		}
+		else fseek (f, (long) (size + (size & 1)), SEEK_CUR);
+	}
+	fclose (f);
+	return samples;
+}
@@ -0,0 +1,24 @@
+/**
+ * @file wav.h
+ * @brief WAV files of the host tests: 16-bit PCM, written mono, read mixed down to mono
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _WAV_H_
+#define _WAV_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// write "count" mono "samples" at "rate" (Hz) to "path"; returns false on error
+bool wav_write (const char * path, const int16_t * samples, uint32_t count, uint32_t rate);
+
+// read 16-bit PCM "path", channels mixed down to mono; returns samples (to be freed) and their "count" and "rate",
+// NULL on error
+int16_t * wav_read (const char * path, uint32_t * count, uint32_t * rate);
+
+#endif /* _WAV_H_ */
@@ -0,0 +1,94 @@
+/**
+ * @file transport.c
+ * @brief Transport state (session, play, pause, count-in) shared by the pedals, the tick schedule and the midi callbacks
+ *
+ * C11 atomics: on the RP2040 (Cortex-M0+, no exclusive load/store), the SDK implements them with a hardware spinlock.
+ * Only the state word is protected: what callers do on a transition (MTC, DIN out, realtime lane) is not, so every
+ * caller runs on core 0, from the main loop or its interrupts.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#include <stdatomic.h>
+#include "transport.h"
+
+_Static_assert ((TRANSPORT_SONG | TRANSPORT_ACTIVE) <= 0xFFFF, "fields fit the arguments of transport_set ()");
+
+// globals
+static _Atomic uint32_t state = 0;
+
+
+// snapshot of the state word
+uint32_t transport_state (void)
+{
+	return atomic_load_explicit (&state, memory_order_acquire);
+}
+
+
+// apply "transition" with "arg" atomically; returns the state it was applied to, so that caller acts on the
+// transition that was actually made
+uint32_t transport_update (transport_transition transition, uint32_t arg)
+{
+	uint32_t old = atomic_load_explicit (&state, memory_order_acquire);
+	uint32_t new;
+
+	do {
+		new = transition (old, arg);
+		if (new == old) return old;			// nothing to write
+	} while (!atomic_compare_exchange_weak_explicit (&state, &old, new, memory_order_acq_rel, memory_order_acquire));
+	return old;
+}
+
+
+// transition of transport_set (): bits to clear in high half of "arg", bits to set in low half
+static uint32_t clear_and_set (uint32_t s, uint32_t arg)
+{
+	return (s & ~(arg >> 16)) | (arg & 0xFFFF);
+}
+
+
+// clear bits "clear" of the state word, then set bits "set", atomically; returns previous state
+uint32_t transport_set (uint32_t clear, uint32_t set)
+{
+	return transport_update (clear_and_set, (clear << 16) | (set & 0xFFFF));
+}
+
+
+// end of count-in or pre-roll: play, unless start has been cancelled meanwhile
+uint32_t transport_start_play (uint32_t s, uint32_t arg)
+{
+	(void) arg;
+	if (!(s & TRANSPORT_STARTING)) return s;
+	return (s | TRANSPORT_PLAY) & ~(TRANSPORT_STARTING | TRANSPORT_COUNT_IN);
+}
+
+
+// PLAY pedal: stop if playing, cancel count-in or pre-roll if starting, start otherwise ("arg" is true for a count-in)
+uint32_t transport_play_pedal (uint32_t s, uint32_t arg)
+{
+	if (s & TRANSPORT_ACTIVE) return s & ~TRANSPORT_ACTIVE;
+	return s | TRANSPORT_STARTING | (arg ? TRANSPORT_COUNT_IN : 0);
+}
+
+
+// CONTINUE pedal: stop if playing, resume otherwise
+uint32_t transport_continue_pedal (uint32_t s, uint32_t arg)
+{
+	(void) arg;
+	if (s & TRANSPORT_RUNNING) return s & ~TRANSPORT_ACTIVE;
+	return (s | TRANSPORT_PAUSE) & ~(TRANSPORT_STARTING | TRANSPORT_COUNT_IN);
+}
+
+
+// pre-roll of a start without count-in: ticks still to stream so that receivers get "preroll_ticks" ticks at target
+// tempo, when "run_ticks" have been sent since the clock started or its tempo changed; rounded up to whole beats of
+// "beat_ticks", and at least 1, as MIDI_PLAY is sent right after a tick
+int32_t transport_preroll (int32_t run_ticks, int32_t preroll_ticks, int32_t beat_ticks)
+{
+	int32_t preroll = preroll_ticks - run_ticks;
+
+	return (preroll <= 1) ? 1 : ((preroll + beat_ticks - 1) / beat_ticks) * beat_ticks;
+}
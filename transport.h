@@ -0,0 +1,64 @@
+/**
+ * @file transport.h
+ * @brief Transport state (session, play, pause, count-in) shared by the pedals, the tick schedule and the midi callbacks
+ *
+ * The whole state is one packed 32-bit word. Readers take a snapshot with a single load, which is always consistent,
+ * without disabling interrupts. Writers apply a transition (new state as a function of the current one) with
+ * compare-and-swap: if another context changed the word in between, the transition is applied again to the new
+ * state, so that a pedal press and a STOP received at the same time never leave play and stop half applied.
+ *
+ * Transitions of the pedals and of the tick schedule are defined here, apart from the SDK, so that they are checked on
+ * a host: tools/hosttest/test_transport.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 denybear, rppicomidi
+ *
+ */
+
+#ifndef _TRANSPORT_H_
+#define _TRANSPORT_H_
+
+#include <stdint.h>
+
+// fields of the state word
+#define TRANSPORT_SONG		0x000000FF		// session of the groovebox (0 to sessions - 1)
+#define TRANSPORT_PLAY		0x00000100		// playing from start of song
+#define TRANSPORT_PAUSE		0x00000200		// playing, resumed with continue
+#define TRANSPORT_STARTING	0x00000400		// MIDI_PLAY is pending: it will be sent by the tick schedule, so that receivers start on tick 0
+#define TRANSPORT_COUNT_IN	0x00000800		// clicks are played while starting
+#define TRANSPORT_RUNNING	(TRANSPORT_PLAY | TRANSPORT_PAUSE)
+#define TRANSPORT_ACTIVE	(TRANSPORT_RUNNING | TRANSPORT_STARTING | TRANSPORT_COUNT_IN)	// cleared on stop
+
+// without count-in, clock ticks streamed at target tempo before MIDI_PLAY, so that receivers lock on tempo first
+// (settling time of receiver models: tools/hosttest/test_preroll)
+#define TRANSPORT_PREROLL_TICKS	48
+
+// transition: returns the new state from "state"; may be called more than once for one update, so it has no side effect
+typedef uint32_t (* transport_transition) (uint32_t state, uint32_t arg);
+
+// snapshot of the state word
+uint32_t transport_state (void);
+
+// apply "transition" with "arg" atomically; returns the state it was applied to, so that caller acts on the
+// transition that was actually made
+uint32_t transport_update (transport_transition transition, uint32_t arg);
+
+// clear bits "clear" of the state word, then set bits "set", atomically; returns previous state
+uint32_t transport_set (uint32_t clear, uint32_t set);
+
+// end of count-in or pre-roll: play, unless start has been cancelled meanwhile
+uint32_t transport_start_play (uint32_t state, uint32_t arg);
+
+// PLAY pedal: stop if playing, cancel count-in or pre-roll if starting, start otherwise ("arg" is true for a count-in)
+uint32_t transport_play_pedal (uint32_t state, uint32_t arg);
+
+// CONTINUE pedal: stop if playing, resume otherwise
+uint32_t transport_continue_pedal (uint32_t state, uint32_t arg);
+
+// pre-roll of a start without count-in: ticks still to stream so that receivers get "preroll_ticks" ticks at target
+// tempo, when "run_ticks" have been sent since the clock started or its tempo changed; rounded up to whole beats of
+// "beat_ticks", and at least 1, as MIDI_PLAY is sent right after a tick
+int32_t transport_preroll (int32_t run_ticks, int32_t preroll_ticks, int32_t beat_ticks);
+
+#endif /* _TRANSPORT_H_ */
@@ -76,7 +76,9 @@
 
 #define CFG_TUH_HUB                 1 // Enable USB hubs
 #define CFG_TUH_CDC                 0
-#define CFG_TUH_HID                 0 // typical keyboard + mouse device can have 3-4 HID interfaces
+#define CFG_TUH_HID                 4 // USB footswitches (HID keyboards); typical keyboard + mouse device can have 3-4 HID interfaces
+#define CFG_TUH_HID_EPIN_BUFSIZE    64
+#define CFG_TUH_HID_EPOUT_BUFSIZE   64
 //NOTE: Do note #define CFG_TUH_MIDI 1 to enable MIDI Host. A code fragment in usbh.c that breaks the build if you do that
 #define CFG_TUH_MSC                 1
 #define CFG_TUH_VENDOR              0